@@ -1,6 +1,8 @@
 #ifndef DEFINE_HPP
 #define DEFINE_HPP
 
+#include <stdint.h>
+
 /* OS */
 #if defined(__linux__)
 #define LINUX 1
@@ -36,6 +38,23 @@
 
 #define REQUEST_FLAGS EPOLLIN | EPOLLRDHUP | EPOLLERR // Quand on attend une requete
 #define RESPONSE_FLAGS EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLOUT // Quand la reponse est prete est que l'on a quelque chose a envoyer dans le socket
+#define LISTEN_FLAGS EPOLLIN | EPOLLET // Le socket d'ecoute est vide jusqu'a EAGAIN a chaque notification
 #define MAX_EVENTS 100
 
+/* EPOLL DATA: owner pointer, its kind in the low bits (objects are at least 8-byte aligned) */
+#define EPOLL_TAG_CLIENT 0 // Client socket: its fd, found in the client table, a client deleted earlier in the batch is not found
+#define EPOLL_TAG_SOCKET 1 // Listening socket
+#define EPOLL_TAG_WATCH 2 // File cache inotify fd, disk I/O eventfd
+#define EPOLL_TAG_FASTCGI 3 // Connection to a FastCGI process
+#define EPOLL_TAG_CGI_STDIN 4 // Pipes of a CGI: the fd of its client instead of a pointer, a CGI
+#define EPOLL_TAG_CGI_STDOUT 5 // deleted earlier in the same epoll_wait batch is then just not found
+#define EPOLL_TAG_CGI_EXIT 6 // pidfd of a CGI process, client fd too
+#define EPOLL_TAG_SIGNAL 7 // A child exited: SIGCHLD signalfd (no pidfd support), or pidfd of a killed CGI
+#define EPOLL_TAG_MASK ((uintptr_t)7)
+#define EPOLL_TAG(ptr, tag) ((void *)((uintptr_t)(ptr) | (tag)))
+#define EPOLL_TAG_OF(ptr) ((uintptr_t)(ptr) & EPOLL_TAG_MASK)
+#define EPOLL_UNTAG(ptr) ((void *)((uintptr_t)(ptr) & ~EPOLL_TAG_MASK))
+#define EPOLL_TAG_FD(fd, tag) EPOLL_TAG((uintptr_t)(fd) << 3, tag)
+#define EPOLL_UNTAG_FD(ptr) ((int)((uintptr_t)EPOLL_UNTAG(ptr) >> 3))
+
 #endif // DEFINE_HPP
@@ -0,0 +1,271 @@
+#include "FileCache.hpp"
+#include "OutputBuffer.hpp"
+#include "Utils.hpp"
+#include "Logger.hpp"
+
+#include <climits>
+#include <cstdlib>
+
+/*
+** ------------------------------- CONSTRUCTOR --------------------------------
+*/
+
+FileCache::FileCache(void) : _maxSize(FC_DEFAULT_SIZE), _valid(FC_DEFAULT_VALID), _size(0)
+{
+}
+
+/*
+** -------------------------------- DESTRUCTOR --------------------------------
+*/
+
+FileCache::~FileCache(void)
+{
+}
+
+/*
+** --------------------------------- METHODS ----------------------------------
+*/
+
+/*
+** @brief Set the memory cap and the revalidation interval, drop what no longer fits
+*/
+void	FileCache::configure(unsigned long long maxSize, time_t valid)
+{
+	this->_maxSize = maxSize;
+	this->_valid = valid;
+	this->_evict(0);
+}
+
+/*
+** @brief Find a fresh entry for path
+** the file is stat'ed again only when the entry is older than the interval
+**
+** @return the entry, or NULL if not cached or changed on disk
+*/
+const FileCache::Entry*	FileCache::lookup(const std::string &path)
+{
+	t_index::iterator it = this->_index.find(path);
+	if (it == this->_index.end())
+		return (NULL);
+
+	Entry	&entry = *it->second;
+	uint64_t	now = Clock::now();
+	if (!entry.watched && now - entry.validated >= (uint64_t)this->_valid * 1000)
+	{
+		struct stat fileStat;
+		if (stat(path.c_str(), &fileStat) == -1 || !FileCache::_sameFile(entry, fileStat))
+		{
+			LOG_DEBUG("[FileCache] %s changed on disk", path.c_str());
+			this->_erase(it);
+			return (NULL);
+		}
+		entry.validated = now;
+	}
+	this->_lru.splice(this->_lru.begin(), this->_lru, it->second);
+	return (&entry);
+}
+
+/*
+** @brief Cache a rendered response for key, path is the file or directory
+** it was built from, fileStat its identity
+**
+** @return the new entry, or NULL if it does not fit
+*/
+const FileCache::Entry*	FileCache::insert(const std::string &key, const std::string &path, std::string &headers, std::string &body, const struct stat &fileStat)
+{
+	if (!this->isCacheable(headers.size() + body.size()))
+		return (NULL);
+
+	this->invalidate(key);
+	Entry entry;
+	entry.key = key;
+	entry.headers = SharedBuffer(headers);
+	entry.body = SharedBuffer(body);
+	entry.dev = fileStat.st_dev;
+	entry.ino = fileStat.st_ino;
+	entry.mtime = fileStat.st_mtim;
+	entry.size = fileStat.st_size;
+	entry.validated = Clock::now();
+	entry.watched = false;
+
+	char resolved[PATH_MAX];
+	if (realpath(path.c_str(), resolved) != NULL)
+	{
+		entry.canonical = resolved;
+		if (S_ISDIR(fileStat.st_mode)) // A listing changes with the entries of the directory itself
+			entry.watched = this->_watcher.watch(entry.canonical, true);
+		else
+		{
+			size_t pos = entry.canonical.find_last_of('/');
+			entry.watched = this->_watcher.watch(pos == 0 ? "/" : entry.canonical.substr(0, pos), true);
+		}
+	}
+
+	unsigned long long size = this->_entrySize(entry);
+	this->_evict(size);
+	this->_lru.push_front(entry);
+	this->_index[key] = this->_lru.begin();
+	if (!entry.canonical.empty())
+		this->_canonical.insert(std::make_pair(entry.canonical, key));
+	this->_size += size;
+	LOG_DEBUG("[FileCache] Cached %s (%llu bytes, %llu/%llu used, %s)", path.c_str(), size, this->_size, this->_maxSize, entry.watched ? "watched" : "stat");
+	return (&this->_lru.front());
+}
+
+/*
+** @brief Cache a file read in full with its 200 header block
+** The content of body is taken without copy (swap)
+**
+** @return the new entry, or NULL if the file does not fit
+*/
+const FileCache::Entry*	FileCache::insertFile(const std::string &path, std::string &body, const struct stat &fileStat, const std::string &mimeType)
+{
+	std::string headers = "HTTP/1.1 200 OK\r\n";
+	headers += "Content-Type: " + mimeType + "\r\n";
+	headers += "Content-Length: " + Utils::ullToStr(fileStat.st_size) + "\r\n";
+	headers += "\r\n";
+	return (this->insert(path, path, headers, body, fileStat));
+}
+
+/*
+** @brief Drop the entry of key if any
+*/
+void	FileCache::invalidate(const std::string &key)
+{
+	t_index::iterator it = this->_index.find(key);
+	if (it != this->_index.end())
+		this->_erase(it);
+}
+
+/*
+** @brief Drop the entries built from the canonical path
+*/
+void	FileCache::invalidateCanonical(const std::string &path)
+{
+	std::pair<t_canonical::iterator, t_canonical::iterator> range = this->_canonical.equal_range(path);
+	this->_eraseKeys(range.first, range.second);
+}
+
+/*
+** @brief Drop the entries built from dir or from anything below it
+*/
+void	FileCache::invalidateTree(const std::string &dir)
+{
+	this->invalidateCanonical(dir);
+	std::string prefix = dir == "/" ? dir : dir + "/";
+	t_canonical::iterator last = this->_canonical.lower_bound(prefix);
+	while (last != this->_canonical.end() && last->first.compare(0, prefix.size(), prefix) == 0)
+		++last;
+	this->_eraseKeys(this->_canonical.lower_bound(prefix), last);
+}
+
+/*
+** @brief Drop every entry, the buffers still queued on clients stay alive
+*/
+void	FileCache::clear(void)
+{
+	this->_index.clear();
+	this->_canonical.clear();
+	this->_lru.clear();
+	this->_size = 0;
+}
+
+/*
+** @brief Watch a root or alias of the configuration
+*/
+void	FileCache::watchRoot(const std::string &root)
+{
+	char resolved[PATH_MAX];
+
+	if (!this->isEnabled() || root.empty())
+		return ;
+	this->_watcher.init();
+	if (realpath(root.c_str(), resolved) != NULL)
+		this->_watcher.watch(resolved, false);
+}
+
+/*
+** @brief Watch the directory of a file before it is read for the cache:
+** a change during the read or before the insert is then seen
+*/
+void	FileCache::watchFile(const std::string &path)
+{
+	char resolved[PATH_MAX];
+
+	if (!this->isEnabled() || realpath(path.c_str(), resolved) == NULL)
+		return ;
+	std::string canonical(resolved);
+	size_t pos = canonical.find_last_of('/');
+	this->_watcher.watch(pos == 0 ? "/" : canonical.substr(0, pos), true);
+}
+
+/*
+** @brief Queue the cached response, only references are taken
+*/
+void	FileCache::pushEntry(OutputBuffer &output, const Entry &entry)
+{
+	output.push(entry.headers);
+	output.push(entry.body);
+}
+
+/*
+** --------------------------------- PRIVATE ----------------------------------
+*/
+
+unsigned long long	FileCache::_entrySize(const Entry &entry) const
+{
+	return (entry.headers.size() + entry.body.size() + entry.key.size() + entry.canonical.size());
+}
+
+void	FileCache::_erase(t_index::iterator it)
+{
+	Entry &entry = *it->second;
+
+	std::pair<t_canonical::iterator, t_canonical::iterator> range = this->_canonical.equal_range(entry.canonical);
+	for (t_canonical::iterator canonical = range.first; canonical != range.second; ++canonical)
+	{
+		if (canonical->second == entry.key)
+		{
+			this->_canonical.erase(canonical);
+			break ;
+		}
+	}
+	this->_size -= this->_entrySize(entry);
+	this->_lru.erase(it->second);
+	this->_index.erase(it);
+}
+
+/*
+** @brief Drop the entries of a range of the canonical index
+*/
+void	FileCache::_eraseKeys(t_canonical::iterator first, t_canonical::iterator last)
+{
+	std::vector<std::string> keys;
+	for (; first != last; ++first)
+		keys.push_back(first->second);
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		LOG_DEBUG("[FileCache] Invalidate %s", keys[i].c_str());
+		this->invalidate(keys[i]);
+	}
+}
+
+/*
+** @brief Drop the least recently used entries until needed more bytes fit
+*/
+void	FileCache::_evict(unsigned long long needed)
+{
+	while (!this->_lru.empty() && this->_size + needed > this->_maxSize)
+	{
+		LOG_DEBUG("[FileCache] Evict %s", this->_lru.back().key.c_str());
+		this->_erase(this->_index.find(this->_lru.back().key));
+	}
+}
+
+bool	FileCache::_sameFile(const Entry &entry, const struct stat &fileStat)
+{
+	return (entry.dev == fileStat.st_dev && entry.ino == fileStat.st_ino
+		&& entry.size == fileStat.st_size
+		&& entry.mtime.tv_sec == fileStat.st_mtim.tv_sec
+		&& entry.mtime.tv_nsec == fileStat.st_mtim.tv_nsec);
+}
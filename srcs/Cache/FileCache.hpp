@@ -0,0 +1,98 @@
+#ifndef FILECACHE_HPP
+# define FILECACHE_HPP
+
+# include <string>
+# include <map>
+# include <list>
+# include <ctime>
+# include <sys/stat.h>
+
+# include "SharedBuffer.hpp"
+# include "FileWatcher.hpp"
+# include "Clock.hpp"
+
+# define FC_DEFAULT_SIZE 0 // bytes, 0 disables the cache
+# define FC_DEFAULT_VALID 1 // seconds between two stat of a cached file
+# define FC_MAX_ENTRY_SIZE 1048576 // bigger files are always streamed with sendfile
+
+class OutputBuffer;
+
+/*
+** LRU cache of the static files and directory listings served as a whole 200
+** response. An entry is keyed on the resolved path and holds the pre-rendered
+** header block and the body as shared buffers, so a hit queues two references
+** and touches neither stat, open nor read.
+** Entries whose directory is watched by inotify are dropped by the watcher as
+** soon as something changes. The others (watch limit reached) have their
+** identity (inode, mtime, size) checked again with a single stat once older
+** than the revalidation interval.
+** Each worker process owns its own cache.
+*/
+class FileCache
+{
+	public:
+		struct Entry
+		{
+			std::string		key;
+			std::string		canonical; // realpath, what the watcher reports
+			bool			watched;
+			SharedBuffer	headers;
+			SharedBuffer	body;
+			dev_t			dev;
+			ino_t			ino;
+			struct timespec	mtime;
+			off_t			size;
+			uint64_t		validated; // ms, Clock::now() base
+		};
+
+	private:
+		typedef std::list<Entry>								t_lru;
+		typedef std::map<std::string, t_lru::iterator>		t_index;
+		typedef std::multimap<std::string, std::string>		t_canonical;
+
+		unsigned long long	_maxSize;
+		time_t				_valid;
+		unsigned long long	_size;
+		t_lru				_lru; // most recently used first
+		t_index				_index;
+		t_canonical			_canonical; // canonical path -> key
+		FileWatcher			_watcher;
+
+		unsigned long long	_entrySize(const Entry &entry) const;
+		void				_erase(t_index::iterator it);
+		void				_eraseKeys(t_canonical::iterator first, t_canonical::iterator last);
+		void				_evict(unsigned long long needed);
+		static bool			_sameFile(const Entry &entry, const struct stat &fileStat);
+
+		FileCache(const FileCache &src);
+		FileCache &operator=(const FileCache &rhs);
+
+	public:
+		FileCache(void);
+		~FileCache(void);
+
+		void			configure(unsigned long long maxSize, time_t valid);
+		const Entry*	lookup(const std::string &path);
+		const Entry*	insert(const std::string &key, const std::string &path, std::string &headers, std::string &body, const struct stat &fileStat);
+		const Entry*	insertFile(const std::string &path, std::string &body, const struct stat &fileStat, const std::string &mimeType);
+		void			invalidate(const std::string &key);
+		void			invalidateCanonical(const std::string &path);
+		void			invalidateTree(const std::string &dir);
+		void			clear(void);
+
+		/* WATCHER */
+		void			watchRoot(const std::string &root);
+		void			watchFile(const std::string &path);
+		void			handleWatchEvents(void) { _watcher.handleEvents(*this); }
+		int				getWatchFd(void) const { return _watcher.getFd(); }
+
+		static void		pushEntry(OutputBuffer &output, const Entry &entry);
+
+		/* GETTERS */
+		bool				isEnabled(void) const { return _maxSize > 0; }
+		bool				isCacheable(off_t size) const { return _maxSize > 0 && size <= FC_MAX_ENTRY_SIZE && (unsigned long long)size <= _maxSize; }
+		unsigned long long	getSize(void) const { return _size; }
+		size_t				getCount(void) const { return _index.size(); }
+};
+
+#endif // FILECACHE_HPP
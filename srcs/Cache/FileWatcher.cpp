@@ -0,0 +1,167 @@
+#include "FileWatcher.hpp"
+#include "FileCache.hpp"
+#include "Utils.hpp"
+#include "Logger.hpp"
+
+/*
+** ------------------------------- CONSTRUCTOR --------------------------------
+*/
+
+FileWatcher::FileWatcher(void) : _fd(-1), _limitReached(false)
+{
+}
+
+/*
+** -------------------------------- DESTRUCTOR --------------------------------
+*/
+
+FileWatcher::~FileWatcher(void)
+{
+	if (this->_fd != -1)
+		close(this->_fd);
+}
+
+/*
+** --------------------------------- METHODS ----------------------------------
+*/
+
+/*
+** @brief Create the inotify instance, without it every entry is stat'ed
+*/
+void	FileWatcher::init(void)
+{
+	if (this->_fd != -1)
+		return ;
+	this->_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (this->_fd == -1)
+		LOG_WARNING("[FileWatcher] inotify unavailable (%s), cached files will be revalidated with stat", strerror(errno));
+}
+
+/*
+** @brief Watch a canonical directory
+**
+** @param ancestors also watch the parents up to /, so that renaming any of
+** them is seen. A directory already watched without them (a root) gets
+** them now. If one of them cannot be watched, a dir added by this call is
+** not watched either
+** @return true if dir is watched, with its ancestors when asked
+*/
+bool	FileWatcher::watch(const std::string &dir, bool ancestors)
+{
+	if (this->_fd == -1 || dir.empty())
+		return (false);
+	std::map<std::string, Watch>::iterator it = this->_wds.find(dir);
+	if (it != this->_wds.end() && (!ancestors || it->second.ancestors))
+		return (true);
+
+	int wd = (it != this->_wds.end()) ? it->second.wd : -1;
+	if (wd == -1)
+	{
+		wd = inotify_add_watch(this->_fd, dir.c_str(), FW_EVENTS);
+		if (wd == -1)
+		{
+			if (errno == ENOSPC && !this->_limitReached)
+				LOG_WARNING("[FileWatcher] inotify watch limit reached, falling back to stat revalidation");
+			else if (errno != ENOSPC)
+				LOG_DEBUG("[FileWatcher] Cannot watch %s: %s", dir.c_str(), strerror(errno));
+			this->_limitReached = this->_limitReached || errno == ENOSPC;
+			return (false);
+		}
+		Watch watch = { wd, false };
+		this->_dirs[wd] = dir;
+		this->_wds[dir] = watch;
+		LOG_DEBUG("[FileWatcher] Watching %s", dir.c_str());
+	}
+	if (!ancestors)
+		return (true);
+
+	size_t pos = dir.find_last_of('/');
+	if (dir != "/" && !this->watch(pos == 0 ? "/" : dir.substr(0, pos), true))
+	{
+		// A rename above it would go unseen: its entries are stat'ed instead
+		if (it == this->_wds.end())
+		{
+			inotify_rm_watch(this->_fd, wd);
+			this->_forget(wd);
+		}
+		return (false);
+	}
+	this->_wds[dir].ancestors = true;
+	return (true);
+}
+
+/*
+** @brief Drain the inotify fd and invalidate what changed
+** a renamed or deleted directory drops everything cached below it
+*/
+void	FileWatcher::handleEvents(FileCache &cache)
+{
+	char	buffer[FW_READ_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t	bytesRead;
+
+	while ((bytesRead = read(this->_fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char *ptr = buffer; ptr < buffer + bytesRead; )
+		{
+			const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+			ptr += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				LOG_WARNING("[FileWatcher] inotify queue overflow, dropping the whole cache");
+				cache.clear();
+				continue ;
+			}
+			std::map<int, std::string>::iterator it = this->_dirs.find(event->wd);
+			if (it == this->_dirs.end())
+				continue ;
+			std::string dir = it->second;
+
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+			{
+				cache.invalidateTree(dir);
+				if (!(event->mask & IN_IGNORED))
+					inotify_rm_watch(this->_fd, event->wd);
+				this->_forget(event->wd);
+				this->_forgetTree(dir);
+				continue ;
+			}
+			cache.invalidateCanonical(dir); // Its listing
+			if (event->len == 0)
+				continue ;
+			std::string path = (dir == "/" ? "" : dir) + "/" + event->name;
+			cache.invalidateCanonical(path);
+			if ((event->mask & IN_ISDIR) && (event->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))
+				cache.invalidateTree(path);
+		}
+	}
+	if (bytesRead == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+		LOG_ERROR("[FileWatcher] read failed: %s", strerror(errno));
+}
+
+void	FileWatcher::_forget(int wd)
+{
+	std::map<int, std::string>::iterator it = this->_dirs.find(wd);
+	if (it == this->_dirs.end())
+		return ;
+	this->_wds.erase(it->second);
+	this->_dirs.erase(it);
+}
+
+/*
+** @brief Drop the watches below a directory gone or renamed: they keep
+** watching the moved directories under their old paths, and a directory
+** created there later would pass for watched
+*/
+void	FileWatcher::_forgetTree(const std::string &dir)
+{
+	std::string prefix = (dir == "/" ? "" : dir) + "/";
+	std::map<std::string, Watch>::iterator it = this->_wds.lower_bound(prefix);
+
+	while (it != this->_wds.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+	{
+		int wd = (it++)->second.wd;
+		inotify_rm_watch(this->_fd, wd);
+		this->_forget(wd);
+	}
+}
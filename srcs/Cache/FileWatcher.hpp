@@ -0,0 +1,54 @@
+#ifndef FILEWATCHER_HPP
+# define FILEWATCHER_HPP
+
+# include <string>
+# include <map>
+# include <sys/inotify.h>
+
+# define FW_EVENTS (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE \
+	| IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+# define FW_READ_BUFFER_SIZE 16384
+
+class FileCache;
+
+/*
+** inotify instance of a reactor, its fd sits in the epoll next to the
+** listening sockets. Directories are watched by canonical path: the roots
+** at startup, then the directory (and its ancestors) of every cached entry.
+** When a watch cannot be added (watch limit reached, no inotify) the entry
+** is simply not marked as watched and the cache stat's it on a schedule.
+*/
+class FileWatcher
+{
+	private:
+		struct Watch
+		{
+			int		wd;
+			bool	ancestors; // Its parents are watched too, up to /
+		};
+
+		int								_fd;
+		bool							_limitReached;
+		std::map<int, std::string>		_dirs; // wd -> canonical directory
+		std::map<std::string, Watch>	_wds;
+
+		void	_forget(int wd);
+		void	_forgetTree(const std::string &dir);
+
+		FileWatcher(const FileWatcher &src);
+		FileWatcher &operator=(const FileWatcher &rhs);
+
+	public:
+		FileWatcher(void);
+		~FileWatcher(void);
+
+		void	init(void);
+		bool	watch(const std::string &dir, bool ancestors);
+		void	handleEvents(FileCache &cache);
+
+		/* GETTERS */
+		int		getFd(void) const { return _fd; }
+		bool	isWatched(const std::string &dir) const { return _wds.find(dir) != _wds.end(); }
+};
+
+#endif // FILEWATCHER_HPP
@@ -1,6 +1,8 @@
 #include "CgiExecutor.hpp"
+#include "FastCgiPool.hpp"
+#include "Webserv.hpp"
 
-CgiExecutor::CgiExecutor(RequestCgi *requestCgi) : _requestCgi(requestCgi), _envp(NULL), _argv(NULL), _body(true), _pid(-1), _StdinBackup(-1), _StdoutBackup(-1)
+CgiExecutor::CgiExecutor(RequestCgi *requestCgi) : _requestCgi(requestCgi), _pid(-1), _owner(-1), _pool(NULL), _pidFd(-1), _exited(false), _status(0), _stdinFd(-1), _stdoutFd(-1), _stdinWatched(false), _stdoutPaused(false), _clientPaused(false), _inputOffset(0), _inputFd(-1), _inputRead(0), _inputOp(NULL), _inputEnd(false)
 {
 }
 
@@ -9,29 +11,36 @@ CgiExecutor::CgiExecutor(const CgiExecutor &src)
 	*this = src;
 }
 
+/*
+** @brief Close the pipes and stop a CGI still running, the server reaps it.
+** A forked FastCGI process unwinding its copy of the server only closes its
+** copies: the epoll and the CGI processes belong to the server
+*/
 CgiExecutor::~CgiExecutor(void)
 {
-	if (this->_envp)
-	{
-		for (int i = 0; this->_envp[i]; i++)
-			delete[] this->_envp[i];
-		delete[] this->_envp;
-	}
-	if (this->_argv)
-	{
-		for (int i = 0; this->_argv[i]; i++)
-			delete[] this->_argv[i];
-		delete[] this->_argv;
-	}
-	if (this->_StdinBackup != -1)
+	if (this->_pool)
+		this->_pool->cancel(this, false);
+	if (this->_inputOp != NULL && getpid() == this->_owner) // The file belongs to the request body
+		g_server->getDiskIo().detach(this->_inputOp, false);
+	if (this->_pid > 0 && getpid() != this->_owner)
 	{
-		close(this->_StdinBackup);
-		this->_StdinBackup = -1;
+		if (this->_stdinFd != -1)
+			close(this->_stdinFd);
+		if (this->_stdoutFd != -1)
+			close(this->_stdoutFd);
+		if (this->_pidFd != -1)
+			close(this->_pidFd);
 	}
-	if (this->_StdoutBackup != -1)
+	else
 	{
-		close(this->_StdoutBackup);
-		this->_StdoutBackup = -1;
+		this->_closeInput();
+		this->_closeOutput();
+		if (this->_pid > 0 && !this->_exited)
+		{
+			kill(this->_pid, SIGTERM);
+			g_server->unwatchChild(this->_pid);
+			g_server->adoptChild(this->_pid, this->_pidFd);
+		}
 	}
 }
 
@@ -46,105 +55,467 @@ CgiExecutor &CgiExecutor::operator=(const CgiExecutor &src)
 
 void CgiExecutor::_init(void)
 {
-	Logger::log(Logger::DEBUG, "[CgiExecutor::_init] Start CGI Executor");
-	Logger::log(Logger::DEBUG, "[CgiExecutor::_init] Path: %s", this->_requestCgi->_path.c_str());
-	Logger::log(Logger::DEBUG, "[CgiExecutor::_init] ExecPath: %s", this->_requestCgi->_execPath.c_str());
-
-	// Add env variables
-	this->_env["SERVER_SOFTWARE"] = "webserv/1.0";
-	this->_env["SERVER_NAME"] = this->_requestCgi->_request->_headers["Host"];
-	this->_env["SERVER_PROTOCOL"] = this->_requestCgi->_request->_httpVersion;
-	this->_env["SERVER_PORT"] = intToString(this->_requestCgi->_request->_client->getSocket()->getPort());
-	this->_env["REDIRECT_STATUS"] = "200";
-	this->_env["REQUEST_METHOD"] = this->_requestCgi->_request->_method;
-	this->_env["GATEWAY_INTERFACE"] = "CGI/1.1";
-	this->_env["SCRIPT_NAME"] = this->_requestCgi->_path;
-	this->_env["SCRIPT_FILENAME"] = this->_requestCgi->_path;
-	this->_env["PATH_INFO"] = this->_requestCgi->_path;
-	this->_env["PATH_TRANSLATED"] = this->_requestCgi->_path; // Not implemented
-	this->_env["QUERY_STRING"] = this->_requestCgi->_request->_query;
-	this->_env["REQUEST_URI"] = this->_requestCgi->_request->_uri;
-	this->_env["REMOTE_ADDR"] = this->_requestCgi->_request->_client->getSocket()->getIp();
-	this->_env["REMOTE_IDENT"] = this->_requestCgi->_request->_headers["Authorization"];
-	this->_env["REMOTE_USER"] = this->_requestCgi->_request->_headers["Authorization"];
-	this->_env["CONTENT_LENGTH"] = Utils::ullToStr(this->_requestCgi->_request->_body._size);
-	this->_env["CONTENT_TYPE"] = this->_requestCgi->_request->_headers["Content-Type"];
-	this->_env["HTTP_COOKIE"] = this->_requestCgi->_request->_headers["Cookie"];
+	LOG_DEBUG("[CgiExecutor::_init] Start CGI Executor");
+	LOG_DEBUG("[CgiExecutor::_init] Path: %s", this->_requestCgi->_path.c_str());
+	LOG_DEBUG("[CgiExecutor::_init] ExecPath: %s", this->_requestCgi->_execPath.c_str());
+
+	Request	*request = this->_requestCgi->_request;
+
+	// SERVER_SOFTWARE, GATEWAY_INTERFACE and SERVER_PORT are built once by the location and the socket
+	this->_env.reserve(CGI_ENV_SIZE);
+	this->_setEnv("SERVER_NAME", request->getHeader("Host"));
+	this->_setEnv("SERVER_PROTOCOL", request->_httpVersion);
+	this->_setEnv("REQUEST_METHOD", request->_method);
+	this->_setEnv("SCRIPT_NAME", this->_requestCgi->_path);
+	this->_setEnv("SCRIPT_FILENAME", this->_requestCgi->_path);
+	this->_setEnv("PATH_INFO", this->_requestCgi->_path);
+	this->_setEnv("PATH_TRANSLATED", this->_requestCgi->_path); // Not implemented
+	this->_setEnv("QUERY_STRING", request->_query);
+	this->_setEnv("REQUEST_URI", request->_uri);
+	this->_setEnv("REMOTE_ADDR", request->_client->getSocket()->getIp());
+	this->_setEnv("REMOTE_IDENT", request->getHeader("Authorization"));
+	this->_setEnv("REMOTE_USER", request->getHeader("Authorization"));
+	this->_setEnv("CONTENT_LENGTH", Utils::ullToStr(request->_isChunked ? request->_body._size : request->_contentLength)); // A streamed body is not received yet
+	this->_setEnv("CONTENT_TYPE", request->getHeader("Content-Type"));
+	this->_setEnv("HTTP_COOKIE", request->getHeader("Cookie"));
+	this->_buildEnvp();
 }
 
+/*
+** @brief Spawn the CGI with a pipe on its stdin and one on its stdout
+** a body already received (spooled, chunked) is copied to the pipe from its
+** file, otherwise the request feeds it as it arrives.
+** posix_spawn runs the child on the memory of the server until its execve
+** (vfork), so launching does not copy the page tables of a large server,
+** and an execve failure is reported here instead of by a child
+*/
 void CgiExecutor::_execute(void)
 {
-	Logger::log(Logger::DEBUG, "[CgiExecutor::_execute] Start CGI Executor");
-	this->_envp = this->_envToChar();
-	this->_argv = this->_buildArgv();
-	this->_StdinBackup = dup(STDIN_FILENO);
-	this->_StdoutBackup = dup(STDOUT_FILENO);
+	int							stdinPipe[2];
+	int							stdoutPipe[2];
+	posix_spawn_file_actions_t	actions;
+	posix_spawnattr_t			attr;
+	sigset_t					signals;
 
-	if (Utils::createTmpFile(this->_body._path, this->_body._fd) == -1)
-		throw std::invalid_argument("[CgiExecutor::_execute] createTmpFile failed");
+	LOG_DEBUG("[CgiExecutor::_execute] Start CGI Executor");
+	this->_buildArgv();
 
-	// if there is a body, we need to put the body in the stdin
-	if (this->_requestCgi->_request->_body._fd != -1) // Start from the beginning of the body, if there is one
-		if (lseek(this->_requestCgi->_request->_body._fd, 0, SEEK_SET) == -1)
-			throw std::invalid_argument("[CgiExecutor::_execute] lseek failed");
-			
-	this->_pid = fork();
-	if (this->_pid == -1)
-		throw std::invalid_argument("[CgiExecutor::_execute] fork failed");
-	if (this->_pid == 0)
+	if (pipe2(stdinPipe, O_CLOEXEC) == -1)
+		throw std::invalid_argument("[CgiExecutor::_execute] pipe failed");
+	if (pipe2(stdoutPipe, O_CLOEXEC) == -1)
+	{
+		close(stdinPipe[0]);
+		close(stdinPipe[1]);
+		throw std::invalid_argument("[CgiExecutor::_execute] pipe failed");
+	}
+	// dup2 clears the close-on-exec flag of the copies, every other fd of the server is closed by the execve
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, stdinPipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, stdoutPipe[1], STDOUT_FILENO);
+	// The mask of the server (SIGCHLD on a signalfd) and its ignored SIGPIPE would be inherited
+	posix_spawnattr_init(&attr);
+	sigemptyset(&signals);
+	posix_spawnattr_setsigmask(&attr, &signals);
+	sigaddset(&signals, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attr, &signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	this->_owner = getpid();
+	int error = posix_spawn(&this->_pid, this->_argv[0], &actions, &attr, &this->_argv[0], &this->_envp[0]);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	close(stdinPipe[0]);
+	close(stdoutPipe[1]);
+	this->_stdinFd = stdinPipe[1];
+	this->_stdoutFd = stdoutPipe[0];
+	if (error != 0)
 	{
-		if (this->_requestCgi->_request->_body._fd != -1) // Listen to the body, if there is one
-			if (dup2(this->_requestCgi->_request->_body._fd, STDIN_FILENO) == -1)
-				throw ChildProcessException();
-		if (dup2(this->_body._fd, STDOUT_FILENO) == -1)
-			throw ChildProcessException();
-		execve(this->_argv[0], this->_argv, this->_envp);
-		throw ChildProcessException();
+		this->_pid = -1;
+		LOG_ERROR("[CgiExecutor::_execute] Failed to spawn %s: %s", this->_argv[0], strerror(error));
+		throw IntException(502);
 	}
+	if (fcntl(this->_stdinFd, F_SETFL, O_NONBLOCK) == -1 || fcntl(this->_stdoutFd, F_SETFL, O_NONBLOCK) == -1)
+		throw std::invalid_argument("[CgiExecutor::_execute] fcntl failed");
+	addSocketEpoll(g_server->getEpollFD(), this->_stdoutFd, EPOLLIN, EPOLL_TAG_FD(this->getClient()->getFd(), EPOLL_TAG_CGI_STDOUT));
+	this->_pidFd = openPidFd(this->_pid);
+	if (this->_pidFd != -1)
+		addSocketEpoll(g_server->getEpollFD(), this->_pidFd, EPOLLIN, EPOLL_TAG_FD(this->getClient()->getFd(), EPOLL_TAG_CGI_EXIT));
 	else
+		g_server->watchChild(this->_pid, this->getClient()->getFd());
+
+	this->_inputFd = this->_requestCgi->_request->_body._fd;
+	this->_inputRead = 0;
+	this->_writeInput();
+}
+
+/*
+** @brief Hand the request to a FastCGI pool instead of spawning, its STDOUT
+** records go to the response like the output of a spawned CGI
+*/
+void CgiExecutor::_pass(FastCgiPool *pool)
+{
+	LOG_DEBUG("[CgiExecutor::_pass] Pass to FastCGI: %s", pool->getCommand().c_str());
+	if (this->_requestCgi->_request->_body._fd != -1)
+		if (lseek(this->_requestCgi->_request->_body._fd, 0, SEEK_SET) == -1)
+			throw std::invalid_argument("[CgiExecutor::_pass] lseek failed");
+
+	this->_pool = pool;
+	this->_requestCgi->_request->_setState(Request::CGI_PROCESS);
+	pool->submit(this);
+}
+
+/*
+** --------------------------------- PIPES ---------------------------------
+*/
+
+/*
+** @brief Handle an epoll event on one of the pipes, or the exit of the process
+*/
+void	CgiExecutor::handleEvent(int tag, uint32_t events)
+{
+	if (tag == EPOLL_TAG_CGI_EXIT && this->_pid > 0 && !this->_exited)
+		return (this->_reap());
+	if (tag == EPOLL_TAG_CGI_STDIN && this->_stdinFd != -1)
+		return (this->_writeInput());
+	if (tag == EPOLL_TAG_CGI_STDOUT && this->_stdoutFd != -1 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		return (this->_readOutput());
+}
+
+/*
+** @brief Queue body bytes for the CGI, the client is not read anymore
+** while the CGI lags behind
+*/
+int	CgiExecutor::_feed(const char *data, size_t size)
+{
+	if (this->_stdinFd == -1) // The CGI closed its stdin, the rest of the body is dropped
+		return (0);
+	if (this->_inputOffset > 0)
 	{
-		this->_requestCgi->_request->_setState(Request::CGI_PROCESS);
+		this->_input.erase(0, this->_inputOffset);
+		this->_inputOffset = 0;
 	}
+	this->_input.append(data, size);
+	this->_writeInput();
+	if (this->_stdinFd != -1 && this->_input.size() - this->_inputOffset >= CGI_INPUT_HIGH_WATER && !this->_clientPaused)
+	{
+		this->_clientPaused = true;
+		this->getClient()->watch(EPOLLRDHUP | EPOLLERR);
+	}
+	return (0);
+}
 
+/*
+** @brief The whole body is received, stdin is closed once it is written
+*/
+void	CgiExecutor::_endInput(void)
+{
+	this->_inputEnd = true;
+	if (this->_stdinFd != -1)
+		this->_writeInput();
 }
 
 /*
-** --------------------------------- UTILS ---------------------------------
+** @brief Write what the pipe takes, EPOLLOUT is only watched while bytes wait
+** the CGI reads EOF once the whole body is written
 */
+void	CgiExecutor::_writeInput(void)
+{
+	while (this->_stdinFd != -1)
+	{
+		if (this->_inputOffset == this->_input.size() && this->_fillInput() == 0)
+		{
+			if (this->_inputEnd && this->_inputFd == -1)
+				return (this->_closeInput());
+			break ;
+		}
+		ssize_t bytesWritten = write(this->_stdinFd, this->_input.data() + this->_inputOffset, this->_input.size() - this->_inputOffset);
+		if (bytesWritten == -1 && (errno == EAGAIN || errno == EINTR))
+			break ;
+		if (bytesWritten == -1) // EPIPE, the CGI does not read its body
+		{
+			LOG_DEBUG("[CgiExecutor] CGI closed its input: %s", strerror(errno));
+			this->_inputFd = -1;
+			return (this->_closeInput());
+		}
+		this->_inputOffset += bytesWritten;
+	}
+	bool pending = this->_inputOffset < this->_input.size();
+	if (pending != this->_stdinWatched)
+	{
+		this->_stdinWatched = pending;
+		if (pending)
+			addSocketEpoll(g_server->getEpollFD(), this->_stdinFd, EPOLLOUT, EPOLL_TAG_FD(this->getClient()->getFd(), EPOLL_TAG_CGI_STDIN));
+		else
+			deleteSocketEpoll(g_server->getEpollFD(), this->_stdinFd);
+	}
+	if (this->_clientPaused && this->_input.size() - this->_inputOffset < CGI_INPUT_HIGH_WATER / 2)
+	{
+		this->_clientPaused = false;
+		if (this->_requestCgi->_request->_state < Request::BODY_END)
+			this->getClient()->watch(REQUEST_FLAGS);
+	}
+}
 
 /*
-** @brief Convert the _env map to a char**
+** @brief Read the next part of the spooled body, handleDiskIo gets it
 **
-** @return char** : the char** of the _env map
+** @return 0, the bytes come with the completion
+*/
+size_t	CgiExecutor::_fillInput(void)
+{
+	this->_input.clear();
+	this->_inputOffset = 0;
+	if (this->_inputFd == -1 || this->_inputOp != NULL)
+		return (0);
+	this->_inputOp = g_server->getDiskIo().read(this->getClient(), DiskIo::CGI_INPUT, this->_inputFd, CGI_PIPE_BUFFER_SIZE, this->_inputRead);
+	return (0);
+}
+
+/*
+** @brief A part of the spooled body is read, a short read is its end. The
+** file belongs to the request body, it is not closed here
 */
-char	**CgiExecutor::_envToChar(void)
+void	CgiExecutor::handleDiskIo(DiskIo::Op &op)
 {
-	char	**envp = new char*[_env.size() + 1];
-	std::map<std::string, std::string>::const_iterator it;
-	int i = 0;
+	this->_inputOp = NULL;
+	if (this->_stdinFd == -1) // The CGI closed its input meanwhile
+		return ;
+	if (op.result < 0)
+		LOG_ERROR("[CgiExecutor] Failed to read the body: %s", strerror(-op.result));
+	if (op.result <= 0 || op.done < op.size)
+		this->_inputFd = -1;
+	this->_input.swap(op.buffer);
+	this->_input.resize(op.done);
+	this->_inputOffset = 0;
+	this->_inputRead += op.done;
+	this->_writeInput();
+}
 
-	for (it = _env.begin(); it != _env.end(); ++it){
-		std::string env = it->first + "=" + it->second;
-		envp[i] = new char[env.size() + 1];
-		strcpy(envp[i], env.c_str());
-		i++;
+void	CgiExecutor::_closeInput(void)
+{
+	if (this->_stdinFd == -1)
+		return ;
+	if (this->_stdinWatched)
+		deleteSocketEpoll(g_server->getEpollFD(), this->_stdinFd);
+	close(this->_stdinFd);
+	this->_stdinFd = -1;
+	this->_stdinWatched = false;
+	this->_input.clear();
+	this->_inputOffset = 0;
+	if (this->_clientPaused)
+	{
+		this->_clientPaused = false;
+		if (this->_requestCgi->_request->_state < Request::BODY_END)
+			this->getClient()->watch(REQUEST_FLAGS);
 	}
-	envp[i] = NULL;
-	return envp;
 }
 
 /*
-** @brief Build the argv
-**
-** @return char** : the argv
+** @brief Hand what the CGI wrote to the response, EOF once it closed stdout
+*/
+void	CgiExecutor::_readOutput(void)
+{
+	char	buffer[CGI_PIPE_BUFFER_SIZE];
+
+	ssize_t bytesRead = read(this->_stdoutFd, buffer, CGI_PIPE_BUFFER_SIZE);
+	if (bytesRead == -1 && (errno == EAGAIN || errno == EINTR))
+		return ;
+	if (bytesRead <= 0)
+	{
+		this->_closeOutput();
+		return (this->_complete());
+	}
+	this->_output(buffer, bytesRead);
+	if (this->_requestCgi->_request->_state == Request::CGI_PROCESS) // The timeout is between two writes of the CGI
+		this->_requestCgi->_request->setTimeout(REQUEST_DEFAULT_CGI_TIMEOUT);
+	if (this->_isOutputFull())
+		this->_pauseOutput(true);
+}
+
+/*
+** @brief The output waiting for the client reached the high water
+*/
+bool	CgiExecutor::_isOutputFull(void) const
+{
+	Client *client = this->getClient();
+	return (client->getOutput().pending() + client->getResponse()->getResponseSize() >= CGI_OUTPUT_HIGH_WATER);
+}
+
+/*
+** @brief Stop or start reading the CGI while the client lags behind, the
+** pipe leaves the epoll: a pipe closed by the CGI would report EPOLLHUP
+** even without EPOLLIN. A FastCGI connection drops EPOLLIN instead.
+** The CGI is not timed meanwhile, the client is covered by the inactivity
+** timeout
+*/
+void	CgiExecutor::_pauseOutput(bool pause)
+{
+	Request	*request = this->_requestCgi->_request;
+
+	if ((this->_stdoutFd == -1 && this->_pool == NULL) || pause == this->_stdoutPaused)
+		return ;
+	this->_stdoutPaused = pause;
+	if (this->_pool)
+		this->_pool->pause(this, pause);
+	else if (pause)
+		deleteSocketEpoll(g_server->getEpollFD(), this->_stdoutFd);
+	else
+		addSocketEpoll(g_server->getEpollFD(), this->_stdoutFd, EPOLLIN, EPOLL_TAG_FD(this->getClient()->getFd(), EPOLL_TAG_CGI_STDOUT));
+	if (request->_state != Request::CGI_PROCESS)
+		return ;
+	if (pause)
+		request->_timeout = 0;
+	else
+		request->setTimeout(REQUEST_DEFAULT_CGI_TIMEOUT);
+}
+
+/*
+** @brief The client drained what was queued, read the CGI again
+*/
+void	CgiExecutor::resumeOutput(void)
+{
+	this->_pauseOutput(false);
+}
+
+void	CgiExecutor::_closeOutput(void)
+{
+	if (this->_stdoutFd == -1)
+		return ;
+	if (!this->_stdoutPaused)
+		deleteSocketEpoll(g_server->getEpollFD(), this->_stdoutFd);
+	close(this->_stdoutFd);
+	this->_stdoutFd = -1;
+	this->_stdoutPaused = false;
+}
+
+/*
+** @brief The pidfd is readable (or SIGCHLD came): collect the process
+*/
+void	CgiExecutor::_reap(void)
+{
+	int		status;
+
+	pid_t wpid = waitpid(this->_pid, &status, WNOHANG);
+	if (wpid == 0) // Still running
+		return ;
+	this->_unwatchExit();
+	if (wpid == -1)
+	{
+		LOG_ERROR("[CgiExecutor] waitpid failed: %s", strerror(errno));
+		this->_exited = true;
+		return (this->_requestCgi->_request->setError(500));
+	}
+	this->_reaped(status);
+}
+
+/*
+** @brief The CGI process exited
+*/
+void	CgiExecutor::_reaped(int status)
+{
+	this->_exited = true;
+	this->_status = status;
+	this->_complete();
+}
+
+void	CgiExecutor::_unwatchExit(void)
+{
+	if (this->_pidFd == -1)
+		return (g_server->unwatchChild(this->_pid));
+	deleteSocketEpoll(g_server->getEpollFD(), this->_pidFd);
+	close(this->_pidFd);
+	this->_pidFd = -1;
+}
+
+/*
+** @brief The CGI is done once it exited and its output is read to the end
+*/
+void	CgiExecutor::_complete(void)
+{
+	if (!this->_exited || this->_stdoutFd != -1)
+		return ;
+	if (this->_requestCgi->_request->_state == Request::FINISH) // Timed out
+		return ;
+	if (WIFEXITED(this->_status) && WEXITSTATUS(this->_status) == 0)
+		return (this->_requestCgi->_request->_setState(Request::FINISH));
+	LOG_ERROR("[CgiExecutor] CGI process exited abnormally");
+	this->_requestCgi->_request->setError(502);
+}
+
+/*
+** --------------------------------- FASTCGI ---------------------------------
+*/
+
+/*
+** @brief The request body file, -1 if there is none
+*/
+int	CgiExecutor::_getStdinFd(void) const
+{
+	return (this->_requestCgi->_request->_body._fd);
+}
+
+/*
+** @brief Hand a part of the output to the response
+*/
+int	CgiExecutor::_output(const char *data, size_t size)
+{
+	this->getClient()->getResponse()->cgiOutput(data, size);
+	return (0);
+}
+
+/*
+** @brief The application is done, like the exit status of a spawned CGI
+*/
+void	CgiExecutor::_end(bool success)
+{
+	if (success)
+		return (this->_requestCgi->_request->_setState(Request::FINISH));
+	LOG_ERROR("[CgiExecutor] FastCGI request failed");
+	this->_requestCgi->_request->setError(502);
+}
+
+Client*	CgiExecutor::getClient(void) const
+{
+	return (this->_requestCgi->_request->_client);
+}
+
+/*
+** --------------------------------- UTILS ---------------------------------
+*/
+
+/*
+** @brief Add a "NAME=value" entry to the environment of the request
+*/
+void	CgiExecutor::_setEnv(const char *name, const std::string &value)
+{
+	this->_env.push_back(std::string(name));
+	this->_env.back() += '=';
+	this->_env.back() += value;
+}
+
+/*
+** @brief Point the envp to the static entries of the location and the
+** socket, then to the entries of the request: nothing is copied again
+*/
+void	CgiExecutor::_buildEnvp(void)
+{
+	const std::vector<std::string>	&common = this->_requestCgi->_request->_location->getCgiEnv();
+
+	this->_envp.reserve(common.size() + this->_env.size() + 2);
+	for (size_t i = 0; i < common.size(); i++)
+		this->_envp.push_back(const_cast<char*>(common[i].c_str()));
+	this->_envp.push_back(const_cast<char*>(this->_requestCgi->_request->_client->getSocket()->getPortEnv().c_str()));
+	for (size_t i = 0; i < this->_env.size(); i++)
+		this->_envp.push_back(const_cast<char*>(this->_env[i].c_str()));
+	this->_envp.push_back(NULL);
+}
+
+/*
+** @brief Build the argv on the paths of the request
 */
-char	**CgiExecutor::_buildArgv(void)
+void	CgiExecutor::_buildArgv(void)
 {
-	char	**argv = new char*[3];
-	argv[0] = new char[this->_requestCgi->_execPath.size() + 1];
-	strcpy(argv[0], this->_requestCgi->_execPath.c_str());
-	argv[1] = new char[this->_requestCgi->_path.size() + 1];
-	strcpy(argv[1], this->_requestCgi->_path.c_str());
-	argv[2] = NULL;
-	return argv;
+	this->_argv.push_back(const_cast<char*>(this->_requestCgi->_execPath.c_str()));
+	this->_argv.push_back(const_cast<char*>(this->_requestCgi->_path.c_str()));
+	this->_argv.push_back(NULL);
 }
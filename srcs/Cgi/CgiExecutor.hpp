@@ -4,44 +4,98 @@
 
 # include <iostream>
 # include <map>
+# include <vector>
+# include <spawn.h>
 
 # include "RequestCgi.hpp"
 # include "RequestBody.hpp"
+# include "DiskIo.hpp"
+
+# define CGI_PIPE_BUFFER_SIZE 65536 // Bytes moved per read on the pipes
+# define CGI_INPUT_HIGH_WATER 262144 // Body bytes waiting for the CGI before the client is not read anymore
+# define CGI_OUTPUT_HIGH_WATER 262144 // Output bytes waiting for the client before the CGI is not read anymore
+# define CGI_ENV_SIZE 15 // Entries built for each request, the static ones come from the location
 
 class RequestCgi;
+class FastCgiPool;
+class Client;
+
+/*
+** Runs the CGI of a request. A spawned CGI gets two non-blocking pipes
+** watched by the reactor: the body goes to its stdin as it is received
+** (or from the spooled file of a chunked body, read by the disk I/O engine),
+** and its stdout is handed to the response as it comes, so the client gets
+** the first bytes as soon as the script writes them. Both sides stop being read while the other
+** one lags behind, so nothing buffers more than the high waters.
+*/
 
 class CgiExecutor
 {
+	friend class Request;
 	friend class RequestCgi;
+	friend class FastCgiPool;
+	friend class FastCgiWorker;
 	public:
 	private:
 		RequestCgi*	_requestCgi;
-		std::map<std::string, std::string>	_env;
-		char**								_envp;
-		char**								_argv; // 0: path, 1: execPath, 2: NULL
+		std::vector<std::string>			_env; // "NAME=value" entries of this request
+		std::vector<char*>					_envp; // Static entries of the location and socket, then _env, NULL
+		std::vector<char*>					_argv; // 0: execPath, 1: path, 2: NULL
 		// Headers
 		std::map<std::string, std::string>	_headers;
 		std::string							_tmpHeaderKey;
 		std::string							_tmpHeaderValue;
-		// Output
-		RequestBody							_body;
-		// FILE*								_tmpOut;
-		// long								_fdOut;
-		
 		// Execution
 		pid_t								_pid;
-		int									_StdinBackup;
-		int									_StdoutBackup;
+		pid_t								_owner; // Process which spawned the CGI
+		FastCgiPool*						_pool; // Set when passed to a FastCGI pool instead of spawned
+		int									_pidFd; // Readable once the process exited, -1 if watched through SIGCHLD
+		bool								_exited;
+		int									_status; // waitpid status once _exited
+		// Pipes, the ends of the server
+		int									_stdinFd; // -1 once the whole body is written
+		int									_stdoutFd; // -1 once the CGI closed its output
+		bool								_stdinWatched;
+		bool								_stdoutPaused;
+		bool								_clientPaused;
+		std::string							_input; // Body bytes not taken by the pipe yet
+		size_t								_inputOffset;
+		int									_inputFd; // Spooled body still to copy, -1 if none
+		off_t								_inputRead; // Offset of the next read of the spooled body
+		DiskIo::Op*							_inputOp; // Read in flight, NULL if none
+		bool								_inputEnd; // No more body bytes will come
 		// State
 		time_t								_lastActivity;
 
 		/* METHODS */
 		void	_init(void);
 		void	_execute(void);
+		void	_pass(FastCgiPool *pool);
+
+		/* PIPES */
+		int		_feed(const char *data, size_t size);
+		void	_endInput(void);
+		void	_writeInput(void);
+		size_t	_fillInput(void);
+		void	_closeInput(void);
+		void	_readOutput(void);
+		void	_pauseOutput(bool pause);
+		bool	_isOutputFull(void) const;
+		void	_closeOutput(void);
+		void	_reap(void);
+		void	_reaped(int status);
+		void	_unwatchExit(void);
+		void	_complete(void);
+
+		/* FASTCGI */
+		int		_getStdinFd(void) const;
+		int		_output(const char *data, size_t size);
+		void	_end(bool success);
 
 		/* UTILS */
-		char**	_envToChar(void);
-		char**	_buildArgv(void);
+		void	_setEnv(const char *name, const std::string &value);
+		void	_buildEnvp(void);
+		void	_buildArgv(void);
 	public:
 		CgiExecutor(RequestCgi* requestCgi);
 		CgiExecutor(const CgiExecutor &src);
@@ -49,8 +103,12 @@ class CgiExecutor
 
 		CgiExecutor &operator=(const CgiExecutor &src);
 
+		void	handleEvent(int tag, uint32_t events);
+		void	handleDiskIo(DiskIo::Op &op);
+		void	resumeOutput(void);
+
 		/* GETTERS */
-		int	getFdOut(void) const { return this->_body._fd; }
+		Client*	getClient(void) const;
 };
 
 #endif // CGIEXECUTOR_HPP
\ No newline at end of file
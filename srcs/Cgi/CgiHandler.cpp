@@ -52,6 +52,19 @@ CgiHandler &CgiHandler::operator=(const CgiHandler &src)
 	return *this;
 }
 
+/*
+** @brief Get ready for the next response, the strings keep their capacity
+*/
+void	CgiHandler::reset(void)
+{
+	this->_output.clear();
+	this->_headers.clear();
+	this->_tmpHeaderKey.clear();
+	this->_tmpHeaderValue.clear();
+	this->_isChunked = false;
+	this->_state = CgiHandler::INIT;
+}
+
 /*
 ** --------------------------------- PARSING ---------------------------------
 */
@@ -69,7 +82,7 @@ void	CgiHandler::_setState(e_cgi_handler_state state)
 		return ;
 	if (this->_state == state)
 		return ;
-	Logger::log(Logger::DEBUG, "CgiHandler state: %s -> %s", this->getStateStr(this->_state).c_str(), this->getStateStr(state).c_str());
+	LOG_DEBUG("CgiHandler state: %s -> %s", this->getStateStr(this->_state).c_str(), this->getStateStr(state).c_str());
 	this->_state = state;
 
 	if (this->_state == CgiHandler::BODY)
@@ -81,10 +94,11 @@ void	CgiHandler::_setState(e_cgi_handler_state state)
 		}
 		if (this->_checkHeaders() == -1)
 			return ;
-		this->_response->_response += this->_response->_request->getHttpVersion() + " " + intToString(this->_response->_request->getStateCode()) + " " + getErrorMessage(this->_response->_request->getStateCode()) + "\r\n";
+		std::string head = this->_response->_request->getHttpVersion() + " " + intToString(this->_response->_request->getStateCode()) + " " + getErrorMessage(this->_response->_request->getStateCode()) + "\r\n";
 		for (std::map<std::string, std::string>::iterator it = this->_headers.begin(); it != this->_headers.end(); it++)
-			this->_response->_response += it->first + ": " + it->second + "\r\n";
-		this->_response->_response += "\r\n";
+			head += it->first + ": " + it->second + "\r\n";
+		head += "\r\n";
+		this->_response->_output.push(head);
 	}
 	else if (this->_state == CgiHandler::FINISH)
 		return (this->_response->setState(Response::FINISH));
@@ -114,9 +128,9 @@ void	CgiHandler::_parse(const std::string &data)
 void	CgiHandler::_parseHeaders(void)
 {
 	if (this->_state < CgiHandler::INIT)
-		return (Logger::log(Logger::DEBUG, "Request line not parsed yet"));
+		return (LOG_DEBUG("Request line not parsed yet"));
 	if (this->_state > CgiHandler::HEADERS_END)
-		return (Logger::log(Logger::DEBUG, "Headers already parsed"));
+		return (LOG_DEBUG("Headers already parsed"));
 
 	if (this->_state == CgiHandler::INIT)
 		this->_state = CgiHandler::HEADERS_PARSE_KEY;
@@ -202,7 +216,7 @@ void	CgiHandler::_parseHeadersKey(void)
 		if (this->_tmpHeaderKey.empty())
 			return (this->_response->setError(500));
 		this->_tmpHeaderKey.erase(std::remove_if(this->_tmpHeaderKey.begin(), this->_tmpHeaderKey.end(), ::isspace), this->_tmpHeaderKey.end());
-		Logger::log(Logger::DEBUG, "Header key: %s", this->_tmpHeaderKey.c_str());
+		LOG_DEBUG("Header key: %s", this->_tmpHeaderKey.c_str());
 		this->_setState(CgiHandler::HEADERS_PARSE_VALUE);
 	}
 
@@ -255,17 +269,22 @@ void	CgiHandler::_parseHeadersValue(void)
 void	CgiHandler::_parseBody(void)
 {
 	if (this->_state < CgiHandler::BODY)
-		return (Logger::log(Logger::DEBUG, "Headers not parsed yet"));
+		return (LOG_DEBUG("Headers not parsed yet"));
 	if (this->_state > CgiHandler::BODY)
-		return (Logger::log(Logger::DEBUG, "Body already parsed"));
+		return (LOG_DEBUG("Body already parsed"));
 
+	if (this->_output.empty())
+		return ;
 	if (this->_isChunked)
 	{
+		// Chunk size line, data and CRLF are queued as three segments
 		std::string chunkSizeStr = intToHexa(this->_output.size()) + "\r\n";
-		this->_response->_response += chunkSizeStr + this->_output + "\r\n";
+		this->_response->_output.push(chunkSizeStr);
+		this->_response->_output.push(this->_output);
+		this->_response->_output.pushStatic("\r\n", 2);
 	}
 	else
-		this->_response->_response += this->_output;
+		this->_response->_output.push(this->_output);
 	this->_output.clear();
 }
 
@@ -53,6 +53,8 @@ class CgiHandler
 
 		CgiHandler &operator=(const CgiHandler &src);
 
+		void	reset(void);
+
 		/* GETTERS */
 		std::string getOutput(void) const { return _output; }
 
@@ -0,0 +1,205 @@
+#include "FastCgiPool.hpp"
+#include "CgiExecutor.hpp"
+#include "Clock.hpp"
+
+#include <algorithm>
+#include <sys/wait.h>
+
+FastCgiPool::FastCgiPool(const std::string &command, size_t size, size_t maxRequests) : _command(command), _sockets(0), _maxRequests(maxRequests), _owner(getpid()), _stopping(false)
+{
+	this->_argv = split(command, " ");
+	for (size_t i = 0; i < size; i++)
+		this->_workers.push_back(new FastCgiWorker(this));
+}
+
+/*
+** @brief Stop the processes and wait for them, only in the process which
+** started them: a CGI child unwinding its copy of the server leaves them alone
+*/
+FastCgiPool::~FastCgiPool(void)
+{
+	this->stop();
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		delete this->_workers[i];
+	if (!this->isOwner())
+		return ;
+	for (size_t i = 0; i < this->_exited.size(); i++)
+		waitpid(this->_exited[i], NULL, 0);
+	if (!this->_runtimeDir.empty())
+		rmdir(this->_runtimeDir.c_str());
+}
+
+/*
+** --------------------------------- METHODS ---------------------------------
+*/
+
+/*
+** @brief Spawn every process of the pool, they stay up between requests
+*/
+void	FastCgiPool::start(void)
+{
+	char	dir[] = FCGI_RUNTIME_DIR;
+
+	if (mkdtemp(dir) != NULL)
+		this->_runtimeDir = dir;
+	else
+		LOG_ERROR("[FastCgi] Failed to create %s: %s", dir, strerror(errno));
+	LOG_INFO("Starting %d FastCGI processes: %s", (int)this->_workers.size(), this->_command.c_str());
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		this->_workers[i]->spawn();
+}
+
+/*
+** @brief Stop every process before the server goes down, none is respawned
+** afterwards, even by a request cancelled while the clients are deleted
+*/
+void	FastCgiPool::stop(void)
+{
+	this->_stopping = true;
+	this->_waiting.clear();
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		this->_workers[i]->stop();
+}
+
+/*
+** @brief Hand a request to an idle process, or queue it until one is free
+** if every process is down the request fails right away
+*/
+void	FastCgiPool::submit(CgiExecutor *executor)
+{
+	this->reap();
+	FastCgiWorker *worker = this->_findWorker();
+	if (worker != NULL)
+		return (worker->begin(executor));
+	for (size_t i = 0; i < this->_workers.size(); i++)
+	{
+		if (this->_workers[i]->getState() == FastCgiWorker::BUSY)
+		{
+			LOG_DEBUG("[FastCgi] Every process is busy, request queued (%d waiting)", (int)this->_waiting.size() + 1);
+			return (this->_waiting.push_back(executor));
+		}
+	}
+	LOG_ERROR("[FastCgi] No process available for %s", this->_command.c_str());
+	executor->_end(false);
+}
+
+/*
+** @brief Forget a request which went away (client gone, timeout)
+**
+** @param kill : the process may be stuck, start a new one
+*/
+void	FastCgiPool::cancel(CgiExecutor *executor, bool kill)
+{
+	if (this->_stopping || !this->isOwner())
+		return ;
+	std::deque<CgiExecutor*>::iterator it = std::find(this->_waiting.begin(), this->_waiting.end(), executor);
+	if (it != this->_waiting.end())
+		return ((void)this->_waiting.erase(it));
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		if (this->_workers[i]->getExecutor() == executor)
+			return (this->_workers[i]->abandon(kill));
+}
+
+/*
+** @brief Stop or start reading the output of a request, while its client
+** lags behind. A request still waiting for a process has none
+*/
+void	FastCgiPool::pause(CgiExecutor *executor, bool pause)
+{
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		if (this->_workers[i]->getExecutor() == executor)
+			return (this->_workers[i]->pause(pause));
+}
+
+/*
+** @brief A process is done with its request, or went down:
+** recycle it after max requests, then give it the next waiting request
+*/
+void	FastCgiPool::release(FastCgiWorker *worker)
+{
+	this->reap();
+	if (this->_maxRequests != 0 && worker->getState() == FastCgiWorker::IDLE && worker->getServed() >= this->_maxRequests)
+	{
+		LOG_DEBUG("[FastCgi] Process %d served %d requests, recycled", worker->getPid(), (int)worker->getServed());
+		worker->restart();
+	}
+	if (this->_waiting.empty())
+		return ;
+
+	FastCgiWorker *next = this->_findWorker();
+	if (next != NULL)
+	{
+		CgiExecutor *executor = this->_waiting.front();
+		this->_waiting.pop_front();
+		return (next->begin(executor));
+	}
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		if (this->_workers[i]->getState() == FastCgiWorker::BUSY)
+			return ;
+	LOG_ERROR("[FastCgi] Every process of %s is down", this->_command.c_str());
+	while (!this->_waiting.empty())
+	{
+		CgiExecutor *executor = this->_waiting.front();
+		this->_waiting.pop_front();
+		executor->_end(false);
+	}
+}
+
+/*
+** @brief Remember a stopped process until it is reaped
+*/
+void	FastCgiPool::retire(pid_t pid)
+{
+	this->_exited.push_back(pid);
+}
+
+/*
+** @brief Collect the stopped processes which exited
+*/
+void	FastCgiPool::reap(void)
+{
+	for (size_t i = 0; i < this->_exited.size(); )
+	{
+		if (waitpid(this->_exited[i], NULL, WNOHANG) == 0)
+			i++;
+		else
+			this->_exited.erase(this->_exited.begin() + i);
+	}
+}
+
+/*
+** @brief A new name in the runtime directory, empty without it. The socket
+** is unlinked once connected, the name only has to be unique meanwhile
+*/
+std::string	FastCgiPool::nextSocketPath(void)
+{
+	if (this->_runtimeDir.empty())
+		return ("");
+	return (this->_runtimeDir + "/" + intToString(getpid()) + "." + uint64ToString(this->_sockets++));
+}
+
+/*
+** --------------------------------- PRIVATE ---------------------------------
+*/
+
+/*
+** @brief An idle process, or a down one whose respawn delay is over
+*/
+FastCgiWorker*	FastCgiPool::_findWorker(void)
+{
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		if (this->_workers[i]->getState() == FastCgiWorker::IDLE)
+			return (this->_workers[i]);
+	for (size_t i = 0; i < this->_workers.size(); i++)
+	{
+		FastCgiWorker *worker = this->_workers[i];
+		if (worker->getState() == FastCgiWorker::DOWN && worker->getRetryAt() <= Clock::now() && worker->spawn() == 0)
+			return (worker);
+	}
+	return (NULL);
+}
+
+bool	FastCgiPool::isOwner(void) const
+{
+	return (getpid() == this->_owner);
+}
@@ -0,0 +1,67 @@
+#ifndef FASTCGIPOOL_HPP
+# define FASTCGIPOOL_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <sys/types.h>
+
+# include "FastCgiWorker.hpp"
+
+# define FCGI_DEFAULT_POOL_SIZE 2
+# define FCGI_MAX_POOL_SIZE 64
+# define FCGI_DEFAULT_MAX_REQUESTS 0 // Unlimited
+# define FCGI_RESPAWN_DELAY 1000 // ms before a process which died without serving is spawned again
+# define FCGI_RUNTIME_DIR "/tmp/webserv-fastcgi.XXXXXX" // mkdtemp template, 0700
+
+class CgiExecutor;
+
+/*
+** Pool of FastCGI application processes for one fastcgi_pass command.
+** A request goes to an idle process, or waits in the queue for the next
+** one to finish. A process is recycled after max requests, and respawned
+** when it exits; one that dies before serving anything is only spawned
+** again after FCGI_RESPAWN_DELAY, so a broken command does not fork in a loop.
+** The listening sockets of the processes are bound in a private directory,
+** only the user of the server can connect to them.
+*/
+class FastCgiPool
+{
+	private:
+		std::string					_command;
+		std::vector<std::string>	_argv;
+		std::string					_runtimeDir; // 0700, empty if it could not be created
+		unsigned long				_sockets; // Names of the sockets bound so far
+		size_t						_maxRequests;
+		std::vector<FastCgiWorker*>	_workers;
+		std::deque<CgiExecutor*>	_waiting;
+		std::vector<pid_t>			_exited; // Stopped processes not reaped yet
+		pid_t						_owner; // A forked child must not stop the processes of its parent
+		bool						_stopping;
+
+		FastCgiWorker*	_findWorker(void);
+
+		FastCgiPool(const FastCgiPool &src);
+		FastCgiPool &operator=(const FastCgiPool &rhs);
+	public:
+		FastCgiPool(const std::string &command, size_t size, size_t maxRequests);
+		~FastCgiPool(void);
+
+		void	start(void);
+		void	stop(void);
+		void	submit(CgiExecutor *executor);
+		void	cancel(CgiExecutor *executor, bool kill);
+		void	pause(CgiExecutor *executor, bool pause);
+		void	release(FastCgiWorker *worker);
+		void	retire(pid_t pid);
+		void	reap(void);
+		std::string	nextSocketPath(void);
+
+		/* GETTERS */
+		const std::string&				getCommand(void) const { return _command; }
+		const std::vector<std::string>&	getArgv(void) const { return _argv; }
+		bool							isOwner(void) const;
+		bool							isStopping(void) const { return _stopping; }
+};
+
+#endif // FASTCGIPOOL_HPP
@@ -0,0 +1,431 @@
+#include "FastCgiWorker.hpp"
+#include "FastCgiPool.hpp"
+#include "CgiExecutor.hpp"
+#include "Webserv.hpp"
+#include "Clock.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+FastCgiWorker::FastCgiWorker(FastCgiPool *pool) : _pool(pool), _pid(-1), _fd(-1), _state(FastCgiWorker::DOWN), _executor(NULL), _stdinFd(-1), _stdinDone(true), _outOffset(0), _flags(0), _paused(false), _served(0), _spawnedAt(0), _retryAt(0)
+{
+}
+
+FastCgiWorker::~FastCgiWorker(void)
+{
+	this->stop();
+}
+
+/*
+** --------------------------------- PROCESS ---------------------------------
+*/
+
+/*
+** @brief Start the application process and connect to it
+** the connection is queued by the listening socket before the fork, so the
+** process does not have to be accepting yet
+**
+** @return 0, or -1 if it failed: the worker stays down until _retryAt
+*/
+int	FastCgiWorker::spawn(void)
+{
+	struct sockaddr_un	addr;
+
+	if (this->_pool->isStopping())
+		return (-1);
+	// Built before the fork: the logger and disk I/O threads may hold the malloc locks
+	const std::vector<std::string> &command = this->_pool->getArgv();
+	std::vector<char *> argv;
+	for (size_t i = 0; i < command.size(); i++)
+		argv.push_back(const_cast<char *>(command[i].c_str()));
+	argv.push_back(NULL);
+
+	// Bound in the private runtime directory, unlinked once connected
+	std::string path = this->_pool->nextSocketPath();
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	int listenFd = path.empty() ? (errno = ENOENT, -1) : socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listenFd != -1 && bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+	{
+		if (listen(listenFd, 1) == 0)
+			this->_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (this->_fd != -1 && connect(this->_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+			this->_pid = fork();
+		if (this->_pid != 0)
+			unlink(addr.sun_path);
+	}
+	if (this->_pid == 0)
+	{
+		resetSignalMask();
+		// FCGI_LISTENSOCK_FILENO, dup2 clears the close-on-exec flag
+		if (dup2(listenFd, STDIN_FILENO) == -1)
+			throw ChildProcessException();
+		execv(argv[0], &argv[0]);
+		throw ChildProcessException();
+	}
+	if (this->_pid == -1)
+		LOG_ERROR("[FastCgi] Failed to start %s: %s", this->_pool->getCommand().c_str(), strerror(errno));
+	if (listenFd != -1)
+		close(listenFd);
+	if (this->_pid == -1)
+	{
+		if (this->_fd != -1)
+			close(this->_fd);
+		this->_fd = -1;
+		this->_state = FastCgiWorker::DOWN;
+		this->_retryAt = Clock::now() + FCGI_RESPAWN_DELAY;
+		return (-1);
+	}
+	LOG_DEBUG("[FastCgi] Process %d started: %s", this->_pid, this->_pool->getCommand().c_str());
+	this->_state = FastCgiWorker::IDLE;
+	this->_served = 0;
+	this->_spawnedAt = Clock::now();
+	this->_flags = EPOLLIN;
+	addSocketEpoll(g_server->getEpollFD(), this->_fd, this->_flags, EPOLL_TAG(this, EPOLL_TAG_FASTCGI));
+	return (0);
+}
+
+/*
+** @brief Replace the process by a new one
+*/
+void	FastCgiWorker::restart(void)
+{
+	this->_stop();
+	this->spawn();
+}
+
+/*
+** @brief Shut the worker down for good. A forked child only closes its copy
+** of the connection: removing it from the epoll it shares with its parent,
+** or signaling the process, would break the parent
+*/
+void	FastCgiWorker::stop(void)
+{
+	if (this->_pool->isOwner())
+		return (this->_stop());
+	if (this->_fd != -1)
+		close(this->_fd);
+	this->_fd = -1;
+	this->_pid = -1;
+}
+
+/*
+** @brief Close the connection and terminate the process, reaped by the pool
+*/
+void	FastCgiWorker::_stop(void)
+{
+	if (this->_fd != -1)
+	{
+		deleteSocketEpoll(g_server->getEpollFD(), this->_fd);
+		close(this->_fd);
+		this->_fd = -1;
+	}
+	if (this->_pid > 0)
+	{
+		kill(this->_pid, SIGTERM);
+		this->_pool->retire(this->_pid);
+	}
+	this->_pid = -1;
+	this->_state = FastCgiWorker::DOWN;
+	this->_executor = NULL;
+	this->_paused = false;
+	this->_stdinFd = -1;
+	this->_stdinDone = true;
+	this->_out.clear();
+	this->_outOffset = 0;
+	this->_in.clear();
+}
+
+/*
+** @brief The process closed the connection or the connection failed
+** its request fails, a process which died young without serving anything
+** is spawned again only after FCGI_RESPAWN_DELAY
+*/
+void	FastCgiWorker::_die(void)
+{
+	LOG_WARNING("[FastCgi] Process %d of %s went down", this->_pid, this->_pool->getCommand().c_str());
+	CgiExecutor	*executor = this->_executor;
+	bool		crashLoop = this->_served == 0 && Clock::now() - this->_spawnedAt < FCGI_RESPAWN_DELAY;
+
+	this->_stop();
+	if (executor)
+		executor->_end(false);
+	if (crashLoop)
+		this->_retryAt = Clock::now() + FCGI_RESPAWN_DELAY;
+	else
+		this->spawn();
+	this->_pool->release(this);
+}
+
+/*
+** --------------------------------- REQUEST ---------------------------------
+*/
+
+/*
+** @brief Send a request: BEGIN_REQUEST with KEEP_CONN, the CGI environment
+** as PARAMS, then the body as STDIN, streamed from its file as the socket drains
+*/
+void	FastCgiWorker::begin(CgiExecutor *executor)
+{
+	const unsigned char	beginBody[FCGI_HEADER_LEN] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+
+	this->_executor = executor;
+	this->_state = FastCgiWorker::BUSY;
+	this->_paused = false;
+	this->_stdinFd = executor->_getStdinFd();
+	this->_stdinDone = false;
+	this->_queueRecord(FCGI_BEGIN_REQUEST, reinterpret_cast<const char *>(beginBody), sizeof(beginBody));
+	this->_queueParams(executor->_envp);
+	this->_queueRecord(FCGI_PARAMS, NULL, 0);
+	if (this->_fillStdin() == -1 || this->_flush() == -1)
+		this->_die();
+}
+
+/*
+** @brief The request went away: its output is dropped when it comes.
+** A process still reading the body, or maybe stuck (kill), is replaced
+*/
+void	FastCgiWorker::abandon(bool kill)
+{
+	this->_executor = NULL;
+	if (!kill && this->_stdinDone)
+		return (this->pause(false)); // Read again, to drop the rest
+	LOG_DEBUG("[FastCgi] Request abandoned, process %d replaced", this->_pid);
+	this->restart();
+	this->_pool->release(this);
+}
+
+/*
+** @brief END_REQUEST received, the process is free for the next request
+*/
+void	FastCgiWorker::_endRequest(bool success)
+{
+	CgiExecutor	*executor = this->_executor;
+
+	this->_executor = NULL;
+	this->pause(false);
+	this->_state = FastCgiWorker::IDLE;
+	this->_served++;
+	if (!this->_stdinDone) // Answered before reading the whole body, the connection is out of sync
+		this->restart();
+	this->_stdinFd = -1;
+	if (executor)
+		executor->_end(success);
+	this->_pool->release(this);
+}
+
+/*
+** @brief Handle an epoll event on the connection
+*/
+void	FastCgiWorker::handleEvent(uint32_t events)
+{
+	if (this->_fd == -1)
+		return ;
+	if ((events & EPOLLOUT) && this->_flush() == -1)
+		return (this->_die());
+	if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && this->_receive(events & (EPOLLHUP | EPOLLERR)) == -1)
+		return (this->_die());
+}
+
+/*
+** @brief Stop or start reading the connection while the client lags
+** behind, called by the executor (CgiExecutor::_pauseOutput)
+*/
+void	FastCgiWorker::pause(bool pause)
+{
+	if (this->_fd == -1 || pause == this->_paused)
+		return ;
+	this->_paused = pause;
+	this->_watch(this->_out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+}
+
+/*
+** --------------------------------- RECORDS ---------------------------------
+*/
+
+/*
+** @brief Append a record, size must fit in FCGI_MAX_CONTENT
+*/
+void	FastCgiWorker::_queueRecord(unsigned char type, const char *data, size_t size)
+{
+	const unsigned char header[FCGI_HEADER_LEN] = {FCGI_VERSION_1, type, 0, FCGI_REQUEST_ID, (unsigned char)(size >> 8), (unsigned char)(size & 0xff), 0, 0};
+
+	this->_out.append(reinterpret_cast<const char *>(header), FCGI_HEADER_LEN);
+	if (size > 0)
+		this->_out.append(data, size);
+}
+
+/*
+** @brief Lengths below 128 take one byte, others four with the high bit set
+*/
+static void	appendLength(std::string &out, size_t length)
+{
+	if (length < 128)
+		return ((void)out.push_back((char)length));
+	out.push_back((char)(((length >> 24) & 0x7f) | 0x80));
+	out.push_back((char)((length >> 16) & 0xff));
+	out.push_back((char)((length >> 8) & 0xff));
+	out.push_back((char)(length & 0xff));
+}
+
+/*
+** @brief Append the environment as name-value pairs, split in PARAMS records
+*/
+void	FastCgiWorker::_queueParams(const std::vector<char*> &envp)
+{
+	std::string	params;
+
+	for (size_t i = 0; envp[i] != NULL; i++)
+	{
+		const char	*value = strchr(envp[i], '=');
+		size_t		nameLength = value - envp[i];
+		size_t		valueLength = strlen(++value);
+
+		appendLength(params, nameLength);
+		appendLength(params, valueLength);
+		params.append(envp[i], nameLength);
+		params.append(value, valueLength);
+	}
+	for (size_t offset = 0; offset < params.size(); offset += FCGI_MAX_CONTENT)
+		this->_queueRecord(FCGI_PARAMS, params.data() + offset, std::min(params.size() - offset, (size_t)FCGI_MAX_CONTENT));
+}
+
+/*
+** @brief Read the next part of the body into STDIN records, an empty record
+** ends it. Only one chunk is kept in memory, the rest waits for EPOLLOUT
+*/
+int	FastCgiWorker::_fillStdin(void)
+{
+	char	buffer[FCGI_STDIN_CHUNK];
+
+	while (!this->_stdinDone && this->_out.size() - this->_outOffset < FCGI_STDIN_CHUNK)
+	{
+		ssize_t bytesRead = (this->_stdinFd == -1) ? 0 : read(this->_stdinFd, buffer, FCGI_STDIN_CHUNK);
+		if (bytesRead == -1)
+			return (LOG_ERROR("[FastCgi] Failed to read the request body"), -1);
+		this->_queueRecord(FCGI_STDIN, buffer, bytesRead);
+		if (bytesRead == 0)
+			this->_stdinDone = true;
+	}
+	return (0);
+}
+
+/*
+** @brief Send what is queued, EPOLLOUT is watched only while it does not fit
+*/
+int	FastCgiWorker::_flush(void)
+{
+	while (this->_outOffset < this->_out.size())
+	{
+		ssize_t bytesSent = send(this->_fd, this->_out.data() + this->_outOffset, this->_out.size() - this->_outOffset, MSG_NOSIGNAL);
+		if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break ;
+		if (bytesSent == -1)
+			return (-1);
+		this->_outOffset += bytesSent;
+		if (this->_outOffset == this->_out.size())
+		{
+			this->_out.clear();
+			this->_outOffset = 0;
+			if (this->_fillStdin() == -1)
+				return (-1);
+		}
+	}
+	this->_watch(this->_out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT);
+	return (0);
+}
+
+/*
+** @brief Read the available records: STDOUT goes to the response,
+** STDERR to the log, END_REQUEST finishes the request. Paused, the records
+** wait in the socket, unless the process hung up: nothing more will come
+**
+** @return -1 if the connection is closed or failed
+*/
+int	FastCgiWorker::_receive(bool hangup)
+{
+	char	buffer[FCGI_READ_BUFFER_SIZE];
+
+	while (!this->_paused || hangup)
+	{
+		ssize_t bytesRead = recv(this->_fd, buffer, FCGI_READ_BUFFER_SIZE, 0);
+		if (bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break ;
+		bool closed = bytesRead <= 0; // The records already received are still handled
+		if (!closed)
+			this->_in.append(buffer, bytesRead);
+		pid_t pid = this->_pid;
+		if (this->_handleRecords())
+			return (closed && this->_pid == pid ? -1 : 0);
+		if (closed)
+			return (-1);
+	}
+	return (0);
+}
+
+/*
+** @brief Handle the complete records of _in, what was read is handled even
+** if the output gets paused meanwhile: at most one read past the high water
+**
+** @return true once END_REQUEST is handled
+*/
+bool	FastCgiWorker::_handleRecords(void)
+{
+	size_t	offset = 0;
+
+	while (this->_in.size() - offset >= FCGI_HEADER_LEN)
+	{
+		const unsigned char	*header = reinterpret_cast<const unsigned char *>(this->_in.data() + offset);
+		size_t				contentLength = (header[4] << 8) | header[5];
+		size_t				recordLength = FCGI_HEADER_LEN + contentLength + header[6];
+		if (this->_in.size() - offset < recordLength)
+			break ;
+		if (header[1] == FCGI_END_REQUEST)
+		{
+			const unsigned char	*body = header + FCGI_HEADER_LEN;
+			bool				success = contentLength >= 5 && body[0] == 0 && body[1] == 0 && body[2] == 0 && body[3] == 0 && body[4] == FCGI_REQUEST_COMPLETE;
+			this->_in.erase(0, offset + recordLength);
+			if (!success)
+				LOG_ERROR("[FastCgi] Process %d ended its request with an error", this->_pid);
+			this->_endRequest(success); // May replace the process, nothing else is expected on this connection
+			return (true);
+		}
+		this->_handleRecord(header[1], this->_in.data() + offset + FCGI_HEADER_LEN, contentLength);
+		offset += recordLength;
+	}
+	this->_in.erase(0, offset);
+	return (false);
+}
+
+/*
+** @brief Handle a STDOUT or STDERR record, the others are ignored
+*/
+void	FastCgiWorker::_handleRecord(unsigned char type, const char *data, size_t size)
+{
+	if (type == FCGI_STDERR && size > 0)
+		LOG_WARNING("[FastCgi] %d: %.*s", this->_pid, (int)size, data);
+	if (type != FCGI_STDOUT || size == 0 || this->_executor == NULL)
+		return ;
+	if (this->_executor->_output(data, size) == -1)
+	{
+		CgiExecutor *executor = this->_executor;
+		this->_executor = NULL; // The rest of the output is dropped
+		executor->_end(false);
+	}
+	else if (this->_executor->_isOutputFull())
+		this->_executor->_pauseOutput(true);
+}
+
+/*
+** @brief Update the epoll flags of the connection when they change
+*/
+void	FastCgiWorker::_watch(uint32_t flags)
+{
+	if (this->_paused)
+		flags &= ~EPOLLIN;
+	if (flags == this->_flags)
+		return ;
+	this->_flags = flags;
+	modifySocketEpoll(g_server->getEpollFD(), this->_fd, flags, EPOLL_TAG(this, EPOLL_TAG_FASTCGI));
+}
@@ -0,0 +1,101 @@
+#ifndef FASTCGIWORKER_HPP
+# define FASTCGIWORKER_HPP
+
+# include <string>
+# include <vector>
+# include <sys/types.h>
+# include <stdint.h>
+
+/* Protocol, see the FastCGI specification 1.0 */
+# define FCGI_VERSION_1 1
+# define FCGI_HEADER_LEN 8
+# define FCGI_MAX_CONTENT 65535
+# define FCGI_BEGIN_REQUEST 1
+# define FCGI_END_REQUEST 3
+# define FCGI_PARAMS 4
+# define FCGI_STDIN 5
+# define FCGI_STDOUT 6
+# define FCGI_STDERR 7
+# define FCGI_RESPONDER 1
+# define FCGI_KEEP_CONN 1
+# define FCGI_REQUEST_COMPLETE 0
+
+# define FCGI_REQUEST_ID 1 // One request at a time on each connection
+# define FCGI_STDIN_CHUNK 32768 // Body bytes read from the file per STDIN record
+# define FCGI_READ_BUFFER_SIZE 65536
+
+class FastCgiPool;
+class CgiExecutor;
+
+/*
+** One long-lived FastCGI application process of a pool, and the kept-alive
+** connection to it. The process gets a listening Unix socket (bound in the
+** 0700 runtime directory of the pool) as its fd 0, as FastCGI applications
+** expect, and the server connects to it once. Records are queued in _out,
+** flushed on EPOLLOUT, and read back on EPOLLIN by the reactor. Like a CGI
+** pipe, the connection is not read while the output waits for the client.
+*/
+class FastCgiWorker
+{
+	public:
+		enum e_worker_state
+		{
+			DOWN, // No process, waiting for _retryAt to spawn again
+			IDLE,
+			BUSY
+		};
+	private:
+		FastCgiPool*	_pool;
+		pid_t			_pid;
+		int				_fd;
+		e_worker_state	_state;
+		CgiExecutor*	_executor; // NULL when idle, or when the request went away
+		int				_stdinFd;
+		bool			_stdinDone;
+		std::string		_out;
+		size_t			_outOffset;
+		std::string		_in;
+		uint32_t		_flags; // Current epoll flags
+		bool			_paused; // STDOUT not read while the client lags behind
+		size_t			_served;
+		uint64_t		_spawnedAt;
+		uint64_t		_retryAt;
+
+		/* PROCESS */
+		void	_stop(void);
+		void	_die(void);
+
+		/* RECORDS */
+		void	_queueRecord(unsigned char type, const char *data, size_t size);
+		void	_queueParams(const std::vector<char*> &envp);
+		int		_fillStdin(void);
+		int		_flush(void);
+		int		_receive(bool hangup);
+		bool	_handleRecords(void);
+		void	_handleRecord(unsigned char type, const char *data, size_t size);
+		void	_endRequest(bool success);
+		void	_watch(uint32_t flags);
+
+		FastCgiWorker(const FastCgiWorker &src);
+		FastCgiWorker &operator=(const FastCgiWorker &rhs);
+	public:
+		FastCgiWorker(FastCgiPool *pool);
+		~FastCgiWorker(void);
+
+		int		spawn(void);
+		void	restart(void);
+		void	stop(void);
+		void	begin(CgiExecutor *executor);
+		void	abandon(bool kill);
+		void	pause(bool pause);
+		void	handleEvent(uint32_t events);
+
+		/* GETTERS */
+		e_worker_state	getState(void) const { return _state; }
+		CgiExecutor*	getExecutor(void) const { return _executor; }
+		pid_t			getPid(void) const { return _pid; }
+		size_t			getServed(void) const { return _served; }
+		uint64_t		getRetryAt(void) const { return _retryAt; }
+};
+
+#endif // FASTCGIWORKER_HPP
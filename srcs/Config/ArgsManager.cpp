@@ -113,14 +113,14 @@ void ArgsManager::_parse(void)
 				else if (arg == "-d" || arg == "--debug")
 					_options["--debug"] = true;
 				else
-					Logger::log(Logger::DEBUG, "illegal option -- %s", arg.substr(2).c_str());
+					LOG_DEBUG("illegal option -- %s", arg.substr(2).c_str());
 			}
 			else
 			{
 				if (_configFilePath == DEFAULT_CONFIG_FILE_PATH)
 					_configFilePath = arg;
 				else
-					Logger::log(Logger::DEBUG, "invalid argument -- %s (config file already set: \"%s\")", arg.c_str(), _configFilePath.c_str());}
+					LOG_DEBUG("invalid argument -- %s (config file already set: \"%s\")", arg.c_str(), _configFilePath.c_str());}
 		}
 	}
 	catch (const std::exception &e)
@@ -1,13 +1,18 @@
 #include "BlocLocation.hpp"
 
 // ------------------------------- GENERAL --------------------------------
-BlocLocation::BlocLocation(std::string filename) : _autoindex(FALSE), _filename(filename)
+BlocLocation::BlocLocation(std::string filename) : _autoindex(FALSE), _fastCgiPoolSize(FCGI_DEFAULT_POOL_SIZE), _fastCgiMaxRequests(FCGI_DEFAULT_MAX_REQUESTS), _filename(filename)
 {
 	_counterView["root"] = 0;
 	_counterView["alias"] = 0;
 	_counterView["allowedMethods"] = 0;
 	_counterView["autoindex"] = 0;
 	_counterView["upload_path"] = 0;
+	_counterView["fastcgi_pool"] = 0;
+	_counterView["fastcgi_max_requests"] = 0;
+	_cgiEnv.push_back("SERVER_SOFTWARE=" CGI_SERVER_SOFTWARE);
+	_cgiEnv.push_back("GATEWAY_INTERFACE=" CGI_GATEWAY_INTERFACE);
+	_cgiEnv.push_back("REDIRECT_STATUS=200");
 }
 
 BlocLocation::BlocLocation(const BlocLocation &other)
@@ -26,12 +31,17 @@ BlocLocation &BlocLocation::operator=(const BlocLocation &other)
 		_path = other._path;
 		_root = other._root;
 		_rewrite = other._rewrite;
+		_rewriteResponse = other._rewriteResponse;
 		_alias = other._alias;
 		_indexes = other._indexes;
 		_allowedMethods = other._allowedMethods;
 		_autoindex = other._autoindex;
 		_cgiExtension = other._cgiExtension;
+		_fastCgiPass = other._fastCgiPass;
+		_fastCgiPoolSize = other._fastCgiPoolSize;
+		_fastCgiMaxRequests = other._fastCgiMaxRequests;
 		_uploadPath = other._uploadPath;
+		_cgiEnv = other._cgiEnv;
 		_counterView = other._counterView;
 		_filename = other._filename;
 	}
@@ -92,6 +102,51 @@ void BlocLocation::addCgiExtension(std::vector<std::string> &token)
 	_cgiExtension[token[1]] = token[2];
 }
 
+/**
+ * @brief fastcgi_pass .ext /path/to/app [args...]
+ * the files with this extension go to a pool of long-lived processes of the
+ * application, instead of a spawn per request
+ */
+void BlocLocation::addFastCgiPass(std::vector<std::string> &tokens)
+{
+	if (_fastCgiPass.find(tokens[1]) != _fastCgiPass.end())
+		Logger::log(Logger::FATAL, "Duplicate fastcgi extension: \"%s\" in file: %s:%d", tokens[1].c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	std::string command = tokens[2];
+	for (size_t i = 3; i < tokens.size(); i++)
+		command += " " + tokens[i];
+	_fastCgiPass[tokens[1]] = command;
+}
+
+/**
+ * @brief number of processes of the FastCGI pools of this location
+ */
+void BlocLocation::setFastCgiPoolSize(const std::string &size)
+{
+	std::stringstream ss(size);
+	long value = 0;
+
+	ss >> value;
+	if (ss.fail() || !ss.eof() || value < 1 || value > FCGI_MAX_POOL_SIZE)
+		Logger::log(Logger::FATAL, "Invalid value for fastcgi_pool: \"%s\" in file: %s:%d", size.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_fastCgiPoolSize = value;
+	_counterView["fastcgi_pool"]++;
+}
+
+/**
+ * @brief requests served by a FastCGI process before it is replaced, 0 for no limit
+ */
+void BlocLocation::setFastCgiMaxRequests(const std::string &maxRequests)
+{
+	std::stringstream ss(maxRequests);
+	long value = -1;
+
+	ss >> value;
+	if (ss.fail() || !ss.eof() || value < 0)
+		Logger::log(Logger::FATAL, "Invalid value for fastcgi_max_requests: \"%s\" in file: %s:%d", maxRequests.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_fastCgiMaxRequests = value;
+	_counterView["fastcgi_max_requests"]++;
+}
+
 void BlocLocation::setRewrite(std::vector<std::string>& tokens)
 {
 	int code = std::atoi(tokens[1].c_str());
@@ -100,6 +155,15 @@ void BlocLocation::setRewrite(std::vector<std::string>& tokens)
 	_rewrite = std::make_pair(code, tokens[2]);
 }
 
+/**
+ * @brief render the response of the return directive, if any
+ */
+void BlocLocation::renderRewrite()
+{
+	if (!_rewrite.second.empty())
+		_rewriteResponse = ErrorPage::renderRedirect(_rewrite.first, _rewrite.second);
+}
+
 /**
  * @brief remove all trailing slashes from paths
  * trailing ca veut dire a la fin
@@ -178,6 +242,12 @@ bool BlocLocation::isValidLineLocation(std::vector<std::string> &tokens, std::st
 		addIndexes(tokens);
 	else if (key == "cgi_extension" && tokens.size() == 3)
 		addCgiExtension(tokens);
+	else if (key == "fastcgi_pass" && tokens.size() >= 3)
+		addFastCgiPass(tokens);
+	else if (key == "fastcgi_pool" && tokens.size() == 2)
+		setFastCgiPoolSize(tokens[1]);
+	else if (key == "fastcgi_max_requests" && tokens.size() == 2)
+		setFastCgiMaxRequests(tokens[1]);
 	else if (key == "upload_path" && tokens.size() == 2)
 		setUploadPath(tokens[1]);
 	else
@@ -256,6 +326,7 @@ void BlocLocation::printLocation(void)
     printPair("Root", _root);
     printPair("Alias", _alias);
     printMap("CGI extension", _cgiExtension);
+    printMap("FastCGI pass", _fastCgiPass);
     printPair("Upload path", _uploadPath);
     printBool("Autoindex", _autoindex == TRUE, "on", "off");
 
@@ -10,6 +10,11 @@
 #include "Utils.hpp"
 #include "Logger.hpp"
 # include "ConfigParser.hpp"
+# include "FastCgiPool.hpp"
+# include "SharedBuffer.hpp"
+
+# define CGI_SERVER_SOFTWARE "webserv/1.0"
+# define CGI_GATEWAY_INTERFACE "CGI/1.1"
 
 enum e_Methods
 {
@@ -32,12 +37,17 @@ class BlocLocation
 		std::string	_path;
 		std::string _root;
 		std::pair<int, std::string> _rewrite;
+		SharedBuffer _rewriteResponse; // Rendered once the server is parsed
 		std::string _alias;
 		std::vector<std::string> _indexes;
 		std::vector<e_Methods> _allowedMethods;
 		e_boolMod _autoindex;
 		std::map<std::string, std::string> _cgiExtension;
+		std::map<std::string, std::string> _fastCgiPass; // extension -> application command
+		size_t _fastCgiPoolSize;
+		size_t _fastCgiMaxRequests;
 		std::string _uploadPath;
+		std::vector<std::string> _cgiEnv; // "NAME=value" entries shared by every CGI of the location
 
 		// divers
 		std::map<std::string, int> _counterView;
@@ -55,6 +65,7 @@ class BlocLocation
 		void addAllowedMethods(std::vector<std::string> &tokens);
 		void addIndexes(std::vector<std::string>& token);
 		void addCgiExtension(std::vector<std::string>& token);
+		void addFastCgiPass(std::vector<std::string>& tokens);
 
 
 	public:
@@ -74,11 +85,14 @@ class BlocLocation
 		void setRewrite(std::vector<std::string>& tokens);
 		void setAlias(const std::string &alias) { _alias = alias;  _counterView["alias"]++;}
 		void setAutoIndex(e_boolMod autoindex) { _autoindex = autoindex;  _counterView["autoindex"]++;}
+		void setFastCgiPoolSize(const std::string &size);
+		void setFastCgiMaxRequests(const std::string &maxRequests);
 
 		// Getters
 		const std::string &getPath() const { return _path; }
 		const std::string &getRoot() const { return _root; }
 		const std::pair<int, std::string> &getRewrite() const { return _rewrite; }
+		const SharedBuffer &getRewriteResponse() const { return _rewriteResponse; }
 		const std::string &getAlias() const { return _alias; }
 		const std::vector<std::string> &getFiles() const { return _indexes; }
 		const std::vector<e_Methods> &getAllowedMethods() const { return _allowedMethods; }
@@ -86,6 +100,10 @@ class BlocLocation
 		const std::vector<std::string> &getIndexes() const { return _indexes; }
 		const std::map<std::string, std::string> &getCGI() const { return _cgiExtension; }
 		std::string	getCgiPath(const std::string &path) const { return _cgiExtension.at(path); }
+		const std::map<std::string, std::string> &getFastCgi() const { return _fastCgiPass; }
+		size_t getFastCgiPoolSize() const { return _fastCgiPoolSize; }
+		size_t getFastCgiMaxRequests() const { return _fastCgiMaxRequests; }
+		const std::vector<std::string> &getCgiEnv() const { return _cgiEnv; }
 
 		// Is
 		bool isCgi(const std::string &path) const { return _cgiExtension.find(path) != _cgiExtension.end(); }
@@ -100,6 +118,7 @@ class BlocLocation
 		// Utils
 		static e_Methods	converStrToMethod(const std::string &method);
 		void cleanPaths();
+		void renderRewrite();
 		bool	isMethodAllowed(e_Methods method);
 };
 
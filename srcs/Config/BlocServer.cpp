@@ -32,6 +32,7 @@ BlocServer &BlocServer::operator=(const BlocServer &other)
 		_clientMaxBodySize = other._clientMaxBodySize;
 		_locations = other._locations;
 		_errorPages = other._errorPages;
+		_errorResponses = other._errorResponses;
 		_filename = other._filename;
 		_counterView = other._counterView;
 	}
@@ -127,6 +128,26 @@ void BlocServer::cleanPaths()
 		it->cleanPaths();
 	}
 }
+
+/**
+ * @brief render the error responses of the server and the redirections of
+ * its locations, errors are then queued without being built again
+ * a custom page which can not be read is replaced by the default one
+ */
+void BlocServer::renderResponses()
+{
+	_errorResponses.clear();
+	for (size_t i = 0; i < ErrorPage::CODES_COUNT; i++)
+		_errorResponses[ErrorPage::CODES[i]] = ErrorPage::getDefault(ErrorPage::CODES[i]);
+	for (std::map<int, std::string>::iterator it = _errorPages.begin(); it != _errorPages.end(); ++it){
+		SharedBuffer response = ErrorPage::renderFile(it->first, it->second);
+		_errorResponses[it->first] = response.empty() ? ErrorPage::getDefault(it->first) : response;
+	}
+
+	for (std::vector<BlocLocation>::iterator it = _locations.begin(); it != _locations.end(); ++it)
+		it->renderRewrite();
+}
+
 // ============ CHECKER ============
 
 
@@ -267,6 +288,15 @@ BlocLocation* BlocServer::findLocation(const std::string &uri)
 
 
 
+/**
+ * @brief the error response rendered for the code, NULL if none
+ */
+const SharedBuffer *BlocServer::findErrorResponse(int code) const
+{
+	std::map<int, SharedBuffer>::const_iterator it = _errorResponses.find(code);
+	return (it == _errorResponses.end() ? NULL : &it->second);
+}
+
 // ============ PRINT ============
 
 
@@ -11,6 +11,7 @@
 # include "ConfigParser.hpp"
 # include "BlocLocation.hpp"
 # include "ListenConfig.hpp"
+# include "SharedBuffer.hpp"
 
 # define BS_DEFAULT_CLIENT_MAX_BODY_SIZE 1048576 // 1MB
 
@@ -28,6 +29,7 @@ private:
 	unsigned long long _clientMaxBodySize;
 	std::vector<BlocLocation> _locations;
 	std::map<int, std::string> _errorPages;
+	std::map<int, SharedBuffer> _errorResponses; // Rendered once the bloc is parsed
 
 	// divers
 	std::string _filename;
@@ -55,6 +57,7 @@ public:
 
 	// Getters
 	const std::map<int, std::string> &getErrorPages() const { return _errorPages; }
+	const SharedBuffer *findErrorResponse(int code) const;
 	const std::vector<std::string> &getServerNames() const { return _serverNames; }
 	// const std::vector<BlocLocation> &getLocations() const { return _locations; }
 	std::vector<BlocLocation>* getLocations() { return &_locations; }
@@ -64,6 +67,7 @@ public:
 	const std::vector<std::string> &getIndexes() const { return _indexes; }
 
 	// Util
+	void renderResponses();
 	bool isServerNamePresent(std::vector<std::string>& otherNames);
 
 
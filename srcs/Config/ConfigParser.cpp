@@ -7,7 +7,17 @@ std::vector<std::string> ConfigParser::supportedMethods = ConfigParser::_getSupp
 std::vector<std::string> ConfigParser::supportedHttpVersions = ConfigParser::_getSupportedHttpVersions();
 
 
-ConfigParser::ConfigParser(void) : _filename("") {}
+ConfigParser::ConfigParser(void) : _filename(""), _workers(CP_DEFAULT_WORKERS), _fileCacheSize(FC_DEFAULT_SIZE), _fileCacheValid(FC_DEFAULT_VALID), _backlog(CP_DEFAULT_BACKLOG), _pipelineDepth(CP_DEFAULT_PIPELINE_DEPTH), _accessLogFormat(ACCESS_LOG_DEFAULT_FORMAT), _accessLogSample(1)
+{
+	_counterView["workers"] = 0;
+	_counterView["file_cache_size"] = 0;
+	_counterView["file_cache_valid"] = 0;
+	_counterView["backlog"] = 0;
+	_counterView["pipeline_depth"] = 0;
+	_counterView["access_log"] = 0;
+	_counterView["access_log_format"] = 0;
+	_counterView["access_log_sample"] = 0;
+}
 
 ConfigParser::~ConfigParser(void) {}
 
@@ -18,6 +28,224 @@ bool ConfigParser::isStartBlocServer(std::vector<std::string> tokens){
 				|| (tokens.size() == 1 && tokens[0] == "server{");
 }
 
+bool ConfigParser::isStartBlocTypes(std::vector<std::string> &tokens){
+	return ((tokens.size() >= 2 && tokens[0] == "types" && tokens[1] == "{"))
+				|| (tokens.size() >= 1 && tokens[0] == "types{");
+}
+
+/**
+ * @brief parse a types bloc: one MIME type then its extensions per line
+ * the entries are added to the built-in ones, compiled once the file is parsed
+ * the bloc may hold on its opening line: types { text/markdown md markdown }
+ */
+void ConfigParser::parseTypes(std::ifstream &configFile, std::vector<std::string> &tokens, std::string &line)
+{
+	tokens.erase(tokens.begin(), tokens.begin() + (tokens[0] == "types{" ? 1 : 2));
+	if (parseTypesLine(tokens, line))
+		return ;
+	while (std::getline(configFile, line))
+	{
+		ConfigParser::countLineFile++;
+		line = trimLine(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+		tokens = split(line, " ");
+		if (parseTypesLine(tokens, line))
+			return ;
+	}
+	Logger::log(Logger::FATAL, "Missing } in file: %s:%d", _filename.c_str(), ConfigParser::countLineFile);
+}
+
+/**
+ * @brief add the entry of a line of a types bloc, a } ends the bloc
+ *
+ * @return true if the bloc is closed
+ */
+bool ConfigParser::parseTypesLine(std::vector<std::string> &tokens, const std::string &line)
+{
+	bool isCloseTypes = !tokens.empty() && tokens.back() == "}";
+
+	if (isCloseTypes)
+		tokens.pop_back();
+	if (tokens.empty())
+		return (isCloseTypes);
+	if (tokens.size() < 2 || tokens[0].find('/') == std::string::npos)
+		Logger::log(Logger::FATAL, "Invalid line: \"%s\" in file: %s:%d", line.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	for (size_t i = 1; i < tokens.size(); i++)
+	{
+		if (!MimeTypes::isValidExtension(tokens[i]))
+			Logger::log(Logger::FATAL, "Invalid extension: \"%s\" in file: %s:%d", tokens[i].c_str(), _filename.c_str(), ConfigParser::countLineFile);
+		MimeTypes::add(tokens[i], tokens[0]);
+	}
+	return (isCloseTypes);
+}
+
+
+/**
+ * @brief Set the number of reactor processes
+ * "auto" starts one worker per online CPU
+ */
+void ConfigParser::setWorkers(const std::string &workers)
+{
+	if (workers == "auto")
+		_workers = sysconf(_SC_NPROCESSORS_ONLN);
+	else
+	{
+		std::stringstream ss(workers);
+		ss >> _workers;
+		if (ss.fail() || !ss.eof())
+			_workers = 0;
+	}
+	if (_workers < 1 || _workers > CP_MAX_WORKERS)
+		Logger::log(Logger::FATAL, "Invalid value for workers: \"%s\" in file: %s:%d", workers.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_counterView["workers"]++;
+}
+
+/**
+ * @brief Set the memory cap of the static file cache, 0 disables it
+ * the size is in bytes, with an optional k, m or g suffix
+ */
+void ConfigParser::setFileCacheSize(const std::string &size)
+{
+	std::stringstream ss(size);
+	unsigned long long value;
+	std::string unit;
+
+	ss >> value;
+	if (!ss.fail() && !ss.eof())
+		ss >> unit;
+	if (ss.fail() || !ss.eof() || size[0] == '-' || unit.size() > 1)
+		Logger::log(Logger::FATAL, "Invalid value for file_cache_size: \"%s\" in file: %s:%d", size.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	if (unit == "k" || unit == "K")
+		value <<= 10;
+	else if (unit == "m" || unit == "M")
+		value <<= 20;
+	else if (unit == "g" || unit == "G")
+		value <<= 30;
+	else if (!unit.empty())
+		Logger::log(Logger::FATAL, "Invalid unit for file_cache_size: \"%s\" in file: %s:%d", size.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_fileCacheSize = value;
+	_counterView["file_cache_size"]++;
+}
+
+/**
+ * @brief Set the seconds a cached file is trusted before being stat'ed again
+ */
+void ConfigParser::setFileCacheValid(const std::string &valid)
+{
+	std::stringstream ss(valid);
+	long value = -1;
+
+	ss >> value;
+	if (ss.fail() || !ss.eof() || value < 0 || value > CP_MAX_FILE_CACHE_VALID)
+		Logger::log(Logger::FATAL, "Invalid value for file_cache_valid: \"%s\" in file: %s:%d", valid.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_fileCacheValid = value;
+	_counterView["file_cache_valid"]++;
+}
+
+/**
+ * @brief Set the length of the accept queue of the listening sockets
+ * the kernel caps it to net.core.somaxconn
+ */
+void ConfigParser::setBacklog(const std::string &backlog)
+{
+	std::stringstream ss(backlog);
+	long value = 0;
+
+	ss >> value;
+	if (ss.fail() || !ss.eof() || value < 1 || value > CP_MAX_BACKLOG)
+		Logger::log(Logger::FATAL, "Invalid value for backlog: \"%s\" in file: %s:%d", backlog.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_backlog = value;
+	_counterView["backlog"]++;
+}
+
+/**
+ * @brief Set how many responses of a connection may wait to be sent before
+ * its next pipelined request is parsed
+ */
+void ConfigParser::setPipelineDepth(const std::string &depth)
+{
+	std::stringstream ss(depth);
+	long value = 0;
+
+	ss >> value;
+	if (ss.fail() || !ss.eof() || value < 1 || value > CP_MAX_PIPELINE_DEPTH)
+		Logger::log(Logger::FATAL, "Invalid value for pipeline_depth: \"%s\" in file: %s:%d", depth.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_pipelineDepth = value;
+	_counterView["pipeline_depth"]++;
+}
+
+/**
+ * @brief Set the access log file, off by default
+ */
+void ConfigParser::setAccessLog(const std::string &path)
+{
+	_accessLog = (path == "off") ? "" : path;
+	_counterView["access_log"]++;
+}
+
+/**
+ * @brief Set the access log format: json, or a line of $variables, the
+ * tokens joined again and its quotes removed
+ */
+void ConfigParser::setAccessLogFormat(const std::vector<std::string> &tokens)
+{
+	std::string format = tokens[1];
+
+	for (size_t i = 2; i < tokens.size(); i++)
+		format += " " + tokens[i];
+	if (format.size() >= 2 && (format[0] == '"' || format[0] == '\'') && format[format.size() - 1] == format[0])
+		format = format.substr(1, format.size() - 2);
+	if (format.empty())
+		Logger::log(Logger::FATAL, "Invalid value for access_log_format in file: %s:%d", _filename.c_str(), ConfigParser::countLineFile);
+	_accessLogFormat = format;
+	_counterView["access_log_format"]++;
+}
+
+/**
+ * @brief Log 1 request in sample, under high load
+ */
+void ConfigParser::setAccessLogSample(const std::string &sample)
+{
+	std::stringstream ss(sample);
+	long value = 0;
+
+	ss >> value;
+	if (ss.fail() || !ss.eof() || value < 1 || value > CP_MAX_ACCESS_LOG_SAMPLE)
+		Logger::log(Logger::FATAL, "Invalid value for access_log_sample: \"%s\" in file: %s:%d", sample.c_str(), _filename.c_str(), ConfigParser::countLineFile);
+	_accessLogSample = value;
+	_counterView["access_log_sample"]++;
+}
+
+/**
+ * @brief check if a line outside of any bloc is a valid global directive
+ */
+bool ConfigParser::isValidLineGlobal(std::vector<std::string>& tokens)
+{
+	if (tokens.size() < 2)
+		return (false);
+	if (tokens[0] == "workers" && tokens.size() == 2)
+		setWorkers(tokens[1]);
+	else if (tokens[0] == "file_cache_size" && tokens.size() == 2)
+		setFileCacheSize(tokens[1]);
+	else if (tokens[0] == "file_cache_valid" && tokens.size() == 2)
+		setFileCacheValid(tokens[1]);
+	else if (tokens[0] == "backlog" && tokens.size() == 2)
+		setBacklog(tokens[1]);
+	else if (tokens[0] == "pipeline_depth" && tokens.size() == 2)
+		setPipelineDepth(tokens[1]);
+	else if (tokens[0] == "access_log" && tokens.size() == 2)
+		setAccessLog(tokens[1]);
+	else if (tokens[0] == "access_log_format")
+		setAccessLogFormat(tokens);
+	else if (tokens[0] == "access_log_sample" && tokens.size() == 2)
+		setAccessLogSample(tokens[1]);
+	else
+		return (false);
+	if (_counterView[tokens[0]] > 1)
+		Logger::log(Logger::FATAL, "Duplicate line in main context: %s", tokens[0].c_str());
+	return (true);
+}
 
 /**
  * fonction qui check si il n'y a pas deux bloc server avec 
@@ -35,6 +263,29 @@ void ConfigParser::checkDoubleServerName(){
 	}
 }
 
+/**
+ * @brief The locations naming the same fastcgi_pass command share one pool:
+ * they must agree on its fastcgi_pool and fastcgi_max_requests
+ */
+void ConfigParser::checkFastCgiPools(){
+	std::map<std::string, const BlocLocation *> pools;
+
+	for (size_t i = 0; i < _servers.size(); i++){
+		std::vector<BlocLocation> *locations = _servers[i].getLocations();
+		for (size_t j = 0; j < locations->size(); j++){
+			const BlocLocation &location = (*locations)[j];
+			const std::map<std::string, std::string> &passes = location.getFastCgi();
+			for (std::map<std::string, std::string>::const_iterator it = passes.begin(); it != passes.end(); ++it){
+				const BlocLocation *&first = pools[it->second];
+				if (first == NULL)
+					first = &location;
+				else if (first->getFastCgiPoolSize() != location.getFastCgiPoolSize() || first->getFastCgiMaxRequests() != location.getFastCgiMaxRequests())
+					Logger::log(Logger::FATAL, "conflicting fastcgi_pool or fastcgi_max_requests for \"%s\" in %s and %s", it->second.c_str(), first->getPath().c_str(), location.getPath().c_str());
+			}
+		}
+	}
+}
+
 /**
  * fait les groupe de serverBloc par ip:port
 */
@@ -59,7 +310,7 @@ void ConfigParser::assignConfigs(){
 void ConfigParser::parse(const std::string &filename)
 {
 	this->_filename = filename;
-	Logger::log(Logger::DEBUG, "Parsing config file: %s", _filename.c_str());
+	LOG_DEBUG("Parsing config file: %s", _filename.c_str());
 	std::ifstream configFile(_filename.c_str());
 	std::vector<std::string> tokens;
 	std::string line;
@@ -77,6 +328,10 @@ void ConfigParser::parse(const std::string &filename)
 			BlocServer server(_filename);
 			_servers.push_back(server.getServerConfig(configFile));
 		}
+		else if (isStartBlocTypes(tokens))
+			parseTypes(configFile, tokens, line);
+		else if (isValidLineGlobal(tokens))
+			continue ;
 		else
 			Logger::log(Logger::FATAL, "Invalid line: \"%s\" in file: %s:%d", line.c_str(), _filename.c_str(), ConfigParser::countLineFile);
 	}
@@ -85,7 +340,13 @@ void ConfigParser::parse(const std::string &filename)
 		BlocServer server(_filename);
 		_servers.push_back(server.getServerConfig(configFile));
 	}
+	MimeTypes::compile();
+	if (!_accessLog.empty())
+		AccessLog::compile(_accessLogFormat);
+	for (size_t i = 0; i < _servers.size(); i++)
+		_servers[i].renderResponses(); // Once every type is known
 	checkDoubleServerName();
+	checkFastCgiPools();
 	assignConfigs();
 	configFile.close();
 }
@@ -93,6 +354,10 @@ void ConfigParser::parse(const std::string &filename)
 
 // ============ PRINT ============
 void ConfigParser::printServers(void){
+	std::cout << "Workers: " << _workers << ", backlog: " << _backlog << ", pipeline depth: " << _pipelineDepth << "\n";
+	std::cout << "File cache: " << _fileCacheSize << " bytes, revalidated every " << _fileCacheValid << "s\n";
+	std::cout << "MIME types from the config: " << MimeTypes::getCustomCount() << "\n";
+	std::cout << "Access log: " << (_accessLog.empty() ? "off" : _accessLog) << ", 1 request in " << _accessLogSample << ", format: " << _accessLogFormat << "\n" << std::endl;
 	for (size_t i = 0; i < _servers.size(); i++)
 	{
 		std::cout << "============ SERVER " << i + 1 << " ===========\n"
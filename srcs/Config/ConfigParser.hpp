@@ -8,6 +8,17 @@
 
 # include "Utils.hpp"
 # include "BlocServer.hpp"
+# include "FileCache.hpp"
+# include "AccessLog.hpp"
+
+# define CP_DEFAULT_WORKERS 1
+# define CP_MAX_WORKERS 128
+# define CP_MAX_FILE_CACHE_VALID 86400 // seconds
+# define CP_DEFAULT_BACKLOG 511
+# define CP_MAX_BACKLOG 65535
+# define CP_DEFAULT_PIPELINE_DEPTH 16
+# define CP_MAX_PIPELINE_DEPTH 1024
+# define CP_MAX_ACCESS_LOG_SAMPLE 1000000
 
 class BlocServer;
 
@@ -23,12 +34,32 @@ class ConfigParser
 		// std::vector<BlocServer> getServersConfig( void ) const { return _servers; }
 		std::map<std::string, std::vector<BlocServer> > getConfigs( void ) const { return _configs; }
 		std::map<std::string, std::vector<BlocServer> > &getServers( void ) { return _configs; }
+		int getWorkers( void ) const { return _workers; }
+		unsigned long long getFileCacheSize( void ) const { return _fileCacheSize; }
+		time_t getFileCacheValid( void ) const { return _fileCacheValid; }
+		int getBacklog( void ) const { return _backlog; }
+		size_t getPipelineDepth( void ) const { return _pipelineDepth; }
+		const std::string &getAccessLog( void ) const { return _accessLog; }
+		unsigned long getAccessLogSample( void ) const { return _accessLogSample; }
 		// parser
 		void parse(const std::string &filename);
 
 		// utils
 		void checkDoubleServerName();
+		void checkFastCgiPools();
 		bool isStartBlocServer(std::vector<std::string> tokens);
+		bool isStartBlocTypes(std::vector<std::string> &tokens);
+		void parseTypes(std::ifstream &configFile, std::vector<std::string> &tokens, std::string &line);
+		bool parseTypesLine(std::vector<std::string> &tokens, const std::string &line);
+		bool isValidLineGlobal(std::vector<std::string>& tokens);
+		void setWorkers(const std::string &workers);
+		void setFileCacheSize(const std::string &size);
+		void setFileCacheValid(const std::string &valid);
+		void setBacklog(const std::string &backlog);
+		void setPipelineDepth(const std::string &depth);
+		void setAccessLog(const std::string &path);
+		void setAccessLogFormat(const std::vector<std::string> &tokens);
+		void setAccessLogSample(const std::string &sample);
 		void assignConfigs();
 
 		// print
@@ -44,6 +75,15 @@ class ConfigParser
 
 		std::vector<BlocServer> _servers;
 		std::map<std::string, std::vector<BlocServer> > _configs;
+		int _workers;
+		unsigned long long _fileCacheSize;
+		time_t _fileCacheValid;
+		int _backlog;
+		size_t _pipelineDepth;
+		std::string _accessLog;
+		std::string _accessLogFormat;
+		unsigned long _accessLogSample;
+		std::map<std::string, int> _counterView;
 
 		/* STATIC */
 		static std::vector<std::string>	_getSupportedMethods(void);
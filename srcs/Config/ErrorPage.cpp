@@ -1,60 +1,101 @@
-
 #include "ErrorPage.hpp"
+#include "BlocServer.hpp"
 
+/*
+** The default error page, cut around TITLE, ERROR and MESSAGE
+*/
+static const char	PAGE_BEFORE_TITLE[] = "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\"><title>";
+static const char	PAGE_BEFORE_ERROR[] = "</title><style>@import url('https://fonts.googleapis.com/css2?family=Inter:ital,opsz,wght@0,14..32,100..900;1,14..32,100..900&display=swap');body{height: 100vh;margin: 0;padding: 0;display: flex;justify-content: center;align-items: center;background-color: #f1f1f1;font-family: \"Inter\", sans-serif;font-optical-sizing: auto;flex-direction: column;}.wrapper{position: relative;}.mainTitle{text-align: center;position: relative;font-size: 3rem;}.mainIcon{left: 50%;transform: translate(-50%, -100%);position: absolute;}.mainText{position: absolute;top: 50%;left: 50%;transform: translate(-50%, 120%);text-align: center;width: 100vw;}.subtitle{position: absolute;bottom: 0;}</style></head><body><div class=\"wrapper\"><lord-icon src=\"https://cdn.lordicon.com/usownftb.json\" trigger=\"loop\" delay=\"2000\" colors=\"primary:#000000,secondary:#000000\" style=\"width:150px;height:150px\" class=\"mainIcon\"></lord-icon><h1 class=\"mainTitle\">Error ";
+static const char	PAGE_BEFORE_MESSAGE[] = "</h1><p class=\"mainText\">";
+static const char	PAGE_END[] = "</p></div></body><script src=\"https://cdn.lordicon.com/lordicon.js\"></script></html>";
 
-std::string ErrorPage::getErrorPagesCustom(int statusCode, std::map<int, std::string> errorPagesCustom){
-	if (errorPagesCustom.empty())
-		return "";
-	std::map<int, std::string>::iterator it = errorPagesCustom.find(statusCode);
-	if (it == errorPagesCustom.end())
-		return "";
-	
-	std::string path = it->second;
-	std::string page;
-	std::ifstream file(path.c_str());
-	if (file.is_open())
-	{
-		std::stringstream content;
-		content << file.rdbuf();
-		std::string body = content.str();
-
-		page = "HTTP/1.1 " + intToString(statusCode) + " " + getErrorMessage(statusCode) + "\r\n";
-		page += "Content-Type: " + getMimeType(path) + "\r\n";
-		page += "Content-Length: " + intToString(body.size()) + "\r\n";
-		page += "\r\n";
-		page += body;
-
-		file.close();
-		return page;
-	}else{
-		Logger::log(Logger::ERROR, "Failed to open custom Error Page: %s", path.c_str());
-		return "";
-	}
+const int		ErrorPage::CODES[] = {400, 401, 403, 404, 405, 408, 409, 410, 413, 414, 415, 429, 431, 500, 501, 502, 503, 504, 505};
+const size_t	ErrorPage::CODES_COUNT = sizeof(ErrorPage::CODES) / sizeof(ErrorPage::CODES[0]);
+std::map<int, SharedBuffer>	ErrorPage::_defaults;
+
+/**
+ * @brief Render the status line, the headers and the body as one response
+ */
+static SharedBuffer	renderResponse(int statusCode, const std::string &headers, const std::string &body)
+{
+	std::string response = "HTTP/1.1 " + intToString(statusCode) + " " + getErrorMessage(statusCode) + "\r\n";
+	response += headers;
+	response += "Content-Length: " + Utils::ullToStr(body.size()) + "\r\n\r\n";
+	response += body;
+	return (SharedBuffer(response));
+}
+
+/**
+ * @brief Render the default html page of the status code
+ * The TITLE and ERROR slots get the status code, the MESSAGE slot the message
+ */
+SharedBuffer ErrorPage::renderPage(int statusCode)
+{
+	std::string code = intToString(statusCode);
+	std::string body = PAGE_BEFORE_TITLE + code + PAGE_BEFORE_ERROR + code + PAGE_BEFORE_MESSAGE + getErrorMessage(statusCode) + PAGE_END;
+	return (renderResponse(statusCode, "Content-Type: text/html\r\n", body));
 }
 
 /**
- * @brief Get the html error page related to the status code
- * Replace TITLE with the error code
- * Replace ERROR by the status code
- * Replace MESSAGE by the message
+ * @brief Render a custom error page, the file is read now and never again
  * 
- * @param statusCode 
- * @return std::string 
+ * @return SharedBuffer : empty if the file can not be used
  */
-std::string ErrorPage::getPage(int statusCode, std::map<int, std::string> errorPagesCustom){
+SharedBuffer ErrorPage::renderFile(int statusCode, const std::string &path)
+{
+	struct stat fileStat;
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1 || fstat(fd, &fileStat) == -1 || !S_ISREG(fileStat.st_mode) || fileStat.st_size > ERROR_PAGE_MAX_SIZE)
+	{
+		if (fd != -1)
+			close(fd);
+		LOG_ERROR("Failed to load custom Error Page: %s", path.c_str());
+		return (SharedBuffer());
+	}
 
-	std::string customPage = getErrorPagesCustom(statusCode, errorPagesCustom);
-	if (!customPage.empty())
-		return customPage;
+	std::string body(fileStat.st_size, '\0');
+	size_t done = 0;
+	while (done < body.size())
+	{
+		ssize_t bytesRead = read(fd, &body[done], body.size() - done);
+		if (bytesRead <= 0)
+			break ;
+		done += bytesRead;
+	}
+	close(fd);
+	if (done != body.size())
+	{
+		LOG_ERROR("Failed to read custom Error Page: %s", path.c_str());
+		return (SharedBuffer());
+	}
+	return (renderResponse(statusCode, "Content-Type: " + getMimeType(path) + "\r\n", body));
+}
 
-	std::string message = getErrorMessage(statusCode);
-	std::string body = "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\"><title>TITLE</title><style>@import url('https://fonts.googleapis.com/css2?family=Inter:ital,opsz,wght@0,14..32,100..900;1,14..32,100..900&display=swap');body{height: 100vh;margin: 0;padding: 0;display: flex;justify-content: center;align-items: center;background-color: #f1f1f1;font-family: \"Inter\", sans-serif;font-optical-sizing: auto;flex-direction: column;}.wrapper{position: relative;}.mainTitle{text-align: center;position: relative;font-size: 3rem;}.mainIcon{left: 50%;transform: translate(-50%, -100%);position: absolute;}.mainText{position: absolute;top: 50%;left: 50%;transform: translate(-50%, 120%);text-align: center;width: 100vw;}.subtitle{position: absolute;bottom: 0;}</style></head><body><div class=\"wrapper\"><lord-icon src=\"https://cdn.lordicon.com/usownftb.json\" trigger=\"loop\" delay=\"2000\" colors=\"primary:#000000,secondary:#000000\" style=\"width:150px;height:150px\" class=\"mainIcon\"></lord-icon><h1 class=\"mainTitle\">Error ERROR</h1><p class=\"mainText\">MESSAGE</p></div></body><script src=\"https://cdn.lordicon.com/lordicon.js\"></script></html>";
+/**
+ * @brief Render the response of a return directive
+ */
+SharedBuffer ErrorPage::renderRedirect(int statusCode, const std::string &location)
+{
+	return (renderResponse(statusCode, "Location: " + location + "\r\n", ""));
+}
 
-	body.replace(body.find("TITLE"), 5, intToString(statusCode));
-	body.replace(body.find("ERROR"), 5, intToString(statusCode));
-	body.replace(body.find("MESSAGE"), 7, message);
+/**
+ * @brief The default page of the status code, rendered on its first use
+ */
+const SharedBuffer &ErrorPage::getDefault(int statusCode)
+{
+	std::map<int, SharedBuffer>::iterator it = _defaults.find(statusCode);
+	if (it == _defaults.end())
+		it = _defaults.insert(std::make_pair(statusCode, renderPage(statusCode))).first;
+	return (it->second);
+}
+
+/**
+ * @brief Queue the error response of the status code, the one rendered for
+ * the server if any, otherwise the default page
+ */
+void ErrorPage::pushPage(OutputBuffer &output, int statusCode, const BlocServer *server){
+	const SharedBuffer *response = server ? server->findErrorResponse(statusCode) : NULL;
 
-	std::string responseLine = "HTTP/1.1 " + intToString(statusCode) + " " + message + "\r\n";
-	std::string headers = "Content-Type: text/html\r\nContent-Length: " + intToString(body.size()) + "\r\n\r\n";
-	return responseLine + headers + body;
-}
\ No newline at end of file
+	output.push(response ? *response : getDefault(statusCode));
+}
@@ -10,14 +10,32 @@
 
 
 #include "Utils.hpp"
+#include "OutputBuffer.hpp"
+#include "SharedBuffer.hpp"
 
+# define ERROR_PAGE_MAX_SIZE 1048576 // Bytes of a custom page kept in memory, a bigger one is not used
+
+class OutputBuffer;
+class BlocServer;
+
+/*
+** The canned responses: error pages and redirections are rendered once, at
+** config load, into immutable shared buffers queued as is on every client
+*/
 class ErrorPage
 {
 private:
+	static std::map<int, SharedBuffer>	_defaults; // Default pages rendered so far
 
 public:
-	static std::string getPage(int statusCode, std::map<int, std::string> errorPagesCustom = std::map<int, std::string>());
-	static std::string getErrorPagesCustom(int statusCode, std::map<int, std::string> errorPagesCustom);
+	static const int	CODES[]; // Error codes rendered for every server
+	static const size_t	CODES_COUNT;
+
+	static SharedBuffer			renderPage(int statusCode);
+	static SharedBuffer			renderFile(int statusCode, const std::string &path);
+	static SharedBuffer			renderRedirect(int statusCode, const std::string &location);
+	static const SharedBuffer	&getDefault(int statusCode);
+	static void pushPage(OutputBuffer &output, int statusCode, const BlocServer *server = NULL);
 };
 
 
@@ -0,0 +1,283 @@
+#include "AccessLog.hpp"
+#include "Logger.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+
+const char*	AccessLog::_names[AccessLog::VARIABLE_COUNT] = {
+	NULL,
+	"remote_addr",
+	"time_local",
+	"time_iso8601",
+	"msec",
+	"request",
+	"request_method",
+	"request_uri",
+	"server_protocol",
+	"status",
+	"bytes_sent",
+	"request_body_length",
+	"http_host",
+	"http_user_agent",
+	"http_referer",
+	"request_time",
+	"cgi_time",
+	"t_accept",
+	"t_headers",
+	"t_body",
+	"t_first_byte",
+	"t_last_byte"
+};
+bool						AccessLog::_enabled = false;
+bool						AccessLog::_json = false;
+std::vector<AccessLog::Token>	AccessLog::_tokens;
+unsigned long				AccessLog::_sample = 1;
+unsigned long				AccessLog::_counter = 0;
+
+/*
+** --------------------------------- CONFIG ---------------------------------
+*/
+
+/*
+** @brief Open the access log, its format already compiled. Called once
+** before the workers fork, an empty path keeps it off
+*/
+void	AccessLog::open(const std::string &path, unsigned long sample)
+{
+	if (path.empty())
+		return ;
+	AccessLog::_sample = sample;
+	AccessLog::_enabled = Logger::openAccessLog(path);
+	if (!AccessLog::_enabled)
+		LOG_ERROR("Failed to open the access log %s: %s", path.c_str(), strerror(errno));
+}
+
+/*
+** @brief Split the format into literals and variables at config load, an
+** unknown variable is fatal. A variable is $name or ${name}
+*/
+void	AccessLog::compile(const std::string &format)
+{
+	AccessLog::_tokens.clear();
+	AccessLog::_json = (format == ACCESS_LOG_JSON);
+	if (AccessLog::_json)
+		return ;
+
+	Token literal;
+	literal.variable = AccessLog::LITERAL;
+	for (size_t i = 0; i < format.size(); )
+	{
+		if (format[i] != '$')
+		{
+			literal.literal += format[i++];
+			continue ;
+		}
+		bool braces = (i + 1 < format.size() && format[i + 1] == '{');
+		size_t start = i + (braces ? 2 : 1);
+		size_t end = start;
+		while (end < format.size() && (std::isalnum(static_cast<unsigned char>(format[end])) || format[end] == '_'))
+			end++;
+		if (braces && (end >= format.size() || format[end] != '}'))
+			Logger::log(Logger::FATAL, "Invalid access_log_format: missing } after \"%s\"", format.substr(i).c_str());
+		std::string name = format.substr(start, end - start);
+		int variable = 1;
+		while (variable < AccessLog::VARIABLE_COUNT && name != AccessLog::_names[variable])
+			variable++;
+		if (variable == AccessLog::VARIABLE_COUNT)
+			Logger::log(Logger::FATAL, "Invalid access_log_format: unknown variable \"$%s\"", name.c_str());
+		if (!literal.literal.empty())
+			AccessLog::_tokens.push_back(literal);
+		literal.literal.clear();
+		Token token;
+		token.variable = static_cast<e_variable>(variable);
+		AccessLog::_tokens.push_back(token);
+		i = end + (braces ? 1 : 0);
+	}
+	if (!literal.literal.empty())
+		AccessLog::_tokens.push_back(literal);
+}
+
+/*
+** --------------------------------- WRITE ---------------------------------
+*/
+
+/*
+** @brief Count a finished request, true for 1 in sample
+*/
+bool	AccessLog::sample(void)
+{
+	return (AccessLog::_enabled && ++AccessLog::_counter % AccessLog::_sample == 0);
+}
+
+/*
+** @brief Format the line of a sent response and queue it in the ring
+*/
+void	AccessLog::write(const Entry &entry)
+{
+	std::string line;
+
+	line.reserve(256);
+	if (!AccessLog::_json)
+	{
+		for (size_t i = 0; i < AccessLog::_tokens.size(); i++)
+		{
+			if (AccessLog::_tokens[i].variable == AccessLog::LITERAL)
+				line += AccessLog::_tokens[i].literal;
+			else
+				AccessLog::_appendVariable(line, AccessLog::_tokens[i].variable, entry, false);
+		}
+	}
+	else
+	{
+		line += '{';
+		for (int variable = 1; variable < AccessLog::VARIABLE_COUNT; variable++)
+		{
+			if (variable == AccessLog::REQUEST) // Already there split in three
+				continue ;
+			if (line.size() > 1)
+				line += ',';
+			line += '"';
+			line += AccessLog::_names[variable];
+			line += "\":";
+			AccessLog::_appendVariable(line, static_cast<e_variable>(variable), entry, true);
+		}
+		line += '}';
+	}
+	Logger::access(line.data(), line.size());
+}
+
+/*
+** @brief Append the value of a variable, a string is quoted in json
+** a value not known is - (null in json)
+*/
+void	AccessLog::_appendVariable(std::string &line, e_variable variable, const Entry &entry, bool json)
+{
+	char	buffer[64];
+	struct tm	tm;
+	time_t	wall = entry.wallMs / 1000;
+
+	switch (variable)
+	{
+		case AccessLog::REMOTE_ADDR:
+			return (AccessLog::_appendEscaped(line, entry.remoteAddr, json));
+		case AccessLog::TIME_LOCAL:
+			localtime_r(&wall, &tm);
+			strftime(buffer, sizeof(buffer), "%d/%b/%Y:%H:%M:%S %z", &tm);
+			return (AccessLog::_appendEscaped(line, buffer, json));
+		case AccessLog::TIME_ISO8601:
+			localtime_r(&wall, &tm);
+			strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S%z", &tm);
+			return (AccessLog::_appendEscaped(line, buffer, json));
+		case AccessLog::MSEC:
+			snprintf(buffer, sizeof(buffer), "%ld.%03d", (long)wall, (int)(entry.wallMs % 1000));
+			line += buffer;
+			return ;
+		case AccessLog::REQUEST:
+			if (entry.method.empty()) // Request line not parsed
+				return (AccessLog::_appendEscaped(line, "", json));
+			return (AccessLog::_appendEscaped(line, entry.method + " " + entry.uri + " " + entry.httpVersion, json));
+		case AccessLog::REQUEST_METHOD:
+			return (AccessLog::_appendEscaped(line, entry.method, json));
+		case AccessLog::REQUEST_URI:
+			return (AccessLog::_appendEscaped(line, entry.uri, json));
+		case AccessLog::SERVER_PROTOCOL:
+			return (AccessLog::_appendEscaped(line, entry.httpVersion, json));
+		case AccessLog::STATUS:
+			snprintf(buffer, sizeof(buffer), "%d", entry.status);
+			line += buffer;
+			return ;
+		case AccessLog::BYTES_SENT:
+			snprintf(buffer, sizeof(buffer), "%llu", entry.bytesSent);
+			line += buffer;
+			return ;
+		case AccessLog::REQUEST_BODY_LENGTH:
+			snprintf(buffer, sizeof(buffer), "%llu", entry.bodyBytes);
+			line += buffer;
+			return ;
+		case AccessLog::HTTP_HOST:
+			return (AccessLog::_appendEscaped(line, entry.host, json));
+		case AccessLog::HTTP_USER_AGENT:
+			return (AccessLog::_appendEscaped(line, entry.userAgent, json));
+		case AccessLog::HTTP_REFERER:
+			return (AccessLog::_appendEscaped(line, entry.referer, json));
+		case AccessLog::REQUEST_TIME:
+			return (AccessLog::_appendSeconds(line, entry.start, entry.lastByte, json));
+		case AccessLog::CGI_TIME:
+			return (AccessLog::_appendSeconds(line, entry.cgiStart, entry.cgiEnd, json));
+		case AccessLog::T_ACCEPT:
+			return (AccessLog::_appendPhase(line, entry.accept, entry.start, json));
+		case AccessLog::T_HEADERS:
+			return (AccessLog::_appendPhase(line, entry.start, entry.headers, json));
+		case AccessLog::T_BODY:
+			return (AccessLog::_appendPhase(line, entry.start, entry.body, json));
+		case AccessLog::T_FIRST_BYTE:
+			return (AccessLog::_appendPhase(line, entry.start, entry.firstByte, json));
+		case AccessLog::T_LAST_BYTE:
+			return (AccessLog::_appendPhase(line, entry.start, entry.lastByte, json));
+		default:
+			return ;
+	}
+}
+
+/*
+** @brief Append a string, quoted in json. The quotes, backslashes and
+** control bytes are escaped (\xHH like nginx, \uHHHH in json)
+*/
+void	AccessLog::_appendEscaped(std::string &line, const std::string &value, bool json)
+{
+	char	buffer[8];
+
+	if (value.empty() && !json)
+	{
+		line += '-';
+		return ;
+	}
+	if (json)
+		line += '"';
+	for (size_t i = 0; i < value.size(); i++)
+	{
+		unsigned char c = value[i];
+		if (c == '"' || c == '\\' || c < 0x20 || c == 0x7F)
+		{
+			snprintf(buffer, sizeof(buffer), json ? "\\u%04x" : "\\x%02X", c);
+			line += buffer;
+		}
+		else
+			line += c;
+	}
+	if (json)
+		line += '"';
+}
+
+/*
+** @brief Append a duration in seconds, ms precision like $request_time
+*/
+void	AccessLog::_appendSeconds(std::string &line, uint64_t from, uint64_t to, bool json)
+{
+	char	buffer[32];
+
+	if (from == 0 || to == 0)
+	{
+		line += json ? "null" : "-";
+		return ;
+	}
+	snprintf(buffer, sizeof(buffer), "%llu.%03llu", (unsigned long long)(to - from) / 1000, (unsigned long long)(to - from) % 1000);
+	line += buffer;
+}
+
+/*
+** @brief Append the ms elapsed between two phases
+*/
+void	AccessLog::_appendPhase(std::string &line, uint64_t from, uint64_t to, bool json)
+{
+	char	buffer[32];
+
+	if (from == 0 || to == 0)
+	{
+		line += json ? "null" : "-";
+		return ;
+	}
+	snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)(to - from));
+	line += buffer;
+}
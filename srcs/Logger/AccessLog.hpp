@@ -0,0 +1,104 @@
+#ifndef ACCESSLOG_HPP
+#define ACCESSLOG_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include <stdint.h>
+
+#define ACCESS_LOG_DEFAULT_FORMAT "$remote_addr - - [$time_local] \"$request\" $status $bytes_sent \"$http_referer\" \"$http_user_agent\" $request_time"
+#define ACCESS_LOG_JSON "json"
+
+/*
+** One line per response, written through the Logger ring into the access
+** log file. The format is compiled once at load into literals and
+** variables, nginx style ($status, $request_time...), or the json keyword
+** for one JSON object per line with every variable.
+** Only 1 request in sample is logged.
+**
+** The phases are Clock::now() times (ms), 0 when not reached: the $t_*
+** variables are the ms elapsed since the request started (its first byte
+** parsed), $t_accept the ms between the accept of the connection and that
+** start.
+*/
+class AccessLog
+{
+	public:
+		struct Entry
+		{
+			char				remoteAddr[16];
+			uint64_t			wallMs; // Real time of the last byte, ms
+			std::string			method;
+			std::string			uri;
+			std::string			httpVersion;
+			std::string			host;
+			std::string			userAgent;
+			std::string			referer;
+			int					status;
+			unsigned long long	bytesSent;
+			unsigned long long	bodyBytes;
+			uint64_t			accept;
+			uint64_t			start;
+			uint64_t			headers;
+			uint64_t			body;
+			uint64_t			cgiStart;
+			uint64_t			cgiEnd;
+			uint64_t			firstByte;
+			uint64_t			lastByte;
+		};
+
+	private:
+		enum e_variable
+		{
+			LITERAL,
+			REMOTE_ADDR,
+			TIME_LOCAL,
+			TIME_ISO8601,
+			MSEC,
+			REQUEST,
+			REQUEST_METHOD,
+			REQUEST_URI,
+			SERVER_PROTOCOL,
+			STATUS,
+			BYTES_SENT,
+			REQUEST_BODY_LENGTH,
+			HTTP_HOST,
+			HTTP_USER_AGENT,
+			HTTP_REFERER,
+			REQUEST_TIME,
+			CGI_TIME,
+			T_ACCEPT,
+			T_HEADERS,
+			T_BODY,
+			T_FIRST_BYTE,
+			T_LAST_BYTE,
+			VARIABLE_COUNT
+		};
+		struct Token
+		{
+			e_variable	variable;
+			std::string	literal;
+		};
+
+		static const char*			_names[VARIABLE_COUNT];
+		static bool					_enabled;
+		static bool					_json;
+		static std::vector<Token>	_tokens;
+		static unsigned long		_sample;
+		static unsigned long		_counter;
+
+		static void	_appendVariable(std::string &line, e_variable variable, const Entry &entry, bool json);
+		static void	_appendEscaped(std::string &line, const std::string &value, bool json);
+		static void	_appendSeconds(std::string &line, uint64_t from, uint64_t to, bool json);
+		static void	_appendPhase(std::string &line, uint64_t from, uint64_t to, bool json);
+
+		AccessLog(void);
+	public:
+		static void	open(const std::string &path, unsigned long sample);
+		static void	compile(const std::string &format);
+		static bool	isEnabled(void) { return _enabled; }
+		static bool	sample(void);
+		static void	write(const Entry &entry);
+};
+
+#endif // ACCESSLOG_HPP
@@ -1,5 +1,9 @@
 #include "Logger.hpp"
 #include <stdarg.h>
+#include <climits>
+#include <algorithm>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 /*  */
 /* ---------------------------- STATIC VARIABLE ---------------------------- */
 /*  */
@@ -38,12 +42,34 @@ std::string Logger::_logFileName = Logger::_generateLogFileName();
 /*
  * @brief The string representation of the log levels
  */
-std::map<Logger::LogLevel, std::string> Logger::_logLevelStr = Logger::_generateLogLevelStr();
+const char *Logger::_logLevelStr[] = {"FATAL", "ERROR", "WARNING", "INFO", "TRACE", "DEBUG"};
 
 /*
  * @brief The color representation of the log levels
  */
-std::map<Logger::LogLevel, std::string> Logger::_logLevelColor = Logger::_generateLogLevelColor();
+const char *Logger::_logLevelColor[] = {C_RED, C_RED, C_YELLOW, C_GREEN, C_MAGENTA, C_CYAN};
+
+/*
+ * @brief The ring of records and the writer thread
+ */
+char Logger::_ring[LOGGER_RING_SIZE];
+size_t Logger::_head = 0;
+size_t Logger::_tail = 0;
+unsigned long Logger::_dropped = 0;
+int Logger::_sleeping = 0;
+volatile sig_atomic_t Logger::_reopen = 0;
+volatile sig_atomic_t Logger::_inLog = 0;
+int Logger::_stopping = 0;
+bool Logger::_running = false;
+pthread_t Logger::_thread;
+int Logger::_fileFd = -1;
+int Logger::_accessFd = -1;
+std::string Logger::_accessPath;
+bool Logger::_forked = false;
+time_t Logger::_stampTime = -1;
+char Logger::_stamp[32];
+
+static const char	RESET_EOL[] = C_RESET "\n";
 
 /*  */
 /* ---------------------------------- UTILS --------------------------------- */
@@ -63,101 +89,271 @@ std::string Logger::_generateLogFileName(void)
 }
 
 /*
- * @brief Generate the string representation of the log levels
+ * @brief Format a record: level, time and message, without color nor newline
+ * the time is formatted again only when the second changes
+ *
+ * @param buffer LOGGER_RECORD_MAX bytes, the message is truncated to fit
+ * @param prefix Set to the size of the level and time, the message follows
  *
- * @return std::map<Logger::LogLevel, std::string> : The string representation of the log levels
+ * @return size_t : The size of the record
  */
-std::map<Logger::LogLevel, std::string> Logger::_generateLogLevelStr(void)
+size_t Logger::_format(Logger::LogLevel level, char *buffer, size_t &prefix, const char *msg, va_list args)
 {
-	std::map<Logger::LogLevel, std::string> logLevelStr;
+	int savedErrno = errno;
+	std::time_t now = std::time(NULL);
+	if (now != Logger::_stampTime)
+	{
+		struct tm tm;
+		localtime_r(&now, &tm);
+		std::strftime(Logger::_stamp, sizeof(Logger::_stamp), "%Y-%m-%d %H:%M:%S", &tm);
+		Logger::_stampTime = now;
+	}
 
-	logLevelStr[Logger::FATAL] = "FATAL";
-	logLevelStr[Logger::ERROR] = "ERROR";
-	logLevelStr[Logger::WARNING] = "WARNING";
-	logLevelStr[Logger::INFO] = "INFO";
-	logLevelStr[Logger::TRACE] = "TRACE";
-	logLevelStr[Logger::DEBUG] = "DEBUG";
+	int size = snprintf(buffer, LOGGER_RECORD_MAX, "[%s]\t%s : ", Logger::_logLevelStr[level], Logger::_stamp);
+	prefix = size;
+	int message = vsnprintf(buffer + size, LOGGER_RECORD_MAX - size, msg, args);
+	if (message > 0)
+		size = std::min(size + message, LOGGER_RECORD_MAX - 1);
+	if (level == Logger::FATAL && savedErrno != 0 && size < LOGGER_RECORD_MAX - 1)
+	{
+		int error = snprintf(buffer + size, LOGGER_RECORD_MAX - size, ": %s", std::strerror(savedErrno));
+		if (error > 0)
+			size = std::min(size + error, LOGGER_RECORD_MAX - 1);
+	}
+	return (size);
+}
+
+/*
+ * @brief Copy a record into the ring, a record which does not fit before
+ * the end of the ring starts again at its beginning after a padding record
+ * a full ring drops the record
+ */
+void Logger::_push(uint32_t level, const char *text, size_t size)
+{
+	size_t need = (sizeof(RecordHeader) + size + 7) & ~(size_t)7;
+	size_t head = __atomic_load_n(&Logger::_head, __ATOMIC_ACQUIRE);
+	size_t tail = Logger::_tail;
+	size_t offset = tail & (LOGGER_RING_SIZE - 1);
+	size_t padding = (LOGGER_RING_SIZE - offset < need) ? LOGGER_RING_SIZE - offset : 0;
 
-	return (logLevelStr);
+	if (tail + padding + need - head > LOGGER_RING_SIZE)
+	{
+		__atomic_add_fetch(&Logger::_dropped, 1, __ATOMIC_RELAXED);
+		return ;
+	}
+	if (padding != 0)
+	{
+		reinterpret_cast<RecordHeader *>(Logger::_ring + offset)->level = LOGGER_RECORD_PAD;
+		tail += padding;
+		offset = 0;
+	}
+	RecordHeader *header = reinterpret_cast<RecordHeader *>(Logger::_ring + offset);
+	header->size = size;
+	header->level = level;
+	std::memcpy(header + 1, text, size);
+	__atomic_store_n(&Logger::_tail, tail + need, __ATOMIC_RELEASE);
+	Logger::_wake();
 }
 
 /*
- * @brief Generate the color representation of the log levels
- *
- * @return std::map<Logger::LogLevel, std::string> : The color representation of the log levels
+ * @brief Wake the writer thread if it waits, async-signal-safe
  */
-std::map<Logger::LogLevel, std::string> Logger::_generateLogLevelColor(void)
+void Logger::_wake(void)
 {
-	std::map<Logger::LogLevel, std::string> logLevelColor;
+	if (__atomic_exchange_n(&Logger::_sleeping, 0, __ATOMIC_SEQ_CST) == 1)
+		syscall(SYS_futex, &Logger::_sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
 
-	logLevelColor[Logger::FATAL] = C_RED;
-	logLevelColor[Logger::ERROR] = C_RED;
-	logLevelColor[Logger::WARNING] = C_YELLOW;
-	logLevelColor[Logger::INFO] = C_GREEN;
-	logLevelColor[Logger::TRACE] = C_MAGENTA;
-	logLevelColor[Logger::DEBUG] = C_CYAN;
+/*
+ * @brief Open the log file once, it stays open until the next reopen
+ */
+void Logger::_openFile(void)
+{
+	if (Logger::_fileFd != -1)
+		close(Logger::_fileFd);
+	Logger::_fileFd = -1;
+	// Create directory if not exist
+	if (mkdir(LOGGER_DIRECTORY, 0777) == -1 && errno != EEXIST)
+		return ;
+	Logger::_fileFd = open((LOGGER_DIRECTORY "/" + Logger::getLogFileName()).c_str(), O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, 0666);
+}
 
-	return (logLevelColor);
+/*
+ * @brief Open the access log, it stays open until the next reopen
+ */
+void Logger::_openAccess(void)
+{
+	if (Logger::_accessFd != -1)
+		close(Logger::_accessFd);
+	Logger::_accessFd = open(Logger::_accessPath.c_str(), O_CREAT | O_WRONLY | O_APPEND | O_CLOEXEC, 0644);
 }
 
 /*
- * @brief Format a log message
- *
- * @param level The level of the message
- * @param msg The message to log
- * @param time The time of the message
- *
- * @return std::string : The formated message
+ * @brief writev the whole iovec array, resumed after a short write
+ * a failed write drops the rest, nothing is retried
  */
-std::string Logger::_formater(Logger::LogLevel level, const char *msg, std::string time, bool colored)
+void Logger::_writeAll(int fd, struct iovec *iov, int count)
 {
-	std::string formatedMsg;
-
-	if (colored == true)
-		formatedMsg += Logger::getLogLevelColor(level);
-	formatedMsg += "[" + Logger::getLogLevelStr(level) + "]\t";
-	formatedMsg += time + " : " + msg;
-	if ((level == Logger::FATAL) && errno != 0)
-		formatedMsg += ": " + static_cast<std::string>(std::strerror(errno));
-	if (colored == true)
-		formatedMsg += C_RESET;
-
-	return (formatedMsg);
+	while (count > 0)
+	{
+		ssize_t written = writev(fd, iov, std::min(count, IOV_MAX));
+		if (written < 0 && errno == EINTR)
+			continue ;
+		if (written <= 0)
+			return ;
+		while (count > 0 && (size_t)written >= iov->iov_len)
+		{
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0)
+		{
+			iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+			iov->iov_len -= written;
+		}
+	}
 }
 
 /*
- * @brief Print a log message
- *
- * @param level The level of the message
- * @param time The time of the message
- * @param msg The message to log
+ * @brief Write records to stdout, in color, and to the log file
+ * the access log lines go to the access log only
  */
-void Logger::_printLog(Logger::LogLevel level, const char *msg, std::string time)
+void Logger::_writeRecords(const RecordHeader **records, size_t count)
 {
-	std::cout << Logger::_formater(level, msg, time) << std::endl;
+	struct iovec out[LOGGER_BATCH_RECORDS * 3];
+	struct iovec file[LOGGER_BATCH_RECORDS * 2];
+	struct iovec access[LOGGER_BATCH_RECORDS * 2];
+	size_t logged = 0;
+	size_t accessed = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (records[i]->level == LOGGER_RECORD_ACCESS)
+		{
+			access[accessed * 2].iov_base = const_cast<RecordHeader *>(records[i] + 1);
+			access[accessed * 2].iov_len = records[i]->size;
+			access[accessed * 2 + 1].iov_base = const_cast<char *>(RESET_EOL + sizeof(RESET_EOL) - 2);
+			access[accessed * 2 + 1].iov_len = 1;
+			accessed++;
+			continue ;
+		}
+		out[logged * 3].iov_base = const_cast<char *>(Logger::_logLevelColor[records[i]->level]);
+		out[logged * 3].iov_len = std::strlen(Logger::_logLevelColor[records[i]->level]);
+		out[logged * 3 + 1].iov_base = const_cast<RecordHeader *>(records[i] + 1);
+		out[logged * 3 + 1].iov_len = records[i]->size;
+		out[logged * 3 + 2].iov_base = const_cast<char *>(RESET_EOL);
+		out[logged * 3 + 2].iov_len = sizeof(RESET_EOL) - 1;
+		file[logged * 2] = out[logged * 3 + 1];
+		file[logged * 2 + 1].iov_base = const_cast<char *>(RESET_EOL + sizeof(RESET_EOL) - 2);
+		file[logged * 2 + 1].iov_len = 1;
+		logged++;
+	}
+	if (accessed > 0)
+	{
+		if (Logger::_accessFd == -1)
+			Logger::_openAccess();
+		if (Logger::_accessFd != -1)
+			Logger::_writeAll(Logger::_accessFd, access, accessed * 2);
+	}
+	if (logged == 0)
+		return ;
+	Logger::_writeAll(STDOUT_FILENO, out, logged * 3);
+	if (Logger::getLogFileState() == false)
+		return ;
+	if (Logger::_fileFd == -1)
+		Logger::_openFile();
+	if (Logger::_fileFd != -1)
+		Logger::_writeAll(Logger::_fileFd, file, logged * 2);
 }
 
 /*
- * @brief Write a log message in a file
- *
- * @param fd The file descriptor
- * @param level The level of the message
- * @param msg The message to log
- * @param time The time of the message
+ * @brief Log how many records the full ring dropped since the last report
+ * the writer thread formats its own time, the stamp belongs to the loop
  */
-void Logger::_writeLogInFile(Logger::LogLevel level, const char *msg, std::string time)
+void Logger::_reportDropped(unsigned long &reported)
 {
-	// Create directory if not exist
-	if (mkdir("logs", 0777) == -1 && errno != EEXIST)
+	unsigned long dropped = __atomic_load_n(&Logger::_dropped, __ATOMIC_RELAXED);
+	if (dropped == reported)
+		return ;
+
+	char buffer[sizeof(RecordHeader) + 128];
+	char stamp[32];
+	struct tm tm;
+	std::time_t now = std::time(NULL);
+	localtime_r(&now, &tm);
+	std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+
+	RecordHeader *header = reinterpret_cast<RecordHeader *>(buffer);
+	header->level = Logger::WARNING;
+	header->size = snprintf(reinterpret_cast<char *>(header + 1), 128, "[%s]\t%s : %lu log messages dropped, the log buffer was full", Logger::_logLevelStr[Logger::WARNING], stamp, dropped - reported);
+	const RecordHeader *record = header;
+	Logger::_writeRecords(&record, 1);
+	reported = dropped;
+}
+
+/*
+ * @brief Writer thread: drain the ring in batches, wait on the futex while
+ * it is empty, until stop() once everything is written
+ */
+void *Logger::_threadMain(void *arg)
+{
+	const RecordHeader	*records[LOGGER_BATCH_RECORDS];
+	unsigned long		reported = 0;
+	struct timespec		timeout = {1, 0};
+
+	(void)arg;
+	while (true)
 	{
-		std::cerr << "Error: " << std::strerror(errno) << std::endl;
-		return;
+		if (Logger::_reopen)
+		{
+			Logger::_reopen = 0;
+			if (Logger::getLogFileState() == true)
+				Logger::_openFile();
+			if (!Logger::_accessPath.empty())
+				Logger::_openAccess();
+		}
+		size_t tail = __atomic_load_n(&Logger::_tail, __ATOMIC_ACQUIRE);
+		size_t head = Logger::_head;
+		if (head == tail)
+		{
+			Logger::_reportDropped(reported);
+			if (__atomic_load_n(&Logger::_stopping, __ATOMIC_ACQUIRE))
+				break ;
+			__atomic_store_n(&Logger::_sleeping, 1, __ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&Logger::_tail, __ATOMIC_SEQ_CST) == tail && !__atomic_load_n(&Logger::_stopping, __ATOMIC_SEQ_CST) && !Logger::_reopen)
+				syscall(SYS_futex, &Logger::_sleeping, FUTEX_WAIT_PRIVATE, 1, &timeout, NULL, 0);
+			__atomic_store_n(&Logger::_sleeping, 0, __ATOMIC_SEQ_CST);
+			continue ;
+		}
+
+		size_t count = 0;
+		while (head != tail && count < LOGGER_BATCH_RECORDS)
+		{
+			size_t offset = head & (LOGGER_RING_SIZE - 1);
+			const RecordHeader *header = reinterpret_cast<const RecordHeader *>(Logger::_ring + offset);
+			if (header->level == LOGGER_RECORD_PAD)
+			{
+				head += LOGGER_RING_SIZE - offset;
+				continue ;
+			}
+			records[count++] = header;
+			head += (sizeof(RecordHeader) + header->size + 7) & ~(size_t)7;
+		}
+		Logger::_writeRecords(records, count);
+		__atomic_store_n(&Logger::_head, head, __ATOMIC_RELEASE);
 	}
-	int file = open(("logs/" + Logger::getLogFileName()).c_str(), O_CREAT | O_WRONLY | O_APPEND, 0666);
-	std::string log = Logger::_formater(level, msg, time, false);
-	write(file, log.c_str(), log.size());
-	write(file, "\n", 1);
-	close(file);
+	return (NULL);
+}
+
+/*
+ * @brief A forked child has no writer thread, it writes its records itself
+ * but no access log line until its own start()
+ */
+void Logger::_atforkChild(void)
+{
+	Logger::_running = false;
+	Logger::_forked = true;
 }
 
 /*  */
@@ -176,46 +372,140 @@ void Logger::log(Logger::LogLevel level, const char *msg, ...)
 	// Check if the logger is on
 	if (Logger::getLogState() == false || (level == Logger::DEBUG && Logger::getLogDebugState() == false))
 		return;
+	if (Logger::_inLog) // Logged from a signal handler while the loop was logging
+	{
+		__atomic_add_fetch(&Logger::_dropped, 1, __ATOMIC_RELAXED);
+		if (level == Logger::FATAL)
+			throw std::runtime_error(msg);
+		return;
+	}
+	Logger::_inLog = 1;
 
-	// Create a buffer
-	const int initialBufferSize = 1024;
-	std::vector<char> buffer(initialBufferSize);
-
+	// The record is formatted after its header, written as is without writer thread
+	static uint64_t record[(sizeof(RecordHeader) + LOGGER_RECORD_MAX) / sizeof(uint64_t)];
+	RecordHeader *header = reinterpret_cast<RecordHeader *>(record);
+	char *text = reinterpret_cast<char *>(header + 1);
+	size_t prefix;
 	va_list args;
 	va_start(args, msg);
-	int size = vsnprintf(buffer.data(), buffer.size(), msg, args);
+	header->size = Logger::_format(level, text, prefix, msg, args);
+	header->level = level;
 	va_end(args);
 
-	// Handling error
-	if (size < 0)
+	if (Logger::_running)
+		Logger::_push(level, text, header->size);
+	else
 	{
-		return;
+		const RecordHeader *written = header;
+		Logger::_writeRecords(&written, 1);
 	}
+	Logger::_inLog = 0;
+
+	// throw if level is FATAL
+	if (level == Logger::FATAL)
+		throw std::runtime_error(std::string(text + prefix, header->size - prefix));
+}
+
+/*
+ * @brief Start the writer thread of this process, the records are queued
+ * from now on. Called again in a forked worker, which gets its own
+ */
+void Logger::start(void)
+{
+	static bool registered = false;
+
+	if (Logger::_running)
+		return ;
+	if (!registered)
+		registered = (pthread_atfork(NULL, NULL, Logger::_atforkChild) == 0);
+	std::cout << std::flush;
+	Logger::_forked = false;
+	Logger::_head = 0;
+	Logger::_tail = 0;
+	Logger::_stopping = 0;
+	Logger::_sleeping = 0;
+
+	// The signals go to the loop, never to the writer
+	sigset_t all, previous;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+	Logger::_running = (pthread_create(&Logger::_thread, NULL, Logger::_threadMain, NULL) == 0);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
 
-	// Resize the buffer if needed
-	while (size >= static_cast<int>(buffer.size()))
+/*
+ * @brief Write what is queued and stop the writer thread, the records are
+ * written right away again
+ */
+void Logger::stop(void)
+{
+	if (!Logger::_running)
+		return ;
+	__atomic_store_n(&Logger::_stopping, 1, __ATOMIC_SEQ_CST);
+	Logger::_wake();
+	pthread_join(Logger::_thread, NULL);
+	Logger::_running = false;
+}
+
+/*
+ * @brief Reopen the log file (rotation), called from the SIGUSR1 handler
+ */
+void Logger::reopen(void)
+{
+	Logger::_reopen = 1;
+	if (Logger::_running)
+		Logger::_wake();
+	else
 	{
-		buffer.resize(buffer.size() * 2);
-		va_start(args, msg);
-		size = vsnprintf(buffer.data(), buffer.size(), msg, args);
-		va_end(args);
+		if (Logger::_fileFd != -1)
+			close(Logger::_fileFd);
+		if (Logger::_accessFd != -1)
+			close(Logger::_accessFd);
+		Logger::_fileFd = -1; // Opened again by the next record
+		Logger::_accessFd = -1;
 	}
+}
 
-	// Get the current time
-	std::time_t t = std::time(NULL);
-	char timeBuffer[80];
-	std::strftime(timeBuffer, sizeof(timeBuffer), "%Y-%m-%d %H:%M:%S", std::localtime(&t));
-
-	// Print the log
+/*  */
+/* ------------------------------- ACCESS LOG ------------------------------- */
+/*  */
 
-	Logger::_printLog(level, buffer.data(), timeBuffer);
+/*
+ * @brief Open the access log once before the workers fork, they share it
+ * in append mode
+ *
+ * @return bool : false if it cannot be opened
+ */
+bool Logger::openAccessLog(const std::string &path)
+{
+	Logger::_accessPath = path;
+	Logger::_openAccess();
+	return (Logger::_accessFd != -1);
+}
 
-	if (Logger::getLogFileState() == true)
-		Logger::_writeLogInFile(level, buffer.data(), timeBuffer);
-	
-	// throw if level is FATAL
-	if (level == Logger::FATAL)
-		throw std::runtime_error(buffer.data());
+/*
+ * @brief Queue an access log line, without newline, whatever the log state
+ * too long, it is truncated
+ */
+void Logger::access(const char *text, size_t size)
+{
+	if (Logger::_forked)
+		return ;
+	Logger::_inLog = 1; // One producer: a signal handler logging meanwhile is dropped
+	size = std::min(size, (size_t)LOGGER_RECORD_MAX);
+	if (Logger::_running)
+		Logger::_push(LOGGER_RECORD_ACCESS, text, size);
+	else
+	{
+		static uint64_t record[(sizeof(RecordHeader) + LOGGER_RECORD_MAX) / sizeof(uint64_t)];
+		RecordHeader *header = reinterpret_cast<RecordHeader *>(record);
+		header->size = size;
+		header->level = LOGGER_RECORD_ACCESS;
+		std::memcpy(header + 1, text, size);
+		const RecordHeader *written = header;
+		Logger::_writeRecords(&written, 1);
+	}
+	Logger::_inLog = 0;
 }
 
 /*  */
@@ -320,6 +610,16 @@ std::string Logger::getLogLevelColor(Logger::LogLevel level)
 	return (Logger::_logLevelColor[level]);
 }
 
+/*
+ * @brief Get the number of records dropped because the ring was full
+ *
+ * @return unsigned long : The number of dropped records
+ */
+unsigned long Logger::getDropped(void)
+{
+	return (__atomic_load_n(&Logger::_dropped, __ATOMIC_RELAXED));
+}
+
 /*
  * @brief Cleanup the logger
  */
@@ -6,6 +6,7 @@
 #include <string>
 #include <iostream>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctime>
@@ -14,12 +15,37 @@
 #include <cerrno>
 #include <cstring>
 #include <cstdlib>
+#include <csignal>
+#include <cstdarg>
+#include <pthread.h>
 
 /* DEFAULT PARAMETERS */
 #define DEFAULT_LOG_STATE true
 #define DEFAULT_LOG_FILE_STATE false
 #define DEFAULT_LOG_DEBUG_STATE false
 
+#define LOGGER_DIRECTORY "logs"
+#define LOGGER_RING_SIZE 1048576 // Bytes of records waiting for the writer thread, a power of two
+#define LOGGER_RECORD_MAX 16384 // Bytes of a message, a longer one is truncated
+#define LOGGER_BATCH_RECORDS 256 // Records written per writev
+#define LOGGER_RECORD_PAD 0xFFFFFFFF
+#define LOGGER_RECORD_ACCESS 0xFFFFFFFE // An access log line, written to the access log only
+
+/* MINIMUM LEVEL: the statements above it are compiled out (make re LOG_LEVEL=3 keeps up to INFO) */
+#ifndef LOG_MIN_LEVEL
+# define LOG_MIN_LEVEL 5 // Logger::DEBUG
+#endif
+
+/*
+** Once started, the event loop only formats a record and copies it into a
+** lock-free ring (one producer, one consumer). A writer thread drains it
+** with batched writev calls to stdout and to the log file, kept open and
+** reopened on SIGUSR1 for rotation. When the ring is full the record is
+** dropped and counted, logging never blocks the loop.
+** Before start(), after stop() and in forked children the records are
+** written right away instead.
+** The access log lines (AccessLog) take the same ring to their own file.
+*/
 class Logger
 {
 public:
@@ -38,6 +64,15 @@ public:
 	/* MAIN */
 	static void log(LogLevel level, const char *msg, ...);
 
+	/* WRITER */
+	static void start(void);
+	static void stop(void);
+	static void reopen(void);
+
+	/* ACCESS LOG */
+	static bool openAccessLog(const std::string &path);
+	static void access(const char *text, size_t size);
+
 	/* SETTERS */
 	static void setLogState(bool state);
 	static void setLogFileState(bool state);
@@ -50,25 +85,71 @@ public:
 	static std::string getLogFileName(void);
 	static std::string getLogLevelStr(LogLevel level);
 	static std::string getLogLevelColor(LogLevel level);
+	static unsigned long getDropped(void);
+	static bool isEnabled(LogLevel level) { return (_logState && (level != DEBUG || _logDebugState)); }
 
 	/* CLEANUP */
 	// static void cleanup(void);
 
 private:
+	/* A record in the ring, its text follows, the next one is 8-byte aligned */
+	struct RecordHeader
+	{
+		uint32_t	size; // Text bytes
+		uint32_t	level; // LOGGER_RECORD_PAD: the rest of the ring is skipped
+	};
+
 	static bool _logState;
 	static bool _logFileState;
 	static bool _logDebugState;
 	static std::string _logFileName;
-	static std::map<Logger::LogLevel, std::string> _logLevelStr;
-	static std::map<Logger::LogLevel, std::string> _logLevelColor;
+	static const char *_logLevelStr[];
+	static const char *_logLevelColor[];
+
+	// Ring, _tail is written by the loop only, _head by the writer only
+	static char _ring[LOGGER_RING_SIZE];
+	static size_t _head;
+	static size_t _tail;
+	static unsigned long _dropped;
+	static int _sleeping; // Futex word, 1 while the writer waits
+	static volatile sig_atomic_t _reopen;
+	static volatile sig_atomic_t _inLog; // A signal handler logging meanwhile is dropped
+	static int _stopping;
+	static bool _running;
+	static pthread_t _thread;
+	static int _fileFd;
+	static int _accessFd;
+	static std::string _accessPath;
+	static bool _forked; // A child without start(): its access lines are not ours to write
+	// Timestamp of the loop, formatted again once per second
+	static time_t _stampTime;
+	static char _stamp[32];
 
 	/* UTILS */
 	static std::string _generateLogFileName(void);
-	static std::map<Logger::LogLevel, std::string> _generateLogLevelStr(void);
-	static std::map<Logger::LogLevel, std::string> _generateLogLevelColor(void);
-	static std::string _formater(Logger::LogLevel level, const char *msg, std::string time, bool colored = true);
-	static void _printLog(Logger::LogLevel level, const char *msg, std::string time);
-	static void _writeLogInFile(LogLevel level, const char *msg, std::string time);
+	static size_t _format(Logger::LogLevel level, char *buffer, size_t &prefix, const char *msg, va_list args);
+	static void _push(uint32_t level, const char *text, size_t size);
+	static void _wake(void);
+	static void _openFile(void);
+	static void _openAccess(void);
+	static void _writeAll(int fd, struct iovec *iov, int count);
+	static void _writeRecords(const RecordHeader **records, size_t count);
+	static void _reportDropped(unsigned long &reported);
+	static void *_threadMain(void *arg);
+	static void _atforkChild(void);
 };
 
+/*
+** Level-checked statements: the arguments are evaluated only when the level
+** is logged, and the statement is compiled out above LOG_MIN_LEVEL.
+** An expression of type void, so `return (LOG_DEBUG(...));` works.
+** FATAL throws: it stays a plain Logger::log call.
+*/
+#define LOGGER_LOG(level, ...) (((level) <= LOG_MIN_LEVEL && Logger::isEnabled(level)) ? Logger::log(level, __VA_ARGS__) : (void)0)
+#define LOG_ERROR(...) LOGGER_LOG(Logger::ERROR, __VA_ARGS__)
+#define LOG_WARNING(...) LOGGER_LOG(Logger::WARNING, __VA_ARGS__)
+#define LOG_INFO(...) LOGGER_LOG(Logger::INFO, __VA_ARGS__)
+#define LOG_TRACE(...) LOGGER_LOG(Logger::TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOGGER_LOG(Logger::DEBUG, __VA_ARGS__)
+
 #endif // LOGGER_HPP
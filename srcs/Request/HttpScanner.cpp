@@ -0,0 +1,125 @@
+#include "HttpScanner.hpp"
+
+#if defined(__x86_64__)
+# include <emmintrin.h>
+# define HS_X86 1
+#endif
+
+/*
+** ---------------------------------- SCALAR ----------------------------------
+*/
+
+static inline bool	isTokenChar(unsigned char c)
+{
+	return ((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '-' || c == '_');
+}
+
+static inline bool	isPrintChar(unsigned char c)
+{
+	return (c >= 0x20 && c < 0x7f);
+}
+
+static size_t	scanTokenScalar(const char *data, size_t size)
+{
+	size_t i = 0;
+	while (i < size && isTokenChar(data[i]))
+		i++;
+	return (i);
+}
+
+static size_t	scanUriScalar(const char *data, size_t size)
+{
+	size_t i = 0;
+	while (i < size && data[i] != ' ' && isPrintChar(data[i]))
+		i++;
+	return (i);
+}
+
+static size_t	scanPrintScalar(const char *data, size_t size)
+{
+	size_t i = 0;
+	while (i < size && isPrintChar(data[i]))
+		i++;
+	return (i);
+}
+
+#ifdef HS_X86
+
+/*
+** ----------------------------------- SSE2 -----------------------------------
+** Bytes are compared as signed: everything >= 0x80 is negative, so it falls
+** below 0x20 and outside every range, which rejects it as expected.
+*/
+
+static inline __m128i	inRange128(__m128i v, char low, char high)
+{
+	return (_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1))));
+}
+
+static inline __m128i	notPrint128(__m128i v)
+{
+	return (_mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(0x20)), _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f))));
+}
+
+static size_t	scanTokenSse2(const char *data, size_t size)
+{
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		__m128i valid = _mm_or_si128(inRange128(v, '0', '9'), inRange128(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'));
+		valid = _mm_or_si128(valid, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+		unsigned int mask = ~_mm_movemask_epi8(valid) & 0xffff;
+		if (mask)
+			return (i + __builtin_ctz(mask));
+	}
+	return (i + scanTokenScalar(data + i, size - i));
+}
+
+static size_t	scanUriSse2(const char *data, size_t size)
+{
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(notPrint128(v), _mm_cmpeq_epi8(v, _mm_set1_epi8(' '))));
+		if (mask)
+			return (i + __builtin_ctz(mask));
+	}
+	return (i + scanUriScalar(data + i, size - i));
+}
+
+static size_t	scanPrintSse2(const char *data, size_t size)
+{
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+		unsigned int mask = _mm_movemask_epi8(notPrint128(v));
+		if (mask)
+			return (i + __builtin_ctz(mask));
+	}
+	return (i + scanPrintScalar(data + i, size - i));
+}
+
+#endif // HS_X86
+
+/*
+** --------------------------------- DISPATCH ---------------------------------
+*/
+
+const HttpScanner::Kernels	&HttpScanner::_getKernels(void)
+{
+	static const Kernels kernels = HttpScanner::_selectKernels();
+	return (kernels);
+}
+
+HttpScanner::Kernels	HttpScanner::_selectKernels(void)
+{
+	Kernels kernels = { "scalar", scanTokenScalar, scanUriScalar, scanPrintScalar };
+#ifdef HS_X86
+	Kernels sse2 = { "sse2", scanTokenSse2, scanUriSse2, scanPrintSse2 };
+	kernels = sse2;
+#endif
+	return (kernels);
+}
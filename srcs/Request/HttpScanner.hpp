@@ -0,0 +1,42 @@
+#ifndef HTTPSCANNER_HPP
+# define HTTPSCANNER_HPP
+
+# include <cstddef>
+
+/*
+** Character class kernels of the request parser.
+** Each one returns the index of the first byte outside its class (size if
+** none), which is either the delimiter the parser waits for or an invalid
+** byte. The SSE2 versions check 16 bytes per step, x86-64 always has them;
+** other CPUs take the scalar loops. 32 byte AVX2 steps lost to SSE2 on
+** header sized inputs (make bench), they are not worth a dispatch.
+*/
+class HttpScanner
+{
+	public:
+		typedef size_t (*t_kernel)(const char *data, size_t size);
+
+		/* Header name: [A-Za-z0-9_-], stops on the ':' */
+		static size_t	scanToken(const char *data, size_t size) { return _getKernels().token(data, size); }
+		/* URI: printable and not a space, stops on the ' ' */
+		static size_t	scanUri(const char *data, size_t size) { return _getKernels().uri(data, size); }
+		/* Field value: printable, stops on the \r or \n */
+		static size_t	scanPrint(const char *data, size_t size) { return _getKernels().print(data, size); }
+
+		static const char	*getKernelName(void) { return _getKernels().name; }
+
+	private:
+		struct Kernels
+		{
+			const char	*name;
+			t_kernel	token;
+			t_kernel	uri;
+			t_kernel	print;
+		};
+		static const Kernels	&_getKernels(void);
+		static Kernels			_selectKernels(void);
+
+		HttpScanner(void);
+};
+
+#endif // HTTPSCANNER_HPP
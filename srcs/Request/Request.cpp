@@ -1,5 +1,8 @@
 #include "Request.hpp"
 #include "Webserv.hpp"
+#include "HttpScanner.hpp"
+
+#include <climits>
 
 std::string	Request::getParseStateStr(e_parse_state state)
 {
@@ -44,7 +47,7 @@ std::string	Request::getParseStateStr(e_parse_state state)
 	}
 }
 
-Request::Request(Client *client) : _client(client), _server(NULL), _location(NULL),  _rawRequest(""), _method(""), _uri(""), _path(""), _httpVersion(""), _isChunked(false), _cgi(this), _contentLength(0),  _chunkSize(-1), _timeout(0), _state(Request::INIT), _stateCode(REQUEST_DEFAULT_STATE_CODE)
+Request::Request(Client *client) : _client(client), _server(NULL), _location(NULL), _cursor(0), _tokenStart(0), _method(""), _uri(""), _path(""), _httpVersion(""), _isChunked(false), _cgi(this), _contentLength(0),  _chunkSize(-1), _timeout(0), _state(Request::INIT), _stateCode(REQUEST_DEFAULT_STATE_CODE), _timings()
 {
 	this->_initServer();
 }
@@ -65,7 +68,9 @@ Request &Request::operator=(const Request &rhs)
 		this->_client = rhs._client;
 		this->_server = rhs._server;
 		this->_location = rhs._location;
-		this->_rawRequest = rhs._rawRequest;
+		this->_cursor = rhs._cursor;
+		this->_tokenStart = rhs._tokenStart;
+		this->_headerKey = rhs._headerKey;
 		this->_method = rhs._method;
 		this->_uri = rhs._uri;
 		this->_path = rhs._path;
@@ -80,6 +85,7 @@ Request &Request::operator=(const Request &rhs)
 		// this->_cgi = rhs._cgi;
 		this->_state = rhs._state;
 		this->_stateCode = rhs._stateCode;
+		this->_timings = rhs._timings;
 	}
 	return *this;
 }
@@ -89,42 +95,86 @@ Request &Request::operator=(const Request &rhs)
 */
 
 /*
-** @brief Parse the raw request
+** @brief Get ready for the next request of the connection
+** the strings and the header vector keep their capacity, the read buffer
+** goes back to the pool until the next bytes arrive, unless it already
+** holds the start of the next request (pipelining): the request ends at
+** _cursor, what follows is moved to the front
+*/
+void	Request::reset(void)
+{
+	this->_location = NULL;
+	if (this->_cursor < this->_rawRequest.size()) // Pipelined: the next request is already there
+		this->_rawRequest.erase(0, this->_cursor);
+	else
+		this->_rawRequest.release();
+	this->_cursor = 0;
+	this->_tokenStart = 0;
+	this->_method.clear();
+	this->_uri.clear();
+	this->_path.clear();
+	this->_query.clear();
+	this->_httpVersion.clear();
+	this->_body.reset();
+	this->_headers.clear();
+	this->_isChunked = false;
+	this->_cgi.reset();
+	this->_contentLength = 0;
+	this->_chunkSize = -1;
+	this->_timeout = 0;
+	this->_state = Request::INIT;
+	this->_stateCode = REQUEST_DEFAULT_STATE_CODE;
+	std::memset(&this->_timings, 0, sizeof(this->_timings));
+	this->_initServer();
+}
+
+/*
+** @brief Parse what has been received in _rawRequest since the last call
+** the request line and the headers must fit in READ_BUFFER_HEADER_MAX
 */
-void	Request::parse(const std::string &rawRequest)
+void	Request::parse(void)
 {
 	if (this->_state == Request::FINISH)
 		return ;
-	if (this->_state == Request::INIT){
-		Logger::log(Logger::TRACE, "%.*s", 25, rawRequest.substr(0, rawRequest.find("\n")).c_str());
-		this->_initTimeout();
-	}
-	
-
-	if (rawRequest.empty())
+	if (this->_rawRequest.empty())
 	{
-		Logger::log(Logger::WARNING, "Empty request");
+		LOG_WARNING("Empty request");
 		return ;
 	}
-	this->_rawRequest += rawRequest;
+	if (this->_state == Request::INIT){
+		// Empty lines before the request line are ignored (RFC 9112 2.2), a pipelining client may send some
+		while (this->_cursor < this->_rawRequest.size() && (this->_rawRequest[this->_cursor] == '\r' || this->_rawRequest[this->_cursor] == '\n'))
+			this->_cursor++;
+		this->_tokenStart = this->_cursor;
+		if (this->_cursor == this->_rawRequest.size())
+			return ;
+		const char *start = this->_rawRequest.data() + this->_cursor;
+		size_t size = this->_rawRequest.size() - this->_cursor;
+		const char *eol = static_cast<const char *>(memchr(start, '\n', size));
+		LOG_TRACE("%.*s", (int)std::min((size_t)25, eol ? eol - start : size), start);
+		this->_initTimeout();
+		this->_timings.start = Clock::now();
+	}
 
-	Logger::log(Logger::DEBUG, "Parsing request: %s", this->_rawRequest.c_str());
+	LOG_DEBUG("Parsing request: %.*s", (int)(this->_rawRequest.size() - this->_cursor), this->_rawRequest.data() + this->_cursor);
 
 	this->_parseRequestLine();
 	this->_parseHeaders();
+	if (this->_state < Request::BODY_INIT && this->_rawRequest.size() >= READ_BUFFER_HEADER_MAX)
+		return (this->setError(431));
 	this->_parseBody();
 }
 
 /*
 ** @brief Parse the request line
-**
-** @param iss : The input stream
-** @param step : The current step
+** every parser scans _rawRequest from _cursor, _tokenStart is the start of
+** the token being read, so bytes already checked are never read twice
+** the delimiters and character classes are checked by HttpScanner
 */
 void	Request::_parseRequestLine(void)
 {
 	if (this->_state > Request::REQUEST_LINE_END)
-		return (Logger::log(Logger::DEBUG, "Request line already parsed"));
+		return (LOG_DEBUG("Request line already parsed"));
 	if (this->_state == Request::INIT)
 		this->_setState(Request::REQUEST_LINE_METHOD);
 
@@ -136,27 +186,16 @@ void	Request::_parseRequestLine(void)
 		this->_parseHttpVersion();
 	if (this->_state == Request::REQUEST_LINE_END)
 	{
-		this->_rawRequest.erase(0, this->_rawRequest.find_first_not_of(" \t"));
-		if (this->_rawRequest.empty())
+		this->_skipBlanks();
+		int eolSize = this->_matchEndOfLine();
+		if (eolSize == 0)
 			return ;
-		if (this->_rawRequest[0] == '\n')
-		{
-			this->_rawRequest.erase(0, 1);
-			return (this->_setState(Request::HEADERS_INIT));
-		}
-		if (this->_rawRequest[0] == '\r')
-		{
-			if (this->_rawRequest.size() < 2)
-				return ;
-			if (this->_rawRequest[1] == '\n')
-			{
-				this->_rawRequest.erase(0, 2);
-				return (this->_setState(Request::HEADERS_INIT));
-			}
+		if (eolSize == -1)
 			return (this->setError(400));
-		}
-		return (this->setError(400));
-	}	
+		this->_cursor += eolSize;
+		this->_tokenStart = this->_cursor;
+		return (this->_setState(Request::HEADERS_INIT));
+	}
 }
 
 /*
@@ -165,31 +204,24 @@ void	Request::_parseRequestLine(void)
 */
 void	Request::_parseMethod(void)
 {
-	size_t	i = 0;
-	size_t	rawSize = this->_rawRequest.size();
-	bool	found = false;
-	while (i < rawSize)
-	{
-		if (this->_rawRequest[i] == ' ')
-		{
-			found = true;
-			break;
-		}
-		if (!std::isalpha(this->_rawRequest[i]))
-			return (this->setError(400));
-		this->_method += this->_rawRequest[i];
-		i++;
-	}
-	this->_rawRequest.erase(0, found ? i + 1 : i);
-	if (found)
-	{
-		if (this->_method.empty())
+	const char	*data = this->_rawRequest.data();
+	size_t		size = this->_rawRequest.size();
+	const char	*space = static_cast<const char *>(memchr(data + this->_cursor, ' ', size - this->_cursor));
+	size_t		end = space ? space - data : size;
+
+	for (; this->_cursor < end; this->_cursor++)
+		if (!std::isalpha(data[this->_cursor]))
 			return (this->setError(400));
-		if (ConfigParser::isMethodSupported(this->_method) == false)
-			return (this->setError(405));
-		Logger::log(Logger::DEBUG, "Method: %s", this->_method.c_str());
-		this->_setState(Request::REQUEST_LINE_URI);
-	}
+	if (!space)
+		return ;
+	this->_method.assign(data + this->_tokenStart, end - this->_tokenStart);
+	this->_tokenStart = ++this->_cursor;
+	if (this->_method.empty())
+		return (this->setError(400));
+	if (ConfigParser::isMethodSupported(this->_method) == false)
+		return (this->setError(405));
+	LOG_DEBUG("Method: %s", this->_method.c_str());
+	this->_setState(Request::REQUEST_LINE_URI);
 }
 
 /*
@@ -198,37 +230,27 @@ void	Request::_parseMethod(void)
 */
 void	Request::_parseUri(void)
 {
-	size_t	i = 0;
-	size_t	rawSize = this->_rawRequest.size();
-	bool	found = false;
-	while (i < rawSize)
+	if (this->_cursor == this->_tokenStart)
 	{
-		if (this->_uri.empty() && (this->_rawRequest[i] == ' ' || this->_rawRequest[i] == '\t'))
-		{
-			i++;
-			continue;
-		}
-		if (this->_rawRequest[i] == ' ')
-		{
-			found = true;
-			break;
-		}
-		if (!std::isprint(this->_rawRequest[i]))
-			return (this->setError(400));
-		this->_uri += this->_rawRequest[i];
-		i++;
-	}
-	this->_rawRequest.erase(0, found ? i + 1 : i);
-	if (found)
-	{
-		if (this->_uri.empty())
-			return (this->setError(400));
-		// this->_uri.erase(std::remove_if(this->_uri.begin(), this->_uri.end(), ::isspace), this->_uri.end());
-		if (this->_processUri() == -1)
-			return ;
-		Logger::log(Logger::DEBUG, "URI: %s", this->_uri.c_str());
-		return (this->_setState(Request::REQUEST_LINE_HTTP_VERSION));
+		this->_skipBlanks();
+		this->_tokenStart = this->_cursor;
 	}
+	const char	*data = this->_rawRequest.data();
+	size_t		size = this->_rawRequest.size();
+
+	this->_cursor += HttpScanner::scanUri(data + this->_cursor, size - this->_cursor);
+	if (this->_cursor == size)
+		return ;
+	if (data[this->_cursor] != ' ')
+		return (this->setError(400));
+	this->_uri.assign(data + this->_tokenStart, this->_cursor - this->_tokenStart);
+	this->_tokenStart = ++this->_cursor;
+	if (this->_uri.empty())
+		return (this->setError(400));
+	if (this->_processUri() == -1)
+		return ;
+	LOG_DEBUG("URI: %s", this->_uri.c_str());
+	return (this->_setState(Request::REQUEST_LINE_HTTP_VERSION));
 }
 
 /*
@@ -237,34 +259,25 @@ void	Request::_parseUri(void)
 */
 void	Request::_parseHttpVersion(void)
 {
-	size_t	i = 0;
-	size_t	rawSize = this->_rawRequest.size();
-	bool	found = false;
-	while (i < rawSize)
+	if (this->_cursor == this->_tokenStart)
 	{
-		if (this->_httpVersion.empty() && (this->_rawRequest[i] == ' ' || this->_rawRequest[i] == '\t'))
-		{
-			i++;
-			continue;
-		}
-		if (this->_rawRequest[i] != 'H' && this->_rawRequest[i] != 'T' && this->_rawRequest[i] != 'P' && this->_rawRequest[i] != '/' && this->_rawRequest[i] != '.' && !std::isdigit(this->_rawRequest[i]))
-		{
-			found = true;
-			break;
-		}
-		this->_httpVersion += this->_rawRequest[i];
-		i++;
-	}
-	this->_rawRequest.erase(0, i);
-	if (found)
-	{
-		if (this->_httpVersion.empty())
-			return (this->setError(400));
-		// this->_httpVersion.erase(std::remove_if(this->_httpVersion.begin(), this->_httpVersion.end(), ::isspace), this->_httpVersion.end());
-		if (ConfigParser::isHttpVersionSupported(this->_httpVersion) == false)
-			return (this->setError(505));
-		this->_setState(Request::REQUEST_LINE_END);
+		this->_skipBlanks();
+		this->_tokenStart = this->_cursor;
 	}
+	const char	*data = this->_rawRequest.data();
+	size_t		size = this->_rawRequest.size();
+
+	while (this->_cursor < size && data[this->_cursor] != '\0' && (std::isdigit(data[this->_cursor]) || strchr("HTP/.", data[this->_cursor]) != NULL))
+		this->_cursor++;
+	if (this->_cursor == size)
+		return ;
+	this->_httpVersion.assign(data + this->_tokenStart, this->_cursor - this->_tokenStart);
+	this->_tokenStart = this->_cursor;
+	if (this->_httpVersion.empty())
+		return (this->setError(400));
+	if (ConfigParser::isHttpVersionSupported(this->_httpVersion) == false)
+		return (this->setError(505));
+	this->_setState(Request::REQUEST_LINE_END);
 }
 
 
@@ -275,202 +288,403 @@ void	Request::_parseHttpVersion(void)
 void	Request::_parseHeaders(void)
 {
 	if (this->_state < Request::HEADERS_INIT)
-		return (Logger::log(Logger::DEBUG, "Request line not parsed yet"));
+		return (LOG_DEBUG("Request line not parsed yet"));
 	if (this->_state > Request::HEADERS_END)
-		return (Logger::log(Logger::DEBUG, "Headers already parsed"));
+		return (LOG_DEBUG("Headers already parsed"));
 
 	if (this->_state == Request::HEADERS_INIT)
 		this->_setState(Request::HEADERS_PARSE_KEY);
-	
-	if (this->_state == Request::HEADERS_PARSE_KEY)
-		this->_parseHeadersKey();
-	if (this->_state == Request::HEADERS_PARSE_VALUE)
-		this->_parseHeadersValue();
-	if (this->_state == Request::HEADERS_PARSE_END)
-	{
-		this->_rawRequest.erase(0, this->_rawRequest.find_first_not_of(" \t"));
-		if (this->_rawRequest.empty())
-			return ;
-		if (this->_rawRequest[0] == '\n')
-		{
-			this->_rawRequest.erase(0, 1);
-			this->_setState(Request::HEADERS_PARSE_KEY);
-			return (this->_parseHeaders());
-		}
-		if (this->_rawRequest[0] == '\r')
+
+	while (this->_state >= Request::HEADERS_PARSE_KEY && this->_state <= Request::HEADERS_PARSE_END)
+	{
+		size_t cursor = this->_cursor;
+		if (this->_state == Request::HEADERS_PARSE_KEY)
+			this->_parseHeadersKey();
+		if (this->_state == Request::HEADERS_PARSE_VALUE)
+			this->_parseHeadersValue();
+		if (this->_state == Request::HEADERS_PARSE_END)
 		{
-			if (this->_rawRequest.size() < 2)
+			this->_skipBlanks();
+			int eolSize = this->_matchEndOfLine();
+			if (eolSize == 0)
 				return ;
-			if (this->_rawRequest[1] == '\n')
-			{
-				this->_rawRequest.erase(0, 2);
-				this->_setState(Request::HEADERS_PARSE_KEY);
-				return (this->_parseHeaders());
-			}
-			return (this->setError(400));
+			if (eolSize == -1)
+				return (this->setError(400));
+			this->_cursor += eolSize;
+			this->_tokenStart = this->_cursor;
+			this->_setState(Request::HEADERS_PARSE_KEY);
 		}
-		return (this->setError(400));
+		if (this->_cursor == cursor) // Waiting for more data
+			return ;
 	}
 }
 
 /*
 ** @brief Parse the headers key
-**
+** the key is only recorded as an offset and a length in _rawRequest
 */
 void	Request::_parseHeadersKey(void)
 {
 	// detect end of headers
-	if (!this->_rawRequest.empty() && (this->_rawRequest[0] == '\r' || this->_rawRequest[0] == '\n'))
+	if (this->_cursor == this->_tokenStart && this->_cursor < this->_rawRequest.size()
+		&& (this->_rawRequest[this->_cursor] == '\r' || this->_rawRequest[this->_cursor] == '\n'))
 	{
-		if (this->_rawRequest[0] == '\n')
-		{
-			this->_rawRequest.erase(0, 1);
-			if (!this->_tmpHeaderKey.empty())
-				return (this->setError(400));
-			return (this->_setState(Request::BODY_INIT));
-		}
-		if (this->_rawRequest.size() < 2)
+		int eolSize = this->_matchEndOfLine();
+		if (eolSize == 0)
 			return ;
-		if (this->_rawRequest[1] == '\n')
-		{
-			this->_rawRequest.erase(0, 2);
-			if (!this->_tmpHeaderKey.empty())
-				return (this->setError(400));
-			return (this->_setState(Request::BODY_INIT));
-		}
-		return (this->setError(400));
-	}
-	size_t	i = 0;
-	size_t	rawSize = this->_rawRequest.size();
-	bool	found = false;
-	while (i < rawSize)
-	{
-		if (this->_rawRequest[i] == ' ' || this->_rawRequest[i] == '\t')
-			return (this->setError(400));
-		if (this->_rawRequest[i] == ':')
-		{
-			found = true;
-			break;
-		}
-		// if (!std::isprint(this->_rawRequest[i]))
-		// 	return (this->setError(400));
-		if (!std::isalnum(this->_rawRequest[i]) && this->_rawRequest[i] != '-' && this->_rawRequest[i] != '_')
-			return (this->setError(400));
-		this->_tmpHeaderKey += this->_rawRequest[i];
-		i++;
-	}
-	this->_rawRequest.erase(0, found ? i + 1 : i);
-	if (found)
-	{
-		if (this->_tmpHeaderKey.empty())
+		if (eolSize == -1)
 			return (this->setError(400));
-		this->_tmpHeaderKey.erase(std::remove_if(this->_tmpHeaderKey.begin(), this->_tmpHeaderKey.end(), ::isspace), this->_tmpHeaderKey.end());
-		Logger::log(Logger::DEBUG, "Header key: %s", this->_tmpHeaderKey.c_str());
-		this->_setState(Request::HEADERS_PARSE_VALUE);
+		this->_cursor += eolSize;
+		this->_tokenStart = this->_cursor;
+		if (this->_cursor > READ_BUFFER_HEADER_MAX)
+			return (this->setError(431));
+		return (this->_setState(Request::BODY_INIT));
 	}
+	const char	*data = this->_rawRequest.data();
+	size_t		size = this->_rawRequest.size();
 
+	this->_cursor += HttpScanner::scanToken(data + this->_cursor, size - this->_cursor);
+	if (this->_cursor == size)
+		return ;
+	if (data[this->_cursor] != ':' || this->_cursor == this->_tokenStart)
+		return (this->setError(400));
+	this->_headerKey.keyOffset = this->_tokenStart;
+	this->_headerKey.keyLength = this->_cursor - this->_tokenStart;
+	this->_tokenStart = ++this->_cursor;
+	LOG_DEBUG("Header key: %.*s", (int)this->_headerKey.keyLength, data + this->_headerKey.keyOffset);
+	this->_setState(Request::HEADERS_PARSE_VALUE);
 }
 
 /*
 ** @brief Parse the headers value
-**
+** the value ends on the first non printable character, usually the \r
 */
 void	Request::_parseHeadersValue(void)
 {
-	size_t	i = 0;
-	size_t	rawSize = this->_rawRequest.size();
-	bool	found = false;
-	while (i < rawSize)
+	if (this->_cursor == this->_tokenStart)
 	{
-		// skip space and tab
-		if (this->_tmpHeaderValue.empty() && (this->_rawRequest[i] == ' ' || this->_rawRequest[i] == '\t'))
-		{
-			i++;
-			continue;
-		}
-		if (!std::isprint(this->_rawRequest[i]))
-		{
-			found = true;
-			break;
-		}
-		this->_tmpHeaderValue += this->_rawRequest[i];
-		i++;
-	}
-	this->_rawRequest.erase(0, i);
-	if (found)
-	{
-		if (this->_tmpHeaderValue.empty())
-			return (this->setError(400));
-		// this->_tmpHeaderValue.erase(std::remove_if(this->_tmpHeaderValue.begin(), this->_tmpHeaderValue.end(), ::isspace), this->_tmpHeaderValue.end());
-		if (this->_headers.find(this->_tmpHeaderKey) != this->_headers.end())
-			return (this->setError(400));
-		Logger::log(Logger::DEBUG, "Header value: %s", this->_tmpHeaderValue.c_str());
-		this->_headers[this->_tmpHeaderKey] = this->_tmpHeaderValue;
-		this->_tmpHeaderKey.clear();
-		this->_tmpHeaderValue.clear();
-		this->_setState(Request::HEADERS_PARSE_END);
+		this->_skipBlanks();
+		this->_tokenStart = this->_cursor;
 	}
+	const char	*data = this->_rawRequest.data();
+	size_t		size = this->_rawRequest.size();
+
+	this->_cursor += HttpScanner::scanPrint(data + this->_cursor, size - this->_cursor);
+	if (this->_cursor == size)
+		return ;
+	if (this->_cursor == this->_tokenStart)
+		return (this->setError(400));
+
+	HeaderView header = this->_headerKey;
+	header.valueOffset = this->_tokenStart;
+	header.valueLength = this->_cursor - this->_tokenStart;
+	if (this->_findHeader(data + header.keyOffset, header.keyLength) != NULL)
+		return (this->setError(400));
+	LOG_DEBUG("Header value: %.*s", (int)header.valueLength, data + header.valueOffset);
+	this->_headers.push_back(header);
+	this->_tokenStart = this->_cursor;
+	this->_setState(Request::HEADERS_PARSE_END);
+}
+
+/*
+** @brief Move the cursor over spaces and tabs
+*/
+void	Request::_skipBlanks(void)
+{
+	size_t size = this->_rawRequest.size();
+	while (this->_cursor < size && (this->_rawRequest[this->_cursor] == ' ' || this->_rawRequest[this->_cursor] == '\t'))
+		this->_cursor++;
+}
+
+/*
+** @brief Check for a line ending at the cursor
+**
+** @return its size (\n or \r\n), 0 if more data is needed, -1 if there is none
+*/
+int	Request::_matchEndOfLine(void) const
+{
+	size_t left = this->_rawRequest.size() - this->_cursor;
+	if (left == 0)
+		return (0);
+	if (this->_rawRequest[this->_cursor] == '\n')
+		return (1);
+	if (this->_rawRequest[this->_cursor] != '\r')
+		return (-1);
+	if (left < 2)
+		return (0);
+	return (this->_rawRequest[this->_cursor + 1] == '\n' ? 2 : -1);
 }
 
 
+/*
+** @brief Parse the body
+** the body starts at _cursor, the bytes before are the request line and
+** the headers, kept for the header views. Only Content-Length bytes are
+** taken, the ones after belong to the next request
+*/
 void	Request::_parseBody(void)
 {
 	if (this->_state < Request::BODY_INIT)
-		return (Logger::log(Logger::DEBUG, "Headers not parsed yet"));
+		return (LOG_DEBUG("Headers not parsed yet"));
 	if (this->_state > Request::BODY_INIT)
-		return (Logger::log(Logger::DEBUG, "Body already parsed"));
+		return (LOG_DEBUG("Body already parsed"));
 
 	if (this->isChunked())
 		return (this->_parseChunkedBody());
 
-	if (this->_body._write(this->_rawRequest) == -1)
+	size_t length = std::min((unsigned long long)(this->_rawRequest.size() - this->_cursor), this->_contentLength - this->_body._size);
+	if (this->_writeBody(this->_rawRequest.data() + this->_cursor, length) == -1)
 		return (this->setError(500));
-	this->_rawRequest.clear();
+	this->_rawRequest.erase(this->_cursor, length);
 	if (this->_body._size > this->_server->getClientMaxBodySize()) // Check the client max body size
 		return (this->setError(413));
 	if (this->_body._size == this->_contentLength)
-		return (this->_setState(Request::BODY_END));
+		return (this->_bodyReceived());
 }
 
 /*
 ** @brief Parse the chunked body
+** the data of a chunk is written as it arrives, so a chunk can be bigger
+** than the read buffer; _chunkSize is what is left of the current chunk,
+** -1 while waiting for a size line, REQUEST_CHUNK_CRLF for the \r\n
+** closing the data and REQUEST_CHUNK_TRAILER after the last chunk. The
+** bytes are read in place from _cursor and the parsed ones are removed
+** from the buffer once, at the end
 */
 void Request::_parseChunkedBody(void)
 {
-	while (!this->_rawRequest.empty())
+	size_t	pos = this->_cursor;
+	size_t	size = this->_rawRequest.size();
+
+	while (pos < size && this->_state == Request::BODY_INIT)
 	{
 		if (this->_chunkSize == -1)
 		{
-			size_t pos = this->_rawRequest.find("\r\n");
-			if (pos == std::string::npos)
-				return ; // Waiting for more data
-			std::string line = this->_rawRequest.substr(0, pos);
-			std::istringstream iss(line);
-			if (!(iss >> std::hex >> this->_chunkSize))
-			{
-				this->setError(400);
-				return (Logger::log(Logger::ERROR, "[_parseChunkedBody] Error parsing chunk size"));
-			}
-			this->_rawRequest.erase(0, pos + 2);
+			if (this->_parseChunkSize(pos) == -1)
+				break ; // Waiting for more data, or 400
 			if (this->_chunkSize == 0)
-				return (this->_setState(Request::BODY_END));
-			Logger::log(Logger::DEBUG, "[_parseChunkedBody] Chunk size: %d", this->_chunkSize);
+				this->_chunkSize = REQUEST_CHUNK_TRAILER;
+			else
+				LOG_DEBUG("[_parseChunkedBody] Chunk size: %d", this->_chunkSize);
 		}
-		size_t pos = this->_rawRequest.find("\r\n");
-		if (pos == std::string::npos)
-			return ; // Waiting for more data
-		if (pos != (size_t)this->_chunkSize)
+		if (this->_chunkSize == REQUEST_CHUNK_TRAILER)
+		{
+			if (this->_parseTrailer(pos) == 0)
+				this->_bodyReceived();
+			break ;
+		}
+		if (this->_chunkSize > 0)
+		{
+			size_t length = std::min((size_t)this->_chunkSize, size - pos);
+			if (this->_writeBody(this->_rawRequest.data() + pos, length) == -1)
+				return (this->setError(500));
+			pos += length;
+			this->_chunkSize -= length;
+			if (this->_body._size > (u_int64_t)this->_server->getClientMaxBodySize()) // Check the client max body size
+				return (this->setError(413));
+			if (this->_chunkSize > 0)
+				break ; // Waiting for more data
+			this->_chunkSize = REQUEST_CHUNK_CRLF;
+		}
+		if (size - pos < 2)
+			break ; // Waiting for more data
+		if (this->_rawRequest[pos] != '\r' || this->_rawRequest[pos + 1] != '\n')
 		{
 			this->setError(400);
-			return (Logger::log(Logger::ERROR, "[_parseChunkedBody] Chunk size does not match"));
+			return (LOG_ERROR("[_parseChunkedBody] Chunk size does not match"));
 		}
-		if (this->_body._write(this->_rawRequest.substr(0, this->_chunkSize)) == -1)
-			return (this->setError(500));
-		this->_rawRequest.erase(0, this->_chunkSize + 2);
+		pos += 2;
 		this->_chunkSize = -1;
-		if (this->_body._size > (u_int64_t)this->_server->getClientMaxBodySize()) // Check the client max body size
-			return (this->setError(413));
 	}
+	this->_rawRequest.erase(this->_cursor, pos - this->_cursor);
+}
+
+/*
+** @brief Parse a chunk size line at pos, its extensions are ignored
+**
+** @return 0 with pos after the line, -1 if the line is incomplete or invalid
+*/
+int	Request::_parseChunkSize(size_t &pos)
+{
+	const char	*data = this->_rawRequest.data();
+	const char	*eol = static_cast<const char *>(memchr(data + pos, '\n', this->_rawRequest.size() - pos));
+	long		chunkSize = 0;
+	size_t		digits = 0;
+
+	if (eol == NULL)
+		return (-1);
+	for (const char *c = data + pos; c < eol && isxdigit(*c); c++, digits++)
+	{
+		chunkSize = chunkSize * 16 + (isdigit(*c) ? *c - '0' : (tolower(*c) - 'a' + 10));
+		if (chunkSize > INT_MAX)
+			break ;
+	}
+	if (digits == 0 || chunkSize > INT_MAX || eol == data + pos || eol[-1] != '\r')
+	{
+		this->setError(400);
+		LOG_ERROR("[_parseChunkedBody] Error parsing chunk size");
+		return (-1);
+	}
+	this->_chunkSize = chunkSize;
+	pos = eol + 1 - data;
+	return (0);
+}
+
+/*
+** @brief Skip the trailer fields after the last chunk, up to the empty line
+** which ends the request
+**
+** @return 0 with pos after the empty line, -1 if more data is needed
+*/
+int	Request::_parseTrailer(size_t &pos)
+{
+	const char	*data = this->_rawRequest.data();
+	const char	*eol;
+
+	while ((eol = static_cast<const char *>(memchr(data + pos, '\n', this->_rawRequest.size() - pos))) != NULL)
+	{
+		bool empty = (eol == data + pos || (eol == data + pos + 1 && data[pos] == '\r'));
+		pos = eol + 1 - data;
+		if (empty)
+			return (0);
+	}
+	return (-1);
+}
+
+/*
+** @brief Write body bytes to their destination: the file, or the CGI
+** already running when the body is streamed to it
+*/
+int	Request::_writeBody(const char *data, size_t size)
+{
+	if (this->_cgi._cgiHandler != NULL)
+	{
+		this->_body._size += size;
+		return (this->_cgi._cgiHandler->_feed(data, size));
+	}
+	if (this->_body._write(this->_client, data, size) == -1)
+		return (-1);
+	if (this->_body.isFull()) // The disk lags behind, resumed by handleDiskIo
+		this->_client->watch(EPOLLRDHUP | EPOLLERR);
+	return (0);
+}
+
+/*
+** @brief The whole body is received, the request goes on once its last
+** bytes are written
+*/
+void	Request::_bodyReceived(void)
+{
+	if (this->_body.isWriting())
+		return (this->_setState(Request::BODY_PROCESS));
+	this->_setState(Request::BODY_END);
+}
+
+/*
+** @brief A write of the body is done: the client is read again once the
+** disk caught up, the request goes on once everything is written
+*/
+void	Request::handleDiskIo(DiskIo::Op &op)
+{
+	if (this->_body._written(this->_client, op) == -1)
+		return (this->setError(500));
+	if (this->_state == Request::BODY_PROCESS && !this->_body.isWriting())
+		return (this->_setState(Request::BODY_END));
+	if (this->_state == Request::BODY_INIT && !this->_body.isFull())
+		this->_client->watch(REQUEST_FLAGS);
+}
+
+/*
+** @brief The rest of a Content-Length body can go from the socket to its
+** file without being read: the buffered bytes are written and nothing
+** is streamed to a CGI
+*/
+bool	Request::canSpliceBody(void)
+{
+	return (this->_state == Request::BODY_INIT && !this->_isChunked && this->_cgi._cgiHandler == NULL
+		&& this->_rawRequest.size() == this->_cursor && this->_body._size < this->_contentLength
+		&& this->_body.canSplice());
+}
+
+/*
+** @brief Splice the body from the socket to its file, only what is left of
+** Content-Length: the next request of the connection stays on the socket.
+** The client is not read while the pipe goes to the file
+**
+** @return the bytes received, 0 if the client closed, -1 on a socket error
+*/
+ssize_t	Request::spliceBody(int fd)
+{
+	ssize_t bytesMoved = this->_body._splice(this->_client, fd, this->_contentLength - this->_body._size);
+	if (bytesMoved <= 0)
+		return (bytesMoved);
+	if (this->_body._size == this->_contentLength)
+		this->_bodyReceived();
+	else
+		this->_client->watch(EPOLLRDHUP | EPOLLERR);
+	return (bytesMoved);
+}
+
+/*
+** --------------------------------- HEADERS ----------------------------------
+*/
+
+/*
+** @brief Find a header, the key is compared without case
+**
+** @return the view of the header, NULL if absent
+*/
+const Request::HeaderView*	Request::_findHeader(const char *key, size_t keyLength) const
+{
+	const char *data = this->_rawRequest.data();
+	for (std::vector<HeaderView>::const_iterator it = this->_headers.begin(); it != this->_headers.end(); ++it)
+		if (it->keyLength == keyLength && strncasecmp(data + it->keyOffset, key, keyLength) == 0)
+			return (&(*it));
+	return (NULL);
+}
+
+/*
+** @brief Check if the connection can stay open after the response:
+** the default of HTTP/1.1 unless "Connection: close", opt-in in HTTP/1.0
+*/
+bool	Request::isKeepAlive(void) const
+{
+	const HeaderView *header = this->_findHeader("Connection", 10);
+	if (header == NULL)
+		return (this->_httpVersion == "HTTP/1.1");
+	if (header->valueLength == 5 && strncasecmp(this->_rawRequest.data() + header->valueOffset, "close", 5) == 0)
+		return (false);
+	if (header->valueLength == 10 && strncasecmp(this->_rawRequest.data() + header->valueOffset, "keep-alive", 10) == 0)
+		return (true);
+	return (this->_httpVersion == "HTTP/1.1");
+}
+
+bool	Request::hasHeader(const char *key) const
+{
+	return (this->_findHeader(key, strlen(key)) != NULL);
+}
+
+/*
+** @brief Copy the value of a header
+**
+** @return the value, empty if absent
+*/
+std::string	Request::getHeader(const char *key) const
+{
+	const HeaderView *header = this->_findHeader(key, strlen(key));
+	if (header == NULL)
+		return ("");
+	return (this->_rawRequest.substr(header->valueOffset, header->valueLength));
+}
+
+/*
+** @brief Compare the value of a header without copying it
+*/
+bool	Request::isHeaderEqual(const char *key, const char *value) const
+{
+	const HeaderView *header = this->_findHeader(key, strlen(key));
+	return (header != NULL && header->valueLength == strlen(value)
+		&& memcmp(this->_rawRequest.data() + header->valueOffset, value, header->valueLength) == 0);
 }
 
 /*
@@ -481,12 +695,18 @@ void Request::_parseChunkedBody(void)
 void	Request::_setState(e_parse_state state)	
 {
 	if (this->_state == Request::FINISH)
-		return (Logger::log(Logger::DEBUG, "[_setState] Request already finished"));
+		return (LOG_DEBUG("[_setState] Request already finished"));
 	if (this->_state == state)
-		return (Logger::log(Logger::DEBUG, "[_setState] Request already in this state"));
+		return (LOG_DEBUG("[_setState] Request already in this state"));
 
-	Logger::log(Logger::DEBUG, "[_setState] Request state changed from %s to %s with state code: %d", this->getParseStateStr(this->_state).c_str(), this->getParseStateStr(state).c_str(), this->_stateCode);
+	LOG_DEBUG("[_setState] Request state changed from %s to %s with state code: %d", this->getParseStateStr(this->_state).c_str(), this->getParseStateStr(state).c_str(), this->_stateCode);
 	this->_state = state;
+	if (this->_state == Request::BODY_INIT)
+		this->_timings.headers = Clock::now();
+	else if ((this->_state == Request::BODY_END || this->_state >= Request::CGI_INIT) && this->_timings.headers != 0 && this->_timings.body == 0)
+		this->_timings.body = Clock::now();
+	if (this->_state == Request::FINISH)
+		this->_timings.finish = Clock::now();
 
 	if (this->_state == Request::BODY_INIT)
 	{
@@ -496,8 +716,12 @@ void	Request::_setState(e_parse_state state)
 		if (this->_method != "POST" && this->_method != "PUT")
 			return(this->_cgi._isCGI ? this->_setState(Request::CGI_INIT) : this->_setState(Request::FINISH));
 		this->setTimeout(REQUEST_DEFAULT_BODY_TIMEOUT);
+		if (this->_cgi._isCGI && this->_cgi._pool == NULL && !this->_isChunked) // Streamed, CONTENT_LENGTH is known
+			return (this->_cgi._start());
 		this->_defineBodyDestination();
 	}
+	else if (this->_state == Request::BODY_PROCESS)
+		this->_client->watch(EPOLLRDHUP | EPOLLERR); // Nothing more to read until the file is written
 	else if (this->_state == Request::BODY_END)
 	{
 		if (this->_cgi._isCGI)
@@ -507,14 +731,21 @@ void	Request::_setState(e_parse_state state)
 	}
 	else if (this->_state == Request::CGI_INIT)
 	{
-		modifySocketEpoll(g_server->getEpollFD(), this->_client->getFd(), RESPONSE_FLAGS);
+		this->_client->watch(REQUEST_FLAGS); // EPOLLOUT once the CGI wrote something
 		this->setTimeout(REQUEST_DEFAULT_CGI_TIMEOUT);
-		this->_cgi._start();
+		if (this->_cgi._cgiHandler == NULL)
+			this->_cgi._start();
+		if (this->_state != Request::CGI_INIT)
+			return ;
+		this->_cgi._cgiHandler->_endInput();
+		this->_setState(Request::CGI_PROCESS);
+		if (this->_client->getResponse()->getResponseSize() != 0) // Written while the body was received
+			this->_client->watch(RESPONSE_FLAGS);
 	}
 	else if (this->_state == Request::FINISH)
 	{
 		this->_timeout = 0;
-		modifySocketEpoll(g_server->getEpollFD(), this->_client->getFd(), RESPONSE_FLAGS);
+		this->_client->watch(RESPONSE_FLAGS);
 	}
 }
 
@@ -573,24 +804,24 @@ int	Request::_findServer(void)
 {
 	if (this->_client == NULL)
 	{
-		Logger::log(Logger::ERROR, "[_findServer] Client is NULL");
+		LOG_ERROR("[_findServer] Client is NULL");
 		this->setError(500);
 		return (-1);
 	}
-	std::string host = this->_headers["Host"]; // Find the host in the headers
+	std::string host = this->getHeader("Host"); // Find the host in the headers
 	if (host.empty()) // If the host is empty, set the error code to 400
 	{
-		Logger::log(Logger::ERROR, "[_findServer] Host not found in headers");
+		LOG_ERROR("[_findServer] Host not found in headers");
 		this->setError(400);
 		return (-1);
 	}
 	
-	Logger::log(Logger::DEBUG, "[_findServer] Host: %s", host.c_str());
+	LOG_DEBUG("[_findServer] Host: %s", host.c_str());
 	
 	Socket* socket = this->_client->getSocket();
 	if (socket == NULL)
 	{
-		Logger::log(Logger::ERROR, "[_findServer] Socket is NULL");
+		LOG_ERROR("[_findServer] Socket is NULL");
 		this->setError(500);
 		return (-1);
 	}
@@ -620,7 +851,7 @@ int	Request::_findLocation(void)
 {
 	if (this->_server == NULL)
 	{
-		Logger::log(Logger::ERROR, "[_findLocation] Server is NULL");
+		LOG_ERROR("[_findLocation] Server is NULL");
 		this->setError(500);
 		return (-1);
 	}
@@ -656,13 +887,13 @@ int	Request::_findLocation(void)
 */
 int	Request::_checkTransferEncoding(void)
 {
-	if (this->_headers.find("Transfer-Encoding") != this->_headers.end())
+	if (this->hasHeader("Transfer-Encoding"))
 	{
-		if (this->_headers["Transfer-Encoding"] == "chunked")
+		if (this->isHeaderEqual("Transfer-Encoding", "chunked"))
 			this->_isChunked = true;
-		else if (this->_headers["Transfer-Encoding"] != "identity")
+		else if (!this->isHeaderEqual("Transfer-Encoding", "identity"))
 		{
-			Logger::log(Logger::ERROR, "[_checkTransferEncoding] Transfer-Encoding not supported: %s", this->_headers["Transfer-Encoding"].c_str());
+			LOG_ERROR("[_checkTransferEncoding] Transfer-Encoding not supported: %s", this->getHeader("Transfer-Encoding").c_str());
 			this->setError(501);
 			return (-1);
 		}
@@ -677,14 +908,14 @@ int	Request::_checkTransferEncoding(void)
 */
 int	Request::_checkClientMaxBodySize(void)
 {
-	if (this->_headers.find("Content-Length") != this->_headers.end())
+	if (this->hasHeader("Content-Length"))
 	{
-		std::istringstream iss(this->_headers["Content-Length"]);
+		std::istringstream iss(this->getHeader("Content-Length"));
 		iss >> this->_contentLength;
 	}
 	if (this->_contentLength > this->_server->getClientMaxBodySize())
 	{
-		Logger::log(Logger::ERROR, "[_checkClientMaxBodySize] Content-Length too big, max body size: %d, content length: %d", this->_server->getClientMaxBodySize(), this->_contentLength);
+		LOG_ERROR("[_checkClientMaxBodySize] Content-Length too big, max body size: %d, content length: %d", this->_server->getClientMaxBodySize(), this->_contentLength);
 		this->setError(413);
 		return -1;
 	}
@@ -702,7 +933,7 @@ int	Request::_checkMethod(void)
 		return (0);
 	if (this->_location->isMethodAllowed(BlocLocation::converStrToMethod(this->_method)))
 		return (0);
-	Logger::log(Logger::ERROR, "[_checkMethod] Method not allowed: %s", this->_method.c_str());
+	LOG_ERROR("[_checkMethod] Method not allowed: %s", this->_method.c_str());
 	this->setError(405);
 	return (-1);
 }
@@ -736,6 +967,14 @@ int	Request::_checkCgi(void)
 		return (0);
 	std::vector<std::string> allPathsLocations = this->_getAllPathsLocation();
 	for (size_t i = 0; i < allPathsLocations.size(); i++){
+		// A FastCGI pool takes precedence over a spawn for the same extension
+		for (std::map<std::string, std::string>::const_iterator it = this->_location->getFastCgi().begin(); it != this->_location->getFastCgi().end(); ++it)
+			if (getExtension(allPathsLocations[i]) == it->first && fileExist(allPathsLocations[i]))
+			{
+				this->_cgi._pool = g_server->getFastCgiPool(it->second);
+				if (this->_cgi._pool)
+					return (this->setCgi(true, allPathsLocations[i], ""), 0);
+			}
 		for (std::map<std::string, std::string>::const_iterator it = this->_location->getCGI().begin(); it != this->_location->getCGI().end(); ++it)
 			if (getExtension(allPathsLocations[i]) == it->first)
 				if (fileExist(allPathsLocations[i]))
@@ -756,7 +995,7 @@ void	Request::_defineBodyDestination(void)
 	if (!this->_cgi._isCGI && (this->_method == "POST" || this->_method == "PUT"))
 	{
 
-		if (this->_headers.find("Content-Type") != this->_headers.end() && this->_headers["Content-Type"] == "multipart/form-data")
+		if (this->isHeaderEqual("Content-Type", "multipart/form-data"))
 			return (this->setError(415));
 		bool isPathDir = this->_path.size() > 1 && this->_path[this->_path.size() - 1] == '/';
 		{
@@ -773,9 +1012,9 @@ void	Request::_defineBodyDestination(void)
 			else
 			{
 				this->_body._path += this->_path;
-				if (this->_headers.find("Filename") != this->_headers.end())
+				if (this->hasHeader("Filename"))
 				{
-					this->_body._path += "/" + this->_headers["Filename"];
+					this->_body._path += "/" + this->getHeader("Filename");
 					if (this->_method == "POST" && fileExist(this->_body._path))
 						this->setError(403);
 					this->_body._fd = open(this->_body._path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
@@ -810,8 +1049,17 @@ void	Request::_defineBodyDestination(void)
 */
 void	Request::_initTimeout(void)
 {
-	time_t currentTime = time(NULL);
-	this->_timeout = currentTime + REQUEST_DEFAULT_HEADER_TIMEOUT;
+	this->setTimeout(REQUEST_DEFAULT_HEADER_TIMEOUT);
+}
+
+/*
+** @brief Give the current step timeout seconds, from now
+*/
+void	Request::setTimeout(int timeout)
+{
+	this->_timeout = Clock::now() + (uint64_t)timeout * 1000;
+	if (this->_client)
+		this->_client->armTimer();
 }
 
 /*
@@ -823,18 +1071,13 @@ void	Request::checkTimeout(void)
 {
 	if (this->_timeout == 0 || this->_state == Request::FINISH)
 		return ;
-	time_t currentTime = time(NULL);
-	if (currentTime > this->_timeout)
+	if (Clock::now() >= this->_timeout)
 	{
-		Logger::log(Logger::ERROR, "[checkTimeout] Client %d timeout", this->_client->getFd());
-		// if its during cgi kill the process
-		if (this->_state >= Request::CGI_INIT)
-		{
+		LOG_ERROR("[checkTimeout] Client %d timeout", this->_client->getFd());
+		// if its during cgi kill the process, it may run since the start of the body
+		if (this->_cgi._cgiHandler != NULL)
 			this->_cgi._kill();
-			this->setError(504);
-		}
-		else
-			this->setError(408);
+		this->setError(this->_state >= Request::CGI_INIT ? 504 : 408);
 	}
 }
 
@@ -849,21 +1092,21 @@ void	Request::_initServer(void)
 {
 	if (this->_client == NULL)
 	{
-		Logger::log(Logger::ERROR, "[_initServer] Client is NULL");
+		LOG_ERROR("[_initServer] Client is NULL");
 		this->setError(500);
 		return ;
 	}
 	Socket* socket = this->_client->getSocket();
 	if (socket == NULL)
 	{
-		Logger::log(Logger::ERROR, "[_initServer] Socket is NULL");
+		LOG_ERROR("[_initServer] Socket is NULL");
 		this->setError(500);
 		return ;
 	}
 	std::vector<BlocServer>* servers = socket->getServers();
 	if (servers->empty())
 	{
-		Logger::log(Logger::ERROR, "[_initServer] No server found");
+		LOG_ERROR("[_initServer] No server found");
 		this->setError(500);
 		return ;
 	}
@@ -12,12 +12,15 @@
 # include "ConfigParser.hpp"
 # include "RequestCgi.hpp"
 # include "RequestBody.hpp"
+# include "ReadBuffer.hpp"
 
 # define REQUEST_DEFAULT_STATE_CODE 200
 # define REQUEST_DEFAULT_UPLOAD_PATH "./www/upload/"
 # define REQUEST_DEFAULT_HEADER_TIMEOUT 10
 # define REQUEST_DEFAULT_BODY_TIMEOUT 3600
 # define REQUEST_DEFAULT_CGI_TIMEOUT 3
+# define REQUEST_CHUNK_CRLF -2 // _chunkSize once the data of a chunk is read
+# define REQUEST_CHUNK_TRAILER -3 // _chunkSize after the last chunk, until the empty line
 # define REQUEST_DEFAULT_UPLOAD_PATH "./www/upload/"
 
 class Client;
@@ -53,11 +56,32 @@ class Request
 			FINISH
 		};
 		static std::string	getParseStateStr(e_parse_state state);
+
+		/* A header as offsets in _rawRequest, nothing is copied while parsing */
+		struct HeaderView
+		{
+			size_t	keyOffset;
+			size_t	keyLength;
+			size_t	valueOffset;
+			size_t	valueLength;
+		};
+
+		/* Clock::now() of each phase, 0 until it is reached (access log) */
+		struct Timings
+		{
+			uint64_t	start; // First byte of the request line
+			uint64_t	headers; // Headers parsed
+			uint64_t	body; // Body received, or none expected
+			uint64_t	cgiStart;
+			uint64_t	finish; // Nothing more to produce, the CGI done
+		};
 	private:
 		Client*								_client;
 		BlocServer*							_server;
 		BlocLocation*						_location;
-		std::string 						_rawRequest;
+		ReadBuffer							_rawRequest; // Leased while the request is received
+		size_t								_cursor; // First byte not parsed yet
+		size_t								_tokenStart;
 		std::string 						_method;
 		std::string 						_uri;
 		std::string 						_path;
@@ -66,16 +90,16 @@ class Request
 		RequestBody							_body;
 		// std::string							_body;
 		// u_int64_t							_bodySize;
-		std::map<std::string, std::string>	_headers;
-		std::string							_tmpHeaderKey;
-		std::string							_tmpHeaderValue;
+		std::vector<HeaderView>				_headers;
+		HeaderView							_headerKey; // Key of the header being parsed
 		bool								_isChunked;
 		RequestCgi							_cgi;
 		unsigned long long					_contentLength;
 		int									_chunkSize;
-		time_t								_timeout;
+		uint64_t							_timeout; // ms, Clock::now() base, 0 if none
 		e_parse_state						_state;
 		int									_stateCode;
+		Timings								_timings;
 
 		/* PARSERS */
 		// Request line
@@ -87,9 +111,13 @@ class Request
 		void	_parseHeaders(void);
 		void	_parseHeadersKey(void);
 		void	_parseHeadersValue(void);
+		void	_skipBlanks(void);
+		int		_matchEndOfLine(void) const;
 		// Body
 		void	_parseBody(void);
 		void	_parseChunkedBody(void);
+		int		_parseChunkSize(size_t &pos);
+		int		_parseTrailer(size_t &pos);
 
 		void	_setState(e_parse_state state);
 		void	_setHeaderState(void);
@@ -98,6 +126,7 @@ class Request
 		int		_processUri(void);
 
 		/* FINDERS */
+		const HeaderView*	_findHeader(const char *key, size_t keyLength) const;
 		int		_findServer(void);
 		int		_findLocation(void);
 
@@ -110,6 +139,8 @@ class Request
 
 		/* BODY */
 		void	_defineBodyDestination(void);
+		int		_writeBody(const char *data, size_t size);
+		void	_bodyReceived(void);
 
 		/* TIMEOUT */
 		void	_initTimeout(void);
@@ -126,13 +157,17 @@ class Request
 
 		Request &operator=(const Request &rhs);
 
-		void	parse(const std::string &rawRequest);
+		void	parse(void);
+		void	reset(void);
+		bool	canSpliceBody(void);
+		ssize_t	spliceBody(int fd);
+		void	handleDiskIo(DiskIo::Op &op);
 
 		/* GETTERS */
 		Client*			getClient(void) const { return _client; }
 		BlocServer*		getServer(void) const { return _server; }
 		BlocLocation*	getLocation(void) const { return _location; }
-		std::string		getRawRequest(void) const { return _rawRequest; }
+		ReadBuffer&		getRawRequest(void) { return _rawRequest; }
 		std::string 	getMethod(void) const { return _method; }
 		std::string 	getUri(void) const { return _uri; }
 		std::string 	getPath(void) const { return _path; }
@@ -144,17 +179,21 @@ class Request
 		bool			isCgi(void) const { return _cgi._isCGI; }
 		// size_t 			getBodySize(void) const { return _bodySize; }
 		int 			getStateCode(void) const { return _stateCode; }
-		std::map<std::string, std::string> getHeaders(void) const { return _headers; }
+		bool			hasHeader(const char *key) const;
+		std::string		getHeader(const char *key) const;
+		bool			isHeaderEqual(const char *key, const char *value) const;
+		bool			isKeepAlive(void) const;
 		bool 			isChunked(void) const { return _isChunked; }
 		e_parse_state	getState(void) const { return _state; }
+		bool			canRespond(void) const { return _state == FINISH || _state == CGI_PROCESS; }
 		unsigned long long			getContentLength(void) const { return _contentLength; }
 		int 			getChunkSize(void) const { return _chunkSize; }
-		time_t			getTimeout(void) const { return _timeout; }
+		uint64_t		getTimeout(void) const { return _timeout; }
+		const Timings&	getTimings(void) const { return _timings; }
 		/* SETTERS */
 		void			setError(int code);
 		void 			setStateCode(int code) { _stateCode = code; }
-		void			setTimeout(time_t timeout) { _timeout = timeout; }
-		void			setTimeout(int timeout) { _timeout = time(NULL) + timeout; }
+		void			setTimeout(int timeout);
 		void			setCgi(bool isCgi, const std::string &path, const std::string &execPath) { _cgi._isCGI = isCgi; _cgi._path = path; _cgi._execPath = execPath; }
 
 		/* TIMEOUT */
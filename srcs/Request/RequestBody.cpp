@@ -1,24 +1,31 @@
 #include "RequestBody.hpp"
 
-RequestBody::RequestBody(void) : _fd(-1), _isTmp(false), _size(0)
+#include "Webserv.hpp"
+
+#include <fcntl.h>
+
+RequestBody::RequestBody(void) : _fd(-1), _isTmp(false), _size(0), _spliceFile(true), _pipeSize(0), _op(NULL), _offset(0)
 {
+	this->_pipe[0] = -1;
+	this->_pipe[1] = -1;
 }
 
-RequestBody::RequestBody(bool isTmp) : _fd(-1), _isTmp(isTmp), _size(0)
+RequestBody::RequestBody(bool isTmp) : _fd(-1), _isTmp(isTmp), _size(0), _spliceFile(true), _pipeSize(0), _op(NULL), _offset(0)
 {
+	this->_pipe[0] = -1;
+	this->_pipe[1] = -1;
 }
 
-RequestBody::RequestBody(const RequestBody &src)
+RequestBody::RequestBody(const RequestBody &src) : _pipeSize(0), _op(NULL)
 {
+	this->_pipe[0] = -1;
+	this->_pipe[1] = -1;
 	*this = src;
 }
 
 RequestBody::~RequestBody(void)
 {
-	if (this->_fd != -1)
-		protectedCall(close(this->_fd), "failed to close file", false);
-	if (this->_path.size() && this->_isTmp)
-		remove(this->_path.c_str());
+	this->reset();
 }
 
 RequestBody &RequestBody::operator=(const RequestBody &rhs)
@@ -30,6 +37,8 @@ RequestBody &RequestBody::operator=(const RequestBody &rhs)
 		// this->_stream = rhs._stream;
 		this->_isTmp = rhs._isTmp;
 		this->_size = rhs._size;
+		this->_spliceFile = rhs._spliceFile;
+		this->_offset = rhs._offset;
 	}
 	return *this;
 }
@@ -39,22 +48,145 @@ RequestBody &RequestBody::operator=(const RequestBody &rhs)
 */
 
 /*
-** @brief Write data in the file
-**
-** @param data : The data to write
+** @brief Close the file, remove it if temporary, and get ready for the next
+** request, _path keeps its capacity. A write in flight is detached: the
+** engine closes the file (and the pipe it reads) once the kernel is done
+*/
+void	RequestBody::reset(void)
+{
+	bool	fdDetached = false;
+	bool	pipeDetached = false;
+
+	if (this->_op != NULL)
+	{
+		fdDetached = true;
+		pipeDetached = (this->_op->pipeFd != -1);
+		g_server->getDiskIo().detach(this->_op, true);
+		this->_op = NULL;
+	}
+	if (this->_fd != -1 && !fdDetached)
+		protectedCall(close(this->_fd), "failed to close file", false);
+	if (pipeDetached)
+		this->_pipe[0] = -1;
+	this->_closePipe();
+	if (this->_path.size() && this->_isTmp)
+		remove(this->_path.c_str());
+	this->_path.clear();
+	this->_fd = -1;
+	this->_isTmp = false;
+	this->_size = 0;
+	this->_spliceFile = true;
+	this->_offset = 0;
+	std::string().swap(this->_pending);
+}
+
+/*
+** @brief Queue size bytes of data for the file, written as soon as the
+** previous write is done
 */
-int	RequestBody::_write(const std::string &data)
+int	RequestBody::_write(Client *client, const char *data, size_t size)
 {
 	if (this->_fd == -1)
 	{
-		Logger::log(Logger::ERROR, "[_write] File descriptor not set");
+		LOG_ERROR("[_write] File descriptor not set");
 		return (-1);
 	}
-	if (write(this->_fd, data.c_str(), data.size()) == -1)
+	this->_pending.append(data, size);
+	this->_size += size;
+	this->_flush(client);
+	return (0);
+}
+
+/*
+** @brief Hand the pending bytes to the engine, unless a write is in flight
+*/
+void	RequestBody::_flush(Client *client)
+{
+	if (this->_op != NULL || this->_pending.empty())
+		return ;
+	this->_op = g_server->getDiskIo().write(client, DiskIo::BODY, this->_fd, this->_pending, this->_offset);
+}
+
+/*
+** @brief A write or a splice is done, the next pending bytes follow. A file
+** system without splice writes gets what is left in the pipe from memory,
+** and the rest of the body through _write
+**
+** @return 0, -1 if the file could not be written
+*/
+int	RequestBody::_written(Client *client, DiskIo::Op &op)
+{
+	this->_op = NULL;
+	this->_offset += op.done;
+	if (op.type == DiskIo::SPLICE && op.result == -EINVAL)
 	{
-		Logger::log(Logger::ERROR, "[_write] Error writing in file");
+		LOG_DEBUG("[_written] No splice writes on %s, body written from memory", this->_path.c_str());
+		this->_spliceFile = false;
+		std::string left(op.size - op.done, '\0');
+		for (size_t done = 0; done < left.size(); )
+		{
+			ssize_t bytesRead = read(this->_pipe[0], &left[done], left.size() - done);
+			if (bytesRead <= 0)
+				return (LOG_ERROR("[_written] Error reading the splice pipe"), -1);
+			done += bytesRead;
+		}
+		this->_pending.insert(0, left);
+	}
+	else if (op.result < 0 || op.done < op.size)
+	{
+		LOG_ERROR("[_written] Error writing in file: %s", op.result < 0 ? strerror(-op.result) : "short write");
 		return (-1);
 	}
-	this->_size += data.size();
+	this->_flush(client);
 	return (0);
 }
+
+/*
+** @brief The body goes to a file which takes splice writes, nothing is
+** waiting for the disk, and the pipe is open
+*/
+bool	RequestBody::canSplice(void)
+{
+	return (this->_fd != -1 && this->_spliceFile && !this->isWriting() && (this->_pipe[0] != -1 || this->_openPipe() == 0));
+}
+
+/*
+** @brief Move up to count body bytes from the socket to the pipe, the
+** engine then moves them to the file
+**
+** @return the bytes received, 0 if the client closed, -1 on a socket error
+*/
+ssize_t	RequestBody::_splice(Client *client, int fd, size_t count)
+{
+	ssize_t received = splice(fd, NULL, this->_pipe[1], NULL, std::min(count, this->_pipeSize), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (received <= 0)
+		return (received);
+	this->_op = g_server->getDiskIo().splice(client, DiskIo::BODY, this->_pipe[0], this->_fd, received, this->_offset);
+	this->_size += received;
+	return (received);
+}
+
+/*
+** @brief Open the pipe on the first splice, non-blocking so a splice never
+** waits on it, and close-on-exec for the CGIs
+*/
+int	RequestBody::_openPipe(void)
+{
+	if (pipe2(this->_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+		return (LOG_ERROR("[_openPipe] Failed to create the splice pipe"), -1);
+	int size = fcntl(this->_pipe[1], F_SETPIPE_SZ, REQUEST_BODY_PIPE_SIZE);
+	if (size == -1)
+		size = fcntl(this->_pipe[1], F_GETPIPE_SZ);
+	this->_pipeSize = (size > 0) ? size : 65536;
+	return (0);
+}
+
+void	RequestBody::_closePipe(void)
+{
+	if (this->_pipe[0] != -1)
+		close(this->_pipe[0]);
+	if (this->_pipe[1] != -1)
+		close(this->_pipe[1]);
+	this->_pipe[0] = -1;
+	this->_pipe[1] = -1;
+}
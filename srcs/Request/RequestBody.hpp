@@ -10,6 +10,20 @@
 
 # include "Utils.hpp"
 # include "Logger.hpp"
+# include "DiskIo.hpp"
+
+# define REQUEST_BODY_PIPE_SIZE 262144 // Asked for the splice pipe, the kernel may keep its default
+# define REQUEST_BODY_HIGH_WATER 1048576 // Bytes waiting for the disk before the client is not read anymore
+
+class Client;
+
+/*
+** Destination of a request body: the uploaded file, or a temporary file
+** for a CGI. The writes go through the disk I/O engine, one at a time at
+** the end of the file, the bytes received meanwhile wait in _pending. A
+** Content-Length body is spliced from the socket to a pipe, then from the
+** pipe to the file by the engine, so its bytes never go through the process.
+*/
 
 class RequestBody
 {
@@ -21,10 +35,21 @@ class RequestBody
 		// std::ofstream	_stream;
 		int					_fd;
 		bool				_isTmp;
-		unsigned long long	_size;
+		unsigned long long	_size; // Bytes received
+		bool				_spliceFile; // The file system takes splice writes
+		int					_pipe[2]; // Socket to file, opened on the first splice
+		size_t				_pipeSize;
+		DiskIo::Op*			_op; // Write or splice in flight, NULL if none
+		std::string			_pending; // Received, not handed to the engine yet
+		off_t				_offset; // End of the bytes written
 
 		/* PRIVATE HELPERS */
-		int	_write(const std::string &data);
+		int		_write(Client *client, const char *data, size_t size);
+		ssize_t	_splice(Client *client, int fd, size_t count);
+		int		_written(Client *client, DiskIo::Op &op);
+		void	_flush(Client *client);
+		int		_openPipe(void);
+		void	_closePipe(void);
 	public:
 		RequestBody(void);
 		RequestBody(bool isTmp);
@@ -33,6 +58,11 @@ class RequestBody
 
 		RequestBody &operator=(const RequestBody &src);
 
+		void	reset(void);
+		bool	canSplice(void);
+		bool	isWriting(void) const { return _op != NULL || !_pending.empty(); }
+		bool	isFull(void) const { return _pending.size() >= REQUEST_BODY_HIGH_WATER; }
+
 		/* GETTERS */
 		std::string			getPath(void) const { return this->_path; }
 		int					getFd(void) const { return this->_fd; }
@@ -1,8 +1,9 @@
 #include "RequestCgi.hpp"
+#include "FastCgiPool.hpp"
 
-RequestCgi::RequestCgi(void) : _request(NULL), _isCGI(false), _path(""), _execPath(""), _cgiHandler(NULL) {}
+RequestCgi::RequestCgi(void) : _request(NULL), _isCGI(false), _path(""), _execPath(""), _cgiHandler(NULL), _pool(NULL) {}
 
-RequestCgi::RequestCgi(Request* request) : _request(request), _isCGI(false), _path(""), _execPath(""), _cgiHandler(NULL) {}
+RequestCgi::RequestCgi(Request* request) : _request(request), _isCGI(false), _path(""), _execPath(""), _cgiHandler(NULL), _pool(NULL) {}
 
 RequestCgi::RequestCgi(const RequestCgi &src)
 {
@@ -24,6 +25,7 @@ RequestCgi &RequestCgi::operator=(const RequestCgi &src)
 		this->_path = src._path;
 		this->_execPath = src._execPath;
 		this->_cgiHandler = src._cgiHandler;
+		this->_pool = src._pool;
 	}
 	return *this;
 }
@@ -32,11 +34,26 @@ RequestCgi &RequestCgi::operator=(const RequestCgi &src)
 ** --------------------------------- METHODS ----------------------------------
 */
 
+/*
+** @brief Get ready for the next request, the executor only lives for one CGI
+*/
+void	RequestCgi::reset(void)
+{
+	if (this->_cgiHandler)
+		delete this->_cgiHandler;
+	this->_cgiHandler = NULL;
+	this->_pool = NULL;
+	this->_isCGI = false;
+	this->_path.clear();
+	this->_execPath.clear();
+}
+
 /*
 ** @brief Initialize the CgiHandler
 */
 void	RequestCgi::_start(void)
 {
+	this->_request->_timings.cgiStart = Clock::now();
 	try {
 		if (this->_cgiHandler)
 			delete this->_cgiHandler;
@@ -44,48 +61,20 @@ void	RequestCgi::_start(void)
 		if (this->_cgiHandler == NULL)
 			throw std::bad_alloc();
 		this->_cgiHandler->_init();
-		this->_cgiHandler->_execute();
+		if (this->_pool)
+			this->_cgiHandler->_pass(this->_pool);
+		else
+			this->_cgiHandler->_execute();
 	} catch (ChildProcessException &e) {
 		throw ChildProcessException();
 	} catch (IntException &e) {
 		return (this->_request->setError(e.code()));
 	} catch (std::exception &e) {
-		Logger::log(Logger::ERROR, "Failed to handle CGI: %s", e.what());
+		LOG_ERROR("Failed to handle CGI: %s", e.what());
 		return (this->_request->setError(500));
 	}
 }
 
-/*
-** @brief Check if the CGI is finished
-**
-** @return bool : true if the CGI is finished, false otherwise
-*/
-void	RequestCgi::_checkState(void)
-{
-	if (this->_request->_state == Request::FINISH)
-		return ;
-	if (this->_cgiHandler == NULL)
-		return ;
-	try {
-		int status;
-		pid_t wpid = waitpid(this->_cgiHandler->_pid, &status, WNOHANG);
-		if (wpid == -1) // Error
-			throw IntException(500);
-		if (wpid == 0) // Still running
-			return ;
-		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
-			this->_request->_setState(Request::FINISH);
-		else
-		{
-			Logger::log(Logger::ERROR, "[RequestCgi] CGI process exited abnormally");
-			this->_request->setError(502);
-		}
-	} catch (IntException &e) {
-		Logger::log(Logger::DEBUG, "[RequestCgi] CGI process failed: %d", e.code());
-		return (this->_request->setError(e.code()));
-	}
-}
-
 /*
 ** @brief Kill the CGI process
 */
@@ -93,5 +82,8 @@ void	RequestCgi::_kill(void)
 {
 	if (this->_cgiHandler == NULL)
 		return ;
-	kill(this->_cgiHandler->_pid, SIGTERM); // OR SIGKILL
+	if (this->_cgiHandler->_pool) // The FastCGI process may be stuck, it is replaced
+		return (this->_cgiHandler->_pool->cancel(this->_cgiHandler, true));
+	if (this->_cgiHandler->_pid > 0)
+		kill(this->_cgiHandler->_pid, SIGTERM); // OR SIGKILL
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 
 class Request;
 class CgiExecutor;
+class FastCgiPool;
 // class CgiHandler;
 
 class RequestCgi
@@ -24,10 +25,10 @@ class RequestCgi
 		std::string		_path;
 		std::string		_execPath;
 		CgiExecutor*	_cgiHandler;
+		FastCgiPool*	_pool; // NULL for a forked CGI
 
 		/* METHODS */
 		void	_start(void);
-		void	_checkState(void);
 		void	_kill(void);
 	public:
 		RequestCgi(void);
@@ -36,6 +37,11 @@ class RequestCgi
 		~RequestCgi(void);
 
 		RequestCgi &operator=(const RequestCgi &src);
+
+		void	reset(void);
+
+		/* GETTERS */
+		CgiExecutor*	getExecutor(void) const { return _cgiHandler; }
 };
 
 # include "Request.hpp"
@@ -1,4 +1,5 @@
 #include "Response.hpp"
+#include "Webserv.hpp"
 
 /*
 ** ------------------------------- CONSTRUCTOR --------------------------------
@@ -8,7 +9,7 @@
 // {
 // }
 
-Response::Response(Client* client) : _request(client->getRequest()), _cgiHandler(this), _state(Response::INIT), _fileFd(-1)
+Response::Response(Client* client) : _request(client->getRequest()), _cgiHandler(this), _state(Response::INIT), _fileFd(-1), _fileSize(0), _loadOp(NULL), _status(0)
 {
 }
 
@@ -18,7 +19,9 @@ Response::Response(Client* client) : _request(client->getRequest()), _cgiHandler
 
 Response::~Response()
 {
-	if (_fileFd != -1)
+	if (_loadOp != NULL) // The engine closes the file once read
+		g_server->getDiskIo().detach(_loadOp, true);
+	else if (_fileFd != -1)
 		close(_fileFd);
 }
 
@@ -26,6 +29,24 @@ Response::~Response()
 ** --------------------------------- METHODS ----------------------------------
 */
 
+/**
+ * @brief get ready for the next request of the connection
+ */
+void Response::reset(void)
+{
+	if (_loadOp != NULL)
+		g_server->getDiskIo().detach(_loadOp, true);
+	else if (_fileFd != -1)
+		close(_fileFd);
+	_loadOp = NULL;
+	_fileFd = -1;
+	_fileSize = 0;
+	_output.clear();
+	_cgiHandler.reset();
+	_state = Response::INIT;
+	_status = 0;
+}
+
 // UTIL RESPONSE ==============================
 
 /**
@@ -40,13 +61,9 @@ bool Response::isRedirect()
 	isLoc = this->_request->getLocation() == NULL ? false : true;
 
 	// return redirection
-	if (isLoc && !this->_request->getLocation()->getRewrite().second.empty())
+	if (isLoc && !this->_request->getLocation()->getRewriteResponse().empty())
 	{
-		std::pair<int, std::string> rewrite = this->_request->getLocation()->getRewrite();
-		_response = "HTTP/1.1 " + intToString(rewrite.first) + " " + getErrorMessage(rewrite.first) + "\r\n";
-		_response += "Location:" + rewrite.second + "\r\n";
-		_response += "Content-Length: 0\r\n";
-		_response += "\r\n";
+		_output.push(this->_request->getLocation()->getRewriteResponse());
 		return (true);
 	}
 
@@ -63,16 +80,14 @@ bool Response::isRedirect()
 
 	if (directoryExist((root + path).c_str()) || (isLoc && directoryExist((this->_request->getLocation()->getAlias() + path.substr(this->_request->getLocation()->getPath().size())).c_str())))
 	{
-		std::string host = _request->getHeaders()["Host"];
-		_response = "HTTP/1.1 301 Moved Permanently\r\n";
-		_response += "Location: http://" + host + path + "/\r\n";
-		_response += "Content-Length: 0\r\n";
-		_response += "\r\n";
+		std::string host = _request->getHeader("Host");
+		std::string body;
+		pushResponse(301, "Location: http://" + host + path + "/\r\n", body);
 
-		Logger::log(Logger::DEBUG, "REDIRECT");
+		LOG_DEBUG("REDIRECT");
 		return true;
 	}
-	Logger::log(Logger::DEBUG, "NO REDIRECT");
+	LOG_DEBUG("NO REDIRECT");
 
 	return false;
 }
@@ -172,131 +187,123 @@ std::vector<std::string> Response::getAllPathsServer(void)
 
 // GET METHOD ==============================
 
-/**
- * @brief check if the file is a large file
- */
-bool Response::isLargeFile(const std::string &path)
-{
-	struct stat fileStat;
-	if (stat(path.c_str(), &fileStat) != 0)
-	{
-		Logger::log(Logger::ERROR, "Failed to stat file: %s", path.c_str());
-		return false;
-	}
-	return fileStat.st_size > THRESHOLD_LARGE_FILE;
-}
-
-
 /**
  * @brief fonction qui determine si il faut
  * renvoyer une page 404 ou 403
  */
 void Response::manageNotFound(std::string directoryToCheck)
 {
-	std::string page;
-
+	_output.clear();
 	if (directoryExist(directoryToCheck.c_str()))
 	{
-		page = ErrorPage::getPage(403, this->_request->getServer()->getErrorPages());
+		ErrorPage::pushPage(_output, 403, this->_request->getServer());
 	}
 	else
 	{
-		page = ErrorPage::getPage(404, this->_request->getServer()->getErrorPages());
+		ErrorPage::pushPage(_output, 404, this->_request->getServer());
 	}
 
-	_response = page;
 	setState(Response::FINISH);
 }
 
 /**
  * @brief fonctions qui test tout les ficher du vector
- * renvoit un pointeur sur le premier fichier qui existe
- * sinon renvoit NULL
+ * renvoit le premier fichier qui existe sinon une string vide
+ * un fichier en cache est pris sans stat, son entree est mise dans cached
  */
-std::string Response::findGoodPath(std::vector<std::string> allPaths)
+std::string Response::findGoodPath(std::vector<std::string> allPaths, const FileCache::Entry *&cached)
 {
+	FileCache &cache = g_server->getFileCache();
+
+	cached = NULL;
 	for (size_t i = 0; i < allPaths.size(); i++)
 	{
-		Logger::log(Logger::DEBUG, "Trying to open file %s", allPaths[i].c_str());
+		LOG_DEBUG("Trying to open file %s", allPaths[i].c_str());
+		if (cache.isEnabled() && (cached = cache.lookup(allPaths[i])) != NULL)
+			return allPaths[i];
 		if (fileExist(allPaths[i]))
 			return allPaths[i];
 	}
 	return "";
 }
 
-void Response::setHeaderChunked(const std::string &path)
+/**
+ * @brief prepare a static file response with content-length
+ * a cached file is queued from memory, a small one is read into the cache
+ * by the disk I/O engine (handleDiskIo), otherwise the file stays open, its
+ * body is queued as a file segment by moveTo() and streamed with sendfile
+ */
+void Response::prepareFileResponse(const std::string &path, const FileCache::Entry *cached)
 {
-	_response = "HTTP/1.1 200 OK\r\n";
-	_response += "Content-Type: " + getMimeType(path) + "\r\n";
-	_response += "Transfer-Encoding: chunked\r\n";
-	_response += "\r\n";
+	if (cached)
+	{
+		LOG_DEBUG("[prepareFileResponse] Cache hit %s", path.c_str());
+		FileCache::pushEntry(_output, *cached);
+		return setState(Response::FINISH);
+	}
+
+	LOG_DEBUG("[prepareFileResponse] Opening file %s", path.c_str());
+	struct stat fileStat;
 
-	_fileFd = open(path.c_str(), O_RDONLY);
-	if (_fileFd == -1)
+	_fileFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (_fileFd == -1 || fstat(_fileFd, &fileStat) == -1)
 	{
-		Logger::log(Logger::ERROR, "Failed to open file: %s", path.c_str());
+		LOG_ERROR("Failed to open file: %s", path.c_str());
 		return manageNotFound(path);
 	}
+	_fileSize = fileStat.st_size;
+
+	std::string mimeType = getMimeType(path);
+	if (g_server->getFileCache().isCacheable(_fileSize))
+	{
+		_loadPath = path;
+		_loadMimeType = mimeType;
+		_loadStat = fileStat;
+		g_server->getFileCache().watchFile(path); // Before the read, a write meanwhile is seen
+		_loadOp = g_server->getDiskIo().read(_request->getClient(), DiskIo::FILE_LOAD, _fileFd, _fileSize, 0);
+		return ;
+	}
+	pushFileHeaders(mimeType);
+	setState(Response::FINISH);
 }
 
 /**
- * @brief prepare CHUNKED response
+ * @brief the file to cache is read, a file which changed meanwhile or
+ * does not fit anymore is streamed instead. The path is stat'ed again:
+ * a write (mtime, size) or a replacement (inode) since the open is not cached
  */
-void Response::prepareChunkedResponse(const std::string &path)
+void Response::handleDiskIo(DiskIo::Op &op)
 {
-	if (_state != Response::CHUNK || _fileFd == -1){
-		setHeaderChunked(path);
-	}
+	const FileCache::Entry *cached = NULL;
+	struct stat fileStat;
 
-	char buffer[RESPONSE_READ_BUFFER_SIZE];
-	ssize_t bytesRead = read(_fileFd, buffer, RESPONSE_READ_BUFFER_SIZE);
-	if (bytesRead == -1)
-	{
-		Logger::log(Logger::ERROR, "Failed to read file: %s", path.c_str());
-		manageNotFound(path);
-	}
-	else if (bytesRead == 0)
+	_loadOp = NULL;
+	if (op.result == _fileSize && stat(_loadPath.c_str(), &fileStat) == 0 && fileStat.st_ino == _loadStat.st_ino
+		&& fileStat.st_dev == _loadStat.st_dev && fileStat.st_size == _loadStat.st_size
+		&& fileStat.st_mtim.tv_sec == _loadStat.st_mtim.tv_sec && fileStat.st_mtim.tv_nsec == _loadStat.st_mtim.tv_nsec)
+		cached = g_server->getFileCache().insertFile(_loadPath, op.buffer, _loadStat, _loadMimeType);
+	if (cached != NULL)
 	{
 		close(_fileFd);
 		_fileFd = -1;
-		_response += "0\r\n\r\n";
-		setState(Response::FINISH);
+		FileCache::pushEntry(_output, *cached);
 	}
 	else
-	{
-		Logger::log(Logger::DEBUG, "[ChunkFUNC] Read %ld bytes from file %s", bytesRead, path.c_str());
-		std::string chunkSize = intToHexa(bytesRead) + "\r\n";
-		std::string chunkData(buffer, bytesRead);
-		_response += chunkSize + chunkData + "\r\n";
-	}
+		pushFileHeaders(_loadMimeType);
+	setState(Response::FINISH);
+	_request->getClient()->watch(RESPONSE_FLAGS);
 }
 
-
 /**
- * @brief prepare STANDARD response with content-length
- * et en lisant en une fois le fichier
+ * @brief queue the header block of a file streamed by moveTo()
  */
-void Response::prepareStandardResponse(const std::string &path)
+void Response::pushFileHeaders(const std::string &mimeType)
 {
-	Logger::log(Logger::DEBUG, "[prepareStandardResponse] Opening file %s", path.c_str());
-	std::ifstream file(path.c_str());
-	if (file.is_open())
-	{
-		std::stringstream content;
-		content << file.rdbuf();
-		std::string body = content.str();
-
-		_response = "HTTP/1.1 200 OK\r\n";
-		_response += "Content-Type: " + getMimeType(path) + "\r\n";
-		_response += "Content-Length: " + intToString(body.size()) + "\r\n";
-		_response += "\r\n";
-		_response += body;
-
-		file.close();
-	}else{
-		Logger::log(Logger::ERROR, "Failed to open file: %s", path.c_str());
-		manageNotFound(path);
-	}
+	std::string headers = "HTTP/1.1 200 OK\r\n";
+	headers += "Content-Type: " + mimeType + "\r\n";
+	headers += "Content-Length: " + Utils::ullToStr(_fileSize) + "\r\n";
+	headers += "\r\n";
+	_output.push(headers);
 }
 
 /**
@@ -308,8 +315,9 @@ void Response::manageLocation()
 	std::string root;
 	this->_request->getLocation()->getRoot().empty() ? root = this->_request->getServer()->getRoot() : root = this->_request->getLocation()->getRoot();
 
+	const FileCache::Entry *cached;
 	std::vector<std::string> allPathsLocation = getAllPathsLocation();
-	std::string path = findGoodPath(allPathsLocation);
+	std::string path = findGoodPath(allPathsLocation, cached);
 
 	if (path.empty()){
 		if (this->_request->getLocation()->getAutoIndex() == TRUE){
@@ -317,24 +325,17 @@ void Response::manageLocation()
 			if (!alias.empty()){
 				// transforme le path en path court: /var/www/html/ -> /www/html/
 				std::string shortPath = _request->getPath().substr(_request->getLocation()->getPath().size());
-				_response = listDirectory(alias + shortPath, alias);
+				listDirectory(alias + shortPath, alias, _output, &g_server->getFileCache());
 			}
 			else
-				_response = listDirectory(root + _request->getPath(), root);
+				listDirectory(root + _request->getPath(), root, _output, &g_server->getFileCache());
 			setState(Response::FINISH);
 			return ;
 		}
 		return manageNotFound(root + _request->getPath());
 	}
 
-	if (isLargeFile(path)){
-		prepareChunkedResponse(path);
-		setState(Response::CHUNK);
-	}
-	else{
-		prepareStandardResponse(path);
-		setState(Response::FINISH);
-	}
+	prepareFileResponse(path, cached);
 }
 
 
@@ -343,20 +344,14 @@ void Response::manageLocation()
  */
 void Response::manageServer()
 {
+	const FileCache::Entry *cached;
 	std::vector<std::string> allPathsServer = getAllPathsServer();
-	std::string path = findGoodPath(allPathsServer);
+	std::string path = findGoodPath(allPathsServer, cached);
 
 	if (path.empty())
 		return manageNotFound(this->_request->getServer()->getRoot() + _request->getPath());
 
-	if (isLargeFile(path)){
-		prepareChunkedResponse(path);
-		setState(Response::CHUNK);
-	}
-	else{
-		prepareStandardResponse(path);
-		setState(Response::FINISH);
-	}
+	prepareFileResponse(path, cached);
 }
 
 /**
@@ -376,17 +371,14 @@ void Response::handleGetRequest(void)
 */
 void Response::handlePostRequest(void)
 {
+	g_server->getFileCache().invalidate(_request->_body.getPath());
 	std::string jsonBody = "{\n";
 	jsonBody += "\"message\": \"File uploaded successfully.\",\n";
 	jsonBody += "\"filename\": \"" + _request->_body.getPath() + "\",\n";
 	jsonBody += "\"size\": " + Utils::ullToStr(_request->_body.getSize()) + "\n";
 	jsonBody += "}\n";
 
-	_response = "HTTP/1.1 200 OK\r\n";
-	_response += "Content-Type: application/json\r\n";
-	_response += "Content-Length: " + intToString(jsonBody.size()) + "\r\n";
-	_response += "\r\n";
-	_response += jsonBody;
+	pushResponse(200, "Content-Type: application/json\r\n", jsonBody);
 	this->setState(Response::FINISH);
 }
 
@@ -400,16 +392,13 @@ void Response::handleDeleteRequest(void)
 		return (this->setError(404));
 	if (directoryExist(path.c_str()) || remove(path.c_str()) != 0)
 		return (this->setError(403));
+	g_server->getFileCache().invalidate(path);
 	std::string jsonBody = "{\n";
 	jsonBody += "\"message\": \"File deleted successfully.\",\n";
 	jsonBody += "\"filename\": \"" + _request->getPath() + "\"\n";
 	jsonBody += "}\n";
 
-	_response = "HTTP/1.1 200 OK\r\n";
-	_response += "Content-Type: application/json\r\n";
-	_response += "Content-Length: " + intToString(jsonBody.size()) + "\r\n";
-	_response += "\r\n";
-	_response += jsonBody;
+	pushResponse(200, "Content-Type: application/json\r\n", jsonBody);
 	this->setState(Response::FINISH);
 }
 
@@ -418,17 +407,14 @@ void Response::handleDeleteRequest(void)
 */
 void Response::handlePutRequest(void)
 {
+	g_server->getFileCache().invalidate(_request->_body.getPath());
 	std::string jsonBody = "{\n";
 	jsonBody += "\"message\": \"File uploaded successfully.\",\n";
 	jsonBody += "\"filename\": \"" + _request->_body.getPath() + "\",\n";
 	jsonBody += "\"size\": " + Utils::ullToStr(_request->_body.getSize()) + "\n";
 	jsonBody += "}\n";
 
-	_response = "HTTP/1.1 200 OK\r\n";
-	_response += "Content-Type: application/json\r\n";
-	_response += "Content-Length: " + intToString(jsonBody.size()) + "\r\n";
-	_response += "\r\n";
-	_response += jsonBody;
+	pushResponse(200, "Content-Type: application/json\r\n", jsonBody);
 	this->setState(Response::FINISH);
 }
 
@@ -438,13 +424,17 @@ void Response::handlePutRequest(void)
  * 
  * @param epollFD
  * @return int : 0 if the response need to be send, -1 if the response is not ready
+ * (CGI output to come, file read by the disk I/O engine)
  */
 int Response::generateResponse(int epollFD)
 {
 	(void)epollFD;
-	if (!_response.empty())
-		_response.clear();
 
+	if (_loadOp != NULL)
+		return (-1);
+
+	if (this->_request->isCgi() && this->_cgiHandler.getState() != CgiHandler::INIT) // Streaming the output, a Status header may have set the code
+		return (this->_handleCgi());
 	if (_request->getStateCode() != REQUEST_DEFAULT_STATE_CODE)
 		return (this->setError(_request->getStateCode()), 0);
 
@@ -454,13 +444,12 @@ int Response::generateResponse(int epollFD)
 
 	if (this->_request->isCgi())
 	{
-		Logger::log(Logger::DEBUG, "ITS A CGI");
+		LOG_DEBUG("ITS A CGI");
 		return (this->_handleCgi());
 	}
-	Logger::log(Logger::DEBUG, "ITS NOT A CGI");
+	LOG_DEBUG("ITS NOT A CGI");
 
-	if (_state != Response::CHUNK)
-		this->setState(Response::PROCESS);
+	this->setState(Response::PROCESS);
 
 	if (_request->getMethod() == "GET")
 		handleGetRequest();
@@ -473,7 +462,55 @@ int Response::generateResponse(int epollFD)
 	else
 		return (this->setError(405), 0);
 	
-	return (0);
+	return (_loadOp != NULL ? -1 : 0); // Not ready while the file is read
+}
+
+/**
+ * @brief queue a response as two segments: the header block and the body
+ * the body is taken without copy
+ *
+ * @param headers : the header lines, each one ending with \r\n
+ */
+void Response::pushResponse(int code, const std::string &headers, std::string &body)
+{
+	std::string head = "HTTP/1.1 " + intToString(code) + " " + getErrorMessage(code) + "\r\n";
+	head += headers;
+	head += "Content-Length: " + Utils::ullToStr(body.size()) + "\r\n";
+	head += "\r\n";
+	_output.push(head);
+	_output.push(body);
+}
+
+/**
+ * @brief hand what has been generated over to the client output queue
+ * the string is moved without copy, an open file becomes a file segment
+ */
+void Response::moveTo(OutputBuffer &output)
+{
+	if (_status == 0)
+		_status = parseStatus();
+	output.splice(_output);
+	if (_fileFd != -1)
+	{
+		output.pushFile(_fileFd, 0, _fileSize);
+		_fileFd = -1;
+	}
+}
+
+/**
+ * @brief read the code of the status line in front of _output, as sent
+ *
+ * @return the code, 0 if the status line is not there yet
+ */
+int Response::parseStatus() const
+{
+	char line[13]; // "HTTP/1.1 200 "
+
+	if (_output.peek(line, sizeof(line)) != sizeof(line) || std::strncmp(line, "HTTP/", 5) != 0 || line[8] != ' ')
+		return (0);
+	if (!std::isdigit(line[9]) || !std::isdigit(line[10]) || !std::isdigit(line[11]))
+		return (0);
+	return ((line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0'));
 }
 
 /*
@@ -483,18 +520,18 @@ int Response::generateResponse(int epollFD)
 void Response::setState(e_response_state state)
 {
 	if (this->_state == Response::FINISH)
-		return (Logger::log(Logger::DEBUG, "[setState (response)] Response already finished"));
+		return (LOG_DEBUG("[setState (response)] Response already finished"));
 	if (this->_state == state)
-		return (Logger::log(Logger::DEBUG, "[setState (response)] Response already in this state"));
+		return (LOG_DEBUG("[setState (response)] Response already in this state"));
 
 	this->_state = state;
 
 	if (this->_state == Response::INIT)
-		Logger::log(Logger::DEBUG, "[setState (response)] Response INIT");
+		LOG_DEBUG("[setState (response)] Response INIT");
 	else if (this->_state == Response::PROCESS)
-		Logger::log(Logger::DEBUG, "[setState (response)] Response PROCESS");
+		LOG_DEBUG("[setState (response)] Response PROCESS");
 	else if (this->_state == Response::FINISH)
-		Logger::log(Logger::DEBUG, "[setState (response)] Response FINISH");
+		LOG_DEBUG("[setState (response)] Response FINISH");
 }
 
 /* ************************************************************************** */
@@ -507,7 +544,10 @@ void	Response::setError(int code, bool generatePage)
 {
 	this->_request->setStateCode(code);
 	if (generatePage)
-		this->_response = ErrorPage::getPage(code, this->_request->getServer()->getErrorPages());
+	{
+		this->_output.clear();
+		ErrorPage::pushPage(this->_output, code, this->_request->getServer());
+	}
 	this->setState(Response::FINISH);
 }
 
@@ -518,42 +558,50 @@ void	Response::setError(int code, bool generatePage)
 
 /**
  * @brief Handle the CGI response
+ * the output is parsed as the CGI writes it (see cgiOutput), this only sends
+ * what is queued and ends the response once the CGI is done
  * 
  * @return int : 0 if the response need to be send, -1 if the response is not ready
+ * (CGI output to come, file read by the disk I/O engine)
  */
 int Response::_handleCgi(void)
 {
-	Logger::log(Logger::DEBUG, "[Reponse::_handleCgi] Handling CGI response");
+	LOG_DEBUG("[Reponse::_handleCgi] Handling CGI response");
 	if (this->_state == Response::FINISH)
 		return (-1);
-	bool isInit = this->_state == Response::INIT;
-	if (this->_state == Response::INIT)
+	this->setState(Response::PROCESS);
+	if (this->_request->getState() != Request::FINISH) // Still running
 	{
-		if (lseek(this->_request->_cgi._cgiHandler->getFdOut(), 0, SEEK_SET) == -1)
-			return (this->setError(500), 0);
-		this->setState(Response::PROCESS);
+		if (this->_request->_cgi._cgiHandler)
+			this->_request->_cgi._cgiHandler->resumeOutput(); // The client took what was queued
+		return (this->_output.empty() ? -1 : 0);
 	}
-	char buffer[RESPONSE_READ_BUFFER_SIZE] = {0};
-
-	memset(buffer, 0, RESPONSE_READ_BUFFER_SIZE);
-	ssize_t bytesRead = read(this->_request->_cgi._cgiHandler->getFdOut(), buffer, RESPONSE_READ_BUFFER_SIZE - 1);
-	if (bytesRead == -1)
+	bool headSent = this->_cgiHandler.getState() >= CgiHandler::BODY;
+	if (this->_request->getStateCode() >= 400) // Failed or timed out
 	{
-		if (isInit) // if its the first read and nothing was sent, we can send a 500. Otherwise is too late, so we just disconnect the client
-			return (this->setError(500), 0);
-		throw IntException(500);
+		if (headSent) // Too late for an error page, so we just disconnect the client
+			throw IntException(this->_request->getStateCode());
+		return (this->setError(this->_request->getStateCode()), 0);
 	}
-	if (bytesRead == 0)
+	if (!headSent)
 	{
-		Logger::log(Logger::DEBUG, "[Reponse::_handleCgi] No more data to read");
-		if (this->_cgiHandler._isChunked)
-			this->_response += "0\r\n\r\n";
-		return (this->setState(Response::FINISH), 0);
+		LOG_ERROR("[Reponse::_handleCgi] CGI output ended before its headers");
+		return (this->setError(502), 0);
 	}
-	buffer[bytesRead] = '\0';
-	std::string str(buffer, bytesRead);
-	this->_cgiHandler._parse(str);
-	if (this->_response.empty())
-		return (-1);
-	return (0);
+	if (this->_cgiHandler._isChunked)
+		this->_output.pushStatic("0\r\n\r\n", 5);
+	return (this->setState(Response::FINISH), 0);
+}
+
+/**
+ * @brief Parse a part of the CGI output, queued for the client right away:
+ * its socket waits for EPOLLOUT only while there is something to send
+ */
+void Response::cgiOutput(const char *data, size_t size)
+{
+	if (this->_state == Response::FINISH) // Replaced by an error page
+		return ;
+	this->_cgiHandler._parse(std::string(data, size));
+	if (!this->_output.empty() && this->_request->getState() >= Request::CGI_PROCESS)
+		this->_request->getClient()->watch(RESPONSE_FLAGS);
 }
@@ -14,13 +14,13 @@
 #include "BlocLocation.hpp"
 #include "ErrorPage.hpp"
 #include "CgiHandler.hpp"
+#include "OutputBuffer.hpp"
+#include "FileCache.hpp"
+#include "DiskIo.hpp"
 
 class Client;
 class Request;
 
-# define RESPONSE_READ_BUFFER_SIZE 4096
-# define THRESHOLD_LARGE_FILE 100000 // 100KB
-
 class Response
 {
 	friend class CgiHandler;
@@ -29,7 +29,6 @@ class Response
 			{
 				INIT,
 				PROCESS,
-				CHUNK,
 				FINISH
 			};
 	
@@ -37,9 +36,15 @@ class Response
 		//Client*				_client;
 		Request*			_request;
 		CgiHandler			_cgiHandler;
-		std::string 		_response;
+		OutputBuffer		_output;
 		e_response_state	_state;
 		int					_fileFd;
+		off_t				_fileSize;
+		DiskIo::Op*			_loadOp; // Read of a file for the cache, NULL if none
+		std::string			_loadPath;
+		std::string			_loadMimeType;
+		struct stat			_loadStat;
+		int					_status; // Code of the status line sent, 0 until moveTo() sees it
 
 
 		// Methods
@@ -53,14 +58,14 @@ class Response
 		void manageServer();
 		void manageLocation();
 		void manageNotFound(std::string directoryToCheck);
-		std::string findGoodPath(std::vector<std::string> allPaths);
-		bool isLargeFile(const std::string& path);
-		void prepareStandardResponse(const std::string &path);
-		void prepareChunkedResponse(const std::string &path);
+		std::string findGoodPath(std::vector<std::string> allPaths, const FileCache::Entry *&cached);
+		void prepareFileResponse(const std::string &path, const FileCache::Entry *cached = NULL);
+		void pushResponse(int code, const std::string &headers, std::string &body);
+		void pushFileHeaders(const std::string &mimeType);
+		int parseStatus() const;
 
 		// Setters
 		void setState(e_response_state state);
-		void setHeaderChunked(const std::string &path);
 
 		/* HANDLE */
 		int	_handleCgi(void);
@@ -73,9 +78,13 @@ class Response
 		
 		// Getters
 		int getState() const { return _state; }
-		std::string getResponse() const { return _response; }
-		size_t	getResponseSize() const { return _response.size(); }
+		unsigned long long	getResponseSize() const { return _output.pending(); }
+		int getStatus() const { return _status; }
 		int generateResponse(int epollFD);
+		void moveTo(OutputBuffer &output);
+		void cgiOutput(const char *data, size_t size);
+		void handleDiskIo(DiskIo::Op &op);
+		void reset(void);
 		std::vector<std::string> getAllPathsLocation();
 		CgiHandler &getCgiHandler(void) { return _cgiHandler; }
 
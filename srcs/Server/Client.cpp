@@ -1,16 +1,32 @@
 #include "Client.hpp"
+#include "Webserv.hpp"
 
 /*
 ** --------------------------------- PRIVATE METHODS ---------------------------
 */
 
-Client::Client(int fd, Socket* socket) : _fd(fd), _socket(socket), _request(new Request(this)), _response(new Response(this)), _lastActivity(time(NULL))
+Client::Client(int fd, Socket* socket, TimerWheel &timers, const struct sockaddr_in &addr) : _fd(fd), _socket(socket), _request(NULL), _response(NULL), _flags(REQUEST_FLAGS), _wanted(REQUEST_FLAGS), _lastActivity(Clock::now()), _acceptTime(Clock::now()), _responseStart(0), _firstByte(0), _accessQueued(false), _timers(timers)
 {
-	// Logger::log(Logger::DEBUG, "[Client] Initializing client with fd %d", fd);
+	// LOG_DEBUG("[Client] Initializing client with fd %d", fd);
+	if (inet_ntop(AF_INET, &addr.sin_addr, this->_remoteAddr, sizeof(this->_remoteAddr)) == NULL)
+		this->_remoteAddr[0] = '\0';
+	this->_timer.data = this;
+	this->_request = new Request(this);
+	this->_response = new Response(this);
+	this->armTimer();
 }
 
 Client::~Client(void)
 {
+	// Responses cut by the disconnection: logged with the bytes sent, without last byte
+	for (; !this->_access.empty(); this->_access.pop_front())
+	{
+		PendingAccess &pending = this->_access.front();
+		pending.entry.bytesSent = std::min(this->_output.getSent(), pending.end) - std::min(this->_output.getSent(), pending.start);
+		pending.entry.wallMs = Clock::wallMs();
+		AccessLog::write(pending.entry);
+	}
+	this->_timers.cancel(this->_timer);
 	if (this->_fd != -1)
 		protectedCall(close(this->_fd), "[~Client] Faild to close client socket", false);
 	if (this->_request != NULL)
@@ -25,91 +41,297 @@ Client::~Client(void)
 
 /**
  * @brief Handle the request of the client
- * 
+ * recv writes straight into the read buffer of the request, leased from
+ * the pool on the first bytes, and the request parses it in place
  */
 void	Client::handleRequest(void)
 {
-	Logger::log(Logger::DEBUG, "[handleRequest] Handling request from client %d", this->_fd);
-	
-	char	buffer[CLIENT_READ_BUFFER_SIZE + 1];
-	int		bytesRead = 0;
-
-	memset(buffer, 0, CLIENT_READ_BUFFER_SIZE + 1);
-	bytesRead  = recv(this->_fd, buffer, CLIENT_READ_BUFFER_SIZE, 0);
-	if (bytesRead > 0)
-	{
-		Logger::log(Logger::DEBUG, "[handleRequest] Received %d bytes from client %d", bytesRead, this->_fd);
-		buffer[bytesRead] = '\0';
-	}
-	else if (bytesRead < 0)
+	LOG_DEBUG("[handleRequest] Handling request from client %d", this->_fd);
+
+	if (this->_request->getState() == Request::FINISH && (this->_request->getStateCode() >= 400 || !this->_request->isKeepAlive()))
+		return (this->_discardInput()); // The connection is closed after the response
+	if (this->_request->getState() > Request::BODY_INIT)
+		return (this->_bufferInput());
+
+	if (this->_request->canSpliceBody())
+		return (this->_spliceBody());
+
+	ReadBuffer &buffer = this->_request->getRawRequest();
+	buffer.lease();
+	if (buffer.space() == 0) // Only a malformed request can fill it
+		return (this->_request->setError(this->_request->getState() < Request::BODY_INIT ? 431 : 400));
+
+	ssize_t bytesRead = recv(this->_fd, buffer.end(), buffer.space(), 0);
+	if (bytesRead < 0)
 		throw std::runtime_error("Error with recv function");
 	else if (bytesRead == 0)
 		throw Client::DisconnectedException();
-	
-	if (this->_request->getState() == Request::FINISH)
-		return (Logger::log(Logger::DEBUG, "[handleRequest] Request already finished"));
+	LOG_DEBUG("[handleRequest] Received %d bytes from client %d", (int)bytesRead, this->_fd);
+
+	buffer.commit(bytesRead);
+	this->_request->parse();
+}
 
-	std::string str(buffer, bytesRead);
-	this->_request->parse(str);
+/**
+ * @brief Receive the rest of a Content-Length body straight into its file
+ */
+void	Client::_spliceBody(void)
+{
+	ssize_t bytesMoved = this->_request->spliceBody(this->_fd);
+	if (bytesMoved < 0)
+		throw std::runtime_error("Error with splice function");
+	else if (bytesMoved == 0)
+		throw Client::DisconnectedException();
+	LOG_DEBUG("[handleRequest] Spliced %d bytes from client %d", (int)bytesMoved, this->_fd);
+}
+
+/**
+ * @brief Keep what the client sends while its request is answered: the next
+ * pipelined requests, parsed once the response is queued. The socket is not
+ * read anymore once the buffer is full
+ */
+void	Client::_bufferInput(void)
+{
+	ReadBuffer &buffer = this->_request->getRawRequest();
+	buffer.lease();
+	if (buffer.space() == 0)
+		return (this->watch(this->_wanted & ~EPOLLIN));
+
+	ssize_t bytesRead = recv(this->_fd, buffer.end(), buffer.space(), 0);
+	if (bytesRead < 0)
+		throw std::runtime_error("Error with recv function");
+	else if (bytesRead == 0)
+		throw Client::DisconnectedException();
+	LOG_DEBUG("[handleRequest] Request already received, %d bytes kept for the next one", (int)bytesRead);
+	buffer.commit(bytesRead);
+}
+
+/**
+ * @brief Read and drop what the client sends while its request is answered,
+ * the connection is closed afterwards
+ */
+void	Client::_discardInput(void)
+{
+	char	buffer[CLIENT_READ_BUFFER_SIZE];
+
+	ssize_t bytesRead = recv(this->_fd, buffer, CLIENT_READ_BUFFER_SIZE, 0);
+	if (bytesRead < 0)
+		throw std::runtime_error("Error with recv function");
+	else if (bytesRead == 0)
+		throw Client::DisconnectedException();
+	LOG_DEBUG("[handleRequest] Request already finished, %d bytes dropped", (int)bytesRead);
 }
 
 /**
  * @brief Handle the response of the client
+ * 
+ * Whatever the socket did not take stays in the output queue and is resumed
+ * on the next EPOLLOUT. The response is generated further only once its
+ * bytes are drained. A finished response may wait in the queue while the
+ * next pipelined request, already buffered, is parsed and answered: the
+ * responses are queued in the order of the requests, at most pipeline_depth
+ * of them waiting for the socket.
  */
 void Client::handleResponse(int epollFD)
 {
-	if (this->_response->generateResponse(epollFD) == -1) // Reponse not ready
-		return ;
+	size_t depth = g_server->getConfigParser().getPipelineDepth();
 
-	Logger::log(Logger::DEBUG, "Response to sent: \n%s", this->_response->getResponse().c_str());
-	
-	int bytesSent = -1;
-	if (this->getFd() != -1)
-		bytesSent = send(this->getFd(), this->_response->getResponse().c_str(), this->_response->getResponseSize(), 0);
-	
-	if (bytesSent < 0)
-		throw std::runtime_error("Error with send function");
-	else
-		Logger::log(Logger::DEBUG, "Sent %d bytes to client %d", bytesSent, this->getFd());
-
-	if (this->getResponse()->getState() == Response::FINISH)
+	while (true)
 	{
-		if (this->_request->getStateCode() != Request::FINISH)
-			throw Client::DisconnectedException();
-		Logger::log(Logger::DEBUG, "Response sent to client %d", this->getFd());
+		if (!this->_output.empty())
+		{
+			this->_flushOutput();
+			if (this->_isSending()) // Socket full or file not read yet, wait for the next EPOLLOUT
+				return ;
+		}
+		if (!this->_request->canRespond()) // Next pipelined request not complete yet
+			return ;
+
+		// The output of a CGI is queued as it comes, an error page may replace it before this call
+		if (this->_response->getState() != Response::FINISH || this->_response->getResponseSize() != 0)
+		{
+			if (this->_response->getState() != Response::FINISH && this->_response->generateResponse(epollFD) == -1) // Reponse not ready
+				return (this->watch(REQUEST_FLAGS)); // Armed again when the CGI writes something
+			LOG_DEBUG("Response to sent: %llu bytes", this->_response->getResponseSize());
+			this->_response->moveTo(this->_output);
+			if (this->_response->getState() == Response::FINISH)
+				this->_queueAccess(); // Before the flush: a connection cut midway is logged too
+			this->_flushOutput();
+			if (this->_isSending())
+				return ;
+		}
+		if (this->_response->getState() != Response::FINISH)
+			return ;
+		this->_queueAccess();
+
+		// After an error the rest of the request may still be on the socket
+		if (this->_request->getStateCode() >= 400 || !this->_request->isKeepAlive())
+		{
+			if (this->_output.empty())
+				throw Client::DisconnectedException();
+			return ;
+		}
+		if (!this->_output.empty())
+		{
+			if (this->_queued.size() >= depth)
+				return ;
+			this->_queued.push_back(this->_output.getSent() + this->_output.pending());
+		}
+		LOG_DEBUG("Response queued to client %d, %d waiting", this->getFd(), (int)this->_queued.size());
 		this->reset();
-		modifySocketEpoll(epollFD, this->getFd(), REQUEST_FLAGS);
+		this->watch(REQUEST_FLAGS);
+		if (this->_request->getRawRequest().empty())
+			return ;
+		this->_request->parse(); // Pipelined, answered on the next turn if complete
 	}
 }
 
 /**
-* Une fois qu'on a envoye la reponse, il faut clear la requete, a voir comment faire ca clean ?
+ * @brief Send what the socket takes, then forget the responses fully sent.
+ * A file range not read from the disk yet is prefetched first: EPOLLOUT is
+ * left out until it is in the page cache, so sendfile never waits for the disk
  */
-void Client::reset(void)
+void Client::_flushOutput(void)
 {
-	// Reset request
-	delete this->_request;
-	this->_request = new Request(this);
-	// Reset response
-	delete this->_response;
-	this->_response = new Response(this);
+	ssize_t bytesSent = this->_output.flush(this->getFd());
+	LOG_DEBUG("Sent %d bytes to client %d, %llu pending", (int)bytesSent, this->getFd(), this->_output.pending());
+	while (!this->_queued.empty() && this->_queued.front() <= this->_output.getSent())
+		this->_queued.pop_front();
+	if (this->_firstByte == 0 && this->_output.getSent() > this->_responseStart)
+		this->_firstByte = Clock::now();
+	this->_retireAccess();
+	this->_output.prefetch(this);
+	this->watch(this->_wanted);
 }
 
-/*
-** --------------------------------- IS ---------------------------------
-*/
+/**
+ * @brief Bytes of the current response are still queued, the ones of the
+ * responses before it end at the last mark
+ */
+bool Client::_isSending(void) const
+{
+	unsigned long long queued = this->_queued.empty() ? this->_output.getSent() : this->_queued.back();
+	return (this->_output.getSent() + this->_output.pending() > queued);
+}
 
 /**
- * @brief Check if got a cgi
- * 	
- * @return true if got a cgi ready, false otherwise
+ * @brief The response is complete in the output queue: 1 request in
+ * access_log_sample gets its line, written once the last byte is sent
  */
-void Client::checkCgi(void)
+void Client::_queueAccess(void)
 {
-	if (this->_request == NULL) // No request
+	if (this->_accessQueued || !AccessLog::isEnabled())
 		return ;
-	if (!this->_request->_cgi._isCGI) // Not a CGI
+	this->_accessQueued = true;
+	if (!AccessLog::sample())
 		return ;
-	return (this->_request->_cgi._checkState());
+
+	const Request::Timings &timings = this->_request->getTimings();
+	this->_access.push_back(PendingAccess());
+	PendingAccess &pending = this->_access.back();
+	AccessLog::Entry &entry = pending.entry;
+	pending.start = this->_responseStart;
+	pending.end = this->_output.getSent() + this->_output.pending();
+	std::memcpy(entry.remoteAddr, this->_remoteAddr, sizeof(entry.remoteAddr));
+	entry.wallMs = 0;
+	entry.method = this->_request->getMethod();
+	entry.uri = this->_request->getUri();
+	entry.httpVersion = this->_request->getHttpVersion();
+	entry.host = this->_request->getHeader("Host");
+	entry.userAgent = this->_request->getHeader("User-Agent");
+	entry.referer = this->_request->getHeader("Referer");
+	entry.status = this->_response->getStatus() ? this->_response->getStatus() : this->_request->getStateCode();
+	entry.bytesSent = pending.end - pending.start;
+	entry.bodyBytes = this->_request->getBody().getSize();
+	entry.accept = this->_acceptTime;
+	entry.start = timings.start;
+	entry.headers = timings.headers;
+	entry.body = timings.body;
+	entry.cgiStart = timings.cgiStart;
+	entry.cgiEnd = timings.cgiStart ? timings.finish : 0;
+	entry.firstByte = this->_firstByte;
+	entry.lastByte = 0;
+	this->_retireAccess();
 }
 
+/**
+ * @brief Write the access log lines of the responses fully sent, in order
+ */
+void Client::_retireAccess(void)
+{
+	unsigned long long sent = this->_output.getSent();
+
+	for (size_t i = 0; i < this->_access.size() && sent > this->_access[i].start; i++)
+		if (this->_access[i].entry.firstByte == 0)
+			this->_access[i].entry.firstByte = Clock::now();
+	while (!this->_access.empty() && this->_access.front().end <= sent)
+	{
+		AccessLog::Entry &entry = this->_access.front().entry;
+		entry.lastByte = Clock::now();
+		if (entry.firstByte == 0) // Empty response
+			entry.firstByte = entry.lastByte;
+		entry.wallMs = Clock::wallMs();
+		AccessLog::write(entry);
+		this->_access.pop_front();
+	}
+}
+
+/**
+ * @brief A disk operation of the client is done, it goes to its owner
+ */
+void Client::handleDiskIo(DiskIo::Op &op)
+{
+	if (op.owner == DiskIo::BODY)
+		return (this->_request->handleDiskIo(op));
+	if (op.owner == DiskIo::CGI_INPUT)
+		return (this->_request->getCgi().getExecutor()->handleDiskIo(op));
+	if (op.owner == DiskIo::FILE_LOAD)
+		return (this->_response->handleDiskIo(op));
+	this->_output.prefetched(op);
+	this->watch(this->_wanted);
+}
+
+/**
+ * @brief Get ready for the next request of a keep-alive connection
+ * the request and the response are reset in place, no allocation
+ */
+void Client::reset(void)
+{
+	this->_request->reset();
+	this->_response->reset();
+	this->_responseStart = this->_output.getSent() + this->_output.pending();
+	this->_firstByte = 0;
+	this->_accessQueued = false;
+}
+
+/**
+ * @brief Arm the timer on the closest deadline: inactivity or request timeout
+ * a deadline moved later (new activity) is left alone, the timer is armed
+ * again on expiry; only an earlier one moves it now
+ */
+void Client::armTimer(void)
+{
+	uint64_t deadline = this->_lastActivity + INACTIVITY_TIMEOUT * 1000;
+	if (this->_request && this->_request->getTimeout() != 0 && this->_request->getState() != Request::FINISH)
+		deadline = std::min(deadline, this->_request->getTimeout());
+	if (!this->_timer.isArmed() || deadline < this->_timer.deadline)
+		this->_timers.arm(this->_timer, deadline);
+}
+
+/**
+ * @brief Set the epoll flags of the socket, only a change reaches the kernel
+ * EPOLLOUT is added while the output queue holds bytes the socket can take,
+ * and left out while they wait for the disk
+ */
+void Client::watch(uint32_t flags)
+{
+	this->_wanted = flags;
+	if (this->_output.isWaitingDisk())
+		flags &= ~EPOLLOUT;
+	else if (!this->_output.empty())
+		flags |= EPOLLOUT;
+	if (flags == this->_flags)
+		return ;
+	this->_flags = flags;
+	modifySocketEpoll(g_server->getEpollFD(), this->_fd, flags, EPOLL_TAG_FD(this->_fd, EPOLL_TAG_CLIENT));
+}
@@ -3,14 +3,22 @@
 
 # include <sys/socket.h>
 # include <netinet/in.h>
+# include <arpa/inet.h>
 # include <ctime>
+# include <deque>
 
 # include "Utils.hpp"
 # include "Request.hpp"
 # include "Socket.hpp"
 # include "Response.hpp"
+# include "OutputBuffer.hpp"
+# include "TimerWheel.hpp"
+# include "Clock.hpp"
+# include "DiskIo.hpp"
+# include "AccessLog.hpp"
 
-# define CLIENT_READ_BUFFER_SIZE 8192  // 4096
+# define CLIENT_READ_BUFFER_SIZE 8192  // Bytes dropped per read once the request is finished
+# define INACTIVITY_TIMEOUT 60 // seconds without any event before the connection is closed
 
 class Request;
 class Response;
@@ -19,34 +27,63 @@ class Response;
 class Client
 {
 	private:
+		/* Access log line of a response queued in _output, written once its last byte is sent */
+		struct PendingAccess
+		{
+			AccessLog::Entry	entry;
+			unsigned long long	start; // Output offsets of the response
+			unsigned long long	end;
+		};
+
 		int						_fd;
 		Socket*					_socket;
 		Request*				_request;
 		Response*				_response;
-		time_t					_lastActivity;
+		OutputBuffer			_output;
+		uint32_t				_flags; // Current epoll flags
+		uint32_t				_wanted; // Flags asked by the last watch, EPOLLOUT follows the output queue
+		std::deque<unsigned long long>	_queued; // Output offsets where the responses waiting in _output end
+		uint64_t				_lastActivity; // ms, Clock::now() base
+		uint64_t				_acceptTime; // ms, Clock::now() base
+		char					_remoteAddr[INET_ADDRSTRLEN];
+		unsigned long long		_responseStart; // Output offset of the current response
+		uint64_t				_firstByte; // First byte of the current response sent, 0 before
+		bool					_accessQueued; // Current request counted for the access log
+		std::deque<PendingAccess>	_access;
+		TimerWheel&				_timers;
+		TimerWheel::Timer		_timer;
+
+		void		_discardInput(void);
+		void		_bufferInput(void);
+		void		_spliceBody(void);
+		void		_flushOutput(void);
+		bool		_isSending(void) const;
+		void		_queueAccess(void);
+		void		_retireAccess(void);
 
 	public:
-		Client(int fd, Socket* socket);
+		Client(int fd, Socket* socket, TimerWheel &timers, const struct sockaddr_in &addr);
 		~Client(void);
 
 		/* HANDLE */
 		void		handleRequest(void);
 		void 		handleResponse(int epollFD);
+		void		handleDiskIo(DiskIo::Op &op);
 		
 		void 		reset(void);
+		void		watch(uint32_t flags);
 
 		/* GETTERS */
 		int 		getFd(void) const { return _fd; }
 		Request* 	getRequest(void) const { return _request; }
 		Socket*		getSocket(void) const { return _socket; }
 		Response*	getResponse(void) const { return _response; }
+		OutputBuffer&	getOutput(void) { return _output; }
 
 		// timeout
-		time_t 		getLastActivity() const { return _lastActivity; }
-		void		updateLastActivity() { _lastActivity = time(NULL); }
-
-		// Checkers
-		void		checkCgi(void);
+		uint64_t	getLastActivity() const { return _lastActivity; }
+		void		updateLastActivity() { _lastActivity = Clock::now(); }
+		void		armTimer(void);
 
 		class DisconnectedException : public std::exception
 		{
@@ -0,0 +1,532 @@
+#include "DiskIo.hpp"
+#include "Logger.hpp"
+#include "Utils.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+** ------------------------------- CONSTRUCTOR --------------------------------
+*/
+
+DiskIo::DiskIo(void) : _backend(DiskIo::SYNC), _owner(-1), _eventFd(-1), _inFlight(0), _ringFd(-1), _entries(0), _sqRing(MAP_FAILED), _sqRingSize(0), _cqRing(MAP_FAILED), _cqRingSize(0), _sqes((struct io_uring_sqe *)MAP_FAILED), _scratch(NULL), _stopping(false)
+{
+	pthread_mutex_init(&this->_lock, NULL);
+	pthread_cond_init(&this->_wake, NULL);
+}
+
+/*
+** -------------------------------- DESTRUCTOR --------------------------------
+*/
+
+/*
+** @brief Wait for the operations still in the kernel, their buffers must
+** outlive them, and stop the threads. A forked child has neither
+*/
+DiskIo::~DiskIo(void)
+{
+	if (this->_eventFd == -1 || getpid() != this->_owner)
+		return ;
+	if (this->_backend == DiskIo::THREADS)
+		this->_stopThreads();
+	if (this->_backend == DiskIo::URING)
+	{
+		std::vector<Op*> done;
+		while (this->_inFlight > 0)
+		{
+			this->_enter(0, 1);
+			this->_reapUring(done);
+		}
+		for (size_t i = 0; i < done.size(); i++)
+			this->_finish(done[i]);
+		this->_closeUring();
+	}
+	for (size_t i = 0; i < this->_backlog.size(); i++)
+		this->_finish(this->_backlog[i]);
+	for (size_t i = 0; i < this->_queue.size(); i++)
+		this->_finish(this->_queue[i]);
+	for (size_t i = 0; i < this->_completed.size(); i++)
+		this->_finish(this->_completed[i]);
+	close(this->_eventFd);
+	pthread_cond_destroy(&this->_wake);
+	pthread_mutex_destroy(&this->_lock);
+}
+
+/*
+** --------------------------------- METHODS ----------------------------------
+*/
+
+/*
+** @brief Pick the backend of this reactor: io_uring if the kernel has it
+** with every operation, the thread pool otherwise, inline as a last resort
+*/
+void	DiskIo::init(void)
+{
+	this->_owner = getpid();
+	this->_eventFd = protectedCall(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "Failed to create the disk I/O eventfd");
+	if (this->_initUring())
+		this->_backend = DiskIo::URING;
+	else if (this->_initThreads())
+		this->_backend = DiskIo::THREADS;
+	else
+		this->_backend = DiskIo::SYNC;
+	LOG_INFO("Disk I/O through %s", this->getBackendName());
+}
+
+/*
+** @brief Read size bytes of fd at offset into the buffer of the operation
+*/
+DiskIo::Op*	DiskIo::read(Client *client, e_op_owner owner, int fd, size_t size, off_t offset)
+{
+	Op *op = this->_newOp(DiskIo::READ, owner, client, fd, size, offset);
+	op->buffer.resize(size);
+	return (this->_submit(op));
+}
+
+/*
+** @brief Write data to fd at offset, data is taken without copy (swapped)
+*/
+DiskIo::Op*	DiskIo::write(Client *client, e_op_owner owner, int fd, std::string &data, off_t offset)
+{
+	Op *op = this->_newOp(DiskIo::WRITE, owner, client, fd, data.size(), offset);
+	op->buffer.swap(data);
+	return (this->_submit(op));
+}
+
+/*
+** @brief Move size bytes from pipeFd to fd at offset, they never reach the process
+*/
+DiskIo::Op*	DiskIo::splice(Client *client, e_op_owner owner, int pipeFd, int fd, size_t size, off_t offset)
+{
+	Op *op = this->_newOp(DiskIo::SPLICE, owner, client, fd, size, offset);
+	op->pipeFd = pipeFd;
+	return (this->_submit(op));
+}
+
+/*
+** @brief Bring size bytes of fd at offset into the page cache, sendfile
+** then finds them without waiting for the disk
+*/
+DiskIo::Op*	DiskIo::prefetch(Client *client, e_op_owner owner, int fd, size_t size, off_t offset)
+{
+	return (this->_submit(this->_newOp(DiskIo::PREFETCH, owner, client, fd, std::min(size, (size_t)DISKIO_PREFETCH_SIZE), offset)));
+}
+
+/*
+** @brief The client of an operation goes away: its completion is dropped
+** and, with closeFd, its fds are closed once nothing uses them anymore
+*/
+void	DiskIo::detach(Op *op, bool closeFd)
+{
+	op->client = NULL;
+	op->closeFd = closeFd;
+	std::deque<Op*>::iterator it = std::find(this->_backlog.begin(), this->_backlog.end(), op);
+	if (it != this->_backlog.end())
+	{
+		this->_backlog.erase(it);
+		return (this->_finish(op));
+	}
+	if (this->_backend != DiskIo::THREADS)
+		return ;
+	pthread_mutex_lock(&this->_lock);
+	it = std::find(this->_queue.begin(), this->_queue.end(), op);
+	bool queued = (it != this->_queue.end());
+	if (queued)
+		this->_queue.erase(it);
+	pthread_mutex_unlock(&this->_lock);
+	if (queued)
+	{
+		this->_inFlight--;
+		this->_finish(op);
+	}
+}
+
+/*
+** @brief Collect the operations done since the last call, the detached
+** ones are released here. The caller releases the others once handled
+*/
+void	DiskIo::reap(std::vector<Op*> &done)
+{
+	std::vector<Op*>	completed;
+	uint64_t			count;
+
+	while (::read(this->_eventFd, &count, sizeof(count)) == sizeof(count))
+		;
+	if (this->_backend == DiskIo::URING)
+		this->_reapUring(completed);
+	pthread_mutex_lock(&this->_lock);
+	completed.insert(completed.end(), this->_completed.begin(), this->_completed.end());
+	this->_inFlight -= this->_completed.size();
+	this->_completed.clear();
+	pthread_mutex_unlock(&this->_lock);
+	for (size_t i = 0; i < completed.size(); i++)
+	{
+		if (completed[i]->client == NULL)
+			this->_finish(completed[i]);
+		else
+			done.push_back(completed[i]);
+	}
+}
+
+void	DiskIo::release(Op *op)
+{
+	this->_finish(op);
+}
+
+const char*	DiskIo::getBackendName(void) const
+{
+	if (this->_backend == DiskIo::URING)
+		return ("io_uring");
+	if (this->_backend == DiskIo::THREADS)
+		return ("thread pool");
+	return ("blocking calls");
+}
+
+/*
+** --------------------------------- PRIVATE ----------------------------------
+*/
+
+DiskIo::Op*	DiskIo::_newOp(e_op_type type, e_op_owner owner, Client *client, int fd, size_t size, off_t offset)
+{
+	Op *op = new Op();
+	op->type = type;
+	op->owner = owner;
+	op->client = client;
+	op->fd = fd;
+	op->pipeFd = -1;
+	op->size = size;
+	op->done = 0;
+	op->offset = offset;
+	op->result = 0;
+	op->closeFd = false;
+	return (op);
+}
+
+/*
+** @brief Hand an operation to the backend, inline it completes on the next
+** loop iteration like the others
+*/
+DiskIo::Op*	DiskIo::_submit(Op *op)
+{
+	if (this->_backend == DiskIo::URING)
+	{
+		if (!this->_backlog.empty() || this->_inFlight >= this->_entries || !this->_pushSqe(op))
+			this->_backlog.push_back(op);
+		else
+			this->_enter(1, 0);
+		return (op);
+	}
+	this->_inFlight++;
+	if (this->_backend == DiskIo::THREADS)
+	{
+		pthread_mutex_lock(&this->_lock);
+		this->_queue.push_back(op);
+		pthread_cond_signal(&this->_wake);
+		pthread_mutex_unlock(&this->_lock);
+		return (op);
+	}
+	DiskIo::_run(op);
+	this->_completed.push_back(op);
+	uint64_t one = 1;
+	::write(this->_eventFd, &one, sizeof(one));
+	return (op);
+}
+
+void	DiskIo::_finish(Op *op)
+{
+	if (op->closeFd)
+	{
+		if (op->fd != -1)
+			close(op->fd);
+		if (op->pipeFd != -1)
+			close(op->pipeFd);
+	}
+	delete op;
+}
+
+/*
+** --------------------------------- IO_URING ---------------------------------
+*/
+
+/*
+** @brief Set up the rings and register the eventfd, the kernel signals it
+** for each completion
+*/
+bool	DiskIo::_initUring(void)
+{
+	struct io_uring_params	params;
+
+	memset(&params, 0, sizeof(params));
+	this->_ringFd = syscall(__NR_io_uring_setup, DISKIO_QUEUE_DEPTH, &params);
+	if (this->_ringFd == -1)
+	{
+		LOG_DEBUG("[DiskIo] No io_uring: %s", strerror(errno));
+		return (false);
+	}
+	this->_entries = params.sq_entries;
+	this->_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	this->_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		this->_sqRingSize = this->_cqRingSize = std::max(this->_sqRingSize, this->_cqRingSize);
+	this->_sqRing = mmap(NULL, this->_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->_ringFd, IORING_OFF_SQ_RING);
+	if (this->_sqRing != MAP_FAILED && (params.features & IORING_FEAT_SINGLE_MMAP))
+		this->_cqRing = this->_sqRing;
+	else if (this->_sqRing != MAP_FAILED)
+		this->_cqRing = mmap(NULL, this->_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->_ringFd, IORING_OFF_CQ_RING);
+	this->_sqes = static_cast<struct io_uring_sqe *>(mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->_ringFd, IORING_OFF_SQES));
+	this->_scratch = static_cast<char *>(malloc(DISKIO_PREFETCH_SIZE));
+	if (this->_sqRing == MAP_FAILED || this->_cqRing == MAP_FAILED || this->_sqes == MAP_FAILED || this->_scratch == NULL
+		|| syscall(__NR_io_uring_register, this->_ringFd, IORING_REGISTER_EVENTFD, &this->_eventFd, 1) == -1 || !this->_probeUring())
+	{
+		LOG_DEBUG("[DiskIo] io_uring unusable");
+		this->_closeUring();
+		return (false);
+	}
+
+	char *sq = static_cast<char *>(this->_sqRing);
+	char *cq = static_cast<char *>(this->_cqRing);
+	this->_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	this->_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	this->_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	this->_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	this->_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	this->_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	this->_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	this->_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+	return (true);
+}
+
+/*
+** @brief Check the kernel knows every operation used (SPLICE is 5.7)
+*/
+bool	DiskIo::_probeUring(void)
+{
+	const size_t	size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+	const int		ops[] = {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_SPLICE};
+	bool			supported = true;
+
+	struct io_uring_probe *probe = static_cast<struct io_uring_probe *>(calloc(1, size));
+	if (probe == NULL || syscall(__NR_io_uring_register, this->_ringFd, IORING_REGISTER_PROBE, probe, 256) == -1)
+		supported = false;
+	for (size_t i = 0; supported && i < sizeof(ops) / sizeof(ops[0]); i++)
+		supported = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+	free(probe);
+	return (supported);
+}
+
+/*
+** @brief Queue the next part of an operation in the submission ring
+**
+** @return false if the ring is full
+*/
+bool	DiskIo::_pushSqe(Op *op)
+{
+	unsigned tail = *this->_sqTail;
+	if (tail - __atomic_load_n(this->_sqHead, __ATOMIC_ACQUIRE) >= this->_entries)
+		return (false);
+
+	unsigned index = tail & *this->_sqMask;
+	struct io_uring_sqe *sqe = &this->_sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = op->fd;
+	sqe->off = op->offset + op->done;
+	sqe->len = op->size - op->done;
+	sqe->user_data = (uintptr_t)op;
+	if (op->type == DiskIo::READ || op->type == DiskIo::WRITE)
+	{
+		sqe->opcode = (op->type == DiskIo::READ) ? IORING_OP_READ : IORING_OP_WRITE;
+		sqe->addr = (uintptr_t)(op->buffer.data() + op->done);
+	}
+	else if (op->type == DiskIo::SPLICE)
+	{
+		sqe->opcode = IORING_OP_SPLICE;
+		sqe->splice_fd_in = op->pipeFd;
+		sqe->splice_off_in = (uint64_t)-1; // A pipe has no offset
+		sqe->splice_flags = SPLICE_F_MOVE;
+	}
+	else // Punted to a kernel worker, a cached file would otherwise be copied inline
+	{
+		sqe->opcode = IORING_OP_READ;
+		sqe->addr = (uintptr_t)this->_scratch;
+		sqe->flags = IOSQE_ASYNC;
+	}
+	this->_sqArray[index] = index;
+	__atomic_store_n(this->_sqTail, tail + 1, __ATOMIC_RELEASE);
+	this->_inFlight++;
+	return (true);
+}
+
+/*
+** @brief Submit the queued entries, and wait for minComplete completions
+*/
+void	DiskIo::_enter(unsigned toSubmit, unsigned minComplete)
+{
+	unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+
+	while (syscall(__NR_io_uring_enter, this->_ringFd, toSubmit, minComplete, flags, NULL, 0) == -1 && errno == EINTR)
+		;
+}
+
+/*
+** @brief Drain the completion ring. A partial transfer is queued again for
+** the rest, then the backlog takes the free entries
+*/
+void	DiskIo::_reapUring(std::vector<Op*> &done)
+{
+	unsigned	head = *this->_cqHead;
+	unsigned	tail = __atomic_load_n(this->_cqTail, __ATOMIC_ACQUIRE);
+	unsigned	submitted = 0;
+
+	for (; head != tail; head++)
+	{
+		struct io_uring_cqe *cqe = &this->_cqes[head & *this->_cqMask];
+		Op *op = reinterpret_cast<Op *>((uintptr_t)cqe->user_data);
+		this->_inFlight--;
+		if (cqe->res > 0)
+			op->done += cqe->res;
+		if (cqe->res > 0 && op->done < op->size && op->client != NULL)
+		{
+			if (this->_pushSqe(op))
+				submitted++;
+			else
+				this->_backlog.push_front(op);
+			continue ;
+		}
+		op->result = (cqe->res < 0) ? cqe->res : (ssize_t)op->done;
+		done.push_back(op);
+	}
+	__atomic_store_n(this->_cqHead, head, __ATOMIC_RELEASE);
+	while (!this->_backlog.empty() && this->_inFlight < this->_entries && this->_pushSqe(this->_backlog.front()))
+	{
+		this->_backlog.pop_front();
+		submitted++;
+	}
+	if (submitted > 0)
+		this->_enter(submitted, 0);
+}
+
+void	DiskIo::_closeUring(void)
+{
+	if (this->_sqes != MAP_FAILED)
+		munmap(this->_sqes, this->_entries * sizeof(struct io_uring_sqe));
+	if (this->_cqRing != MAP_FAILED && this->_cqRing != this->_sqRing)
+		munmap(this->_cqRing, this->_cqRingSize);
+	if (this->_sqRing != MAP_FAILED)
+		munmap(this->_sqRing, this->_sqRingSize);
+	if (this->_ringFd != -1)
+		close(this->_ringFd);
+	free(this->_scratch);
+	this->_sqes = (struct io_uring_sqe *)MAP_FAILED;
+	this->_sqRing = MAP_FAILED;
+	this->_cqRing = MAP_FAILED;
+	this->_ringFd = -1;
+	this->_scratch = NULL;
+}
+
+/*
+** --------------------------------- THREADS ----------------------------------
+*/
+
+/*
+** @brief Start the pool, every signal blocked in the threads so they keep
+** going to the reactor (SIGINT handler, SIGCHLD signalfd)
+*/
+bool	DiskIo::_initThreads(void)
+{
+	sigset_t	all;
+	sigset_t	previous;
+	pthread_t	thread;
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &previous);
+	for (size_t i = 0; i < DISKIO_THREADS; i++)
+	{
+		if (pthread_create(&thread, NULL, &DiskIo::_threadMain, this) != 0)
+			break ;
+		this->_threads.push_back(thread);
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	return (!this->_threads.empty());
+}
+
+void	DiskIo::_stopThreads(void)
+{
+	pthread_mutex_lock(&this->_lock);
+	this->_stopping = true;
+	pthread_cond_broadcast(&this->_wake);
+	pthread_mutex_unlock(&this->_lock);
+	for (size_t i = 0; i < this->_threads.size(); i++)
+		pthread_join(this->_threads[i], NULL);
+	this->_threads.clear();
+}
+
+/*
+** @brief Run the queued operations, then wake the reactor
+*/
+void	*DiskIo::_threadMain(void *arg)
+{
+	DiskIo		*self = static_cast<DiskIo *>(arg);
+	uint64_t	one = 1;
+
+	pthread_mutex_lock(&self->_lock);
+	while (true)
+	{
+		while (self->_queue.empty() && !self->_stopping)
+			pthread_cond_wait(&self->_wake, &self->_lock);
+		if (self->_stopping)
+			break ;
+		Op *op = self->_queue.front();
+		self->_queue.pop_front();
+		pthread_mutex_unlock(&self->_lock);
+		DiskIo::_run(op);
+		pthread_mutex_lock(&self->_lock);
+		self->_completed.push_back(op);
+		::write(self->_eventFd, &one, sizeof(one));
+	}
+	pthread_mutex_unlock(&self->_lock);
+	return (NULL);
+}
+
+/*
+** @brief Do a whole operation with blocking calls
+*/
+void	DiskIo::_run(Op *op)
+{
+	char	chunk[DISKIO_CHUNK_SIZE];
+
+	while (op->done < op->size)
+	{
+		ssize_t	bytes;
+		size_t	left = op->size - op->done;
+		off_t	offset = op->offset + op->done;
+
+		if (op->type == DiskIo::READ)
+			bytes = pread(op->fd, &op->buffer[op->done], left, offset);
+		else if (op->type == DiskIo::WRITE)
+			bytes = pwrite(op->fd, op->buffer.data() + op->done, left, offset);
+		else if (op->type == DiskIo::SPLICE)
+		{
+			loff_t fileOffset = offset;
+			bytes = ::splice(op->pipeFd, NULL, op->fd, &fileOffset, left, SPLICE_F_MOVE);
+		}
+		else
+			bytes = pread(op->fd, chunk, std::min(left, sizeof(chunk)), offset);
+		if (bytes == -1 && errno == EINTR)
+			continue ;
+		if (bytes == -1)
+		{
+			op->result = -errno;
+			return ;
+		}
+		if (bytes == 0)
+			break ;
+		op->done += bytes;
+	}
+	op->result = op->done;
+}
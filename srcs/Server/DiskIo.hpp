@@ -0,0 +1,135 @@
+#ifndef DISKIO_HPP
+# define DISKIO_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <pthread.h>
+# include <sys/types.h>
+# include <linux/io_uring.h>
+
+# define DISKIO_QUEUE_DEPTH 256 // io_uring entries, more operations wait in the backlog
+# define DISKIO_THREADS 4 // Threads of the pool used without io_uring
+# define DISKIO_PREFETCH_SIZE 1048576 // Bytes of a file read ahead of sendfile
+# define DISKIO_CHUNK_SIZE 65536 // Bytes read per call by a thread prefetching
+
+class Client;
+
+/*
+** Asynchronous disk I/O of a reactor. The operations go to io_uring, or to
+** a small thread pool on a kernel without it (or without one of the
+** operations), and their completions wake the epoll through an eventfd, so
+** a slow disk never stalls the other connections.
+** An operation owns its buffer and is done in full (short transfers are
+** resumed). Its client may go away meanwhile: the operation is detached,
+** and its fds are closed once the kernel or the thread is done with them.
+*/
+class DiskIo
+{
+	public:
+		enum e_op_type
+		{
+			READ, // pread into buffer
+			WRITE, // pwrite from buffer
+			SPLICE, // From pipeFd to fd at offset
+			PREFETCH // Read and drop, the pages are in the cache for sendfile
+		};
+		enum e_op_owner // What of the client gets the completion
+		{
+			BODY,
+			CGI_INPUT,
+			FILE_LOAD,
+			FILE_SEND
+		};
+		struct Op
+		{
+			e_op_type	type;
+			e_op_owner	owner;
+			Client*		client; // NULL once detached
+			int			fd;
+			int			pipeFd;
+			std::string	buffer;
+			size_t		size;
+			size_t		done;
+			off_t		offset;
+			ssize_t		result; // done, or -errno
+			bool		closeFd; // Close fd and pipeFd once done, the owner went away
+		};
+
+	private:
+		enum e_backend
+		{
+			URING,
+			THREADS,
+			SYNC
+		};
+
+		e_backend				_backend;
+		pid_t					_owner; // A forked child leaves the ring and the threads alone
+		int						_eventFd;
+		size_t					_inFlight;
+		std::deque<Op*>			_backlog; // Waiting for room in the ring
+		std::vector<Op*>		_completed; // Done by a thread or inline, under _lock
+		// io_uring
+		int						_ringFd;
+		unsigned				_entries;
+		void*					_sqRing;
+		size_t					_sqRingSize;
+		void*					_cqRing;
+		size_t					_cqRingSize;
+		struct io_uring_sqe*	_sqes;
+		unsigned*				_sqHead;
+		unsigned*				_sqTail;
+		unsigned*				_sqMask;
+		unsigned*				_sqArray;
+		unsigned*				_cqHead;
+		unsigned*				_cqTail;
+		unsigned*				_cqMask;
+		struct io_uring_cqe*	_cqes;
+		char*					_scratch; // Destination of the prefetches, never read
+		// Thread pool
+		std::vector<pthread_t>	_threads;
+		pthread_mutex_t			_lock;
+		pthread_cond_t			_wake;
+		std::deque<Op*>			_queue;
+		bool					_stopping;
+
+		Op*		_newOp(e_op_type type, e_op_owner owner, Client *client, int fd, size_t size, off_t offset);
+		Op*		_submit(Op *op);
+		void	_finish(Op *op);
+
+		/* IO_URING */
+		bool	_initUring(void);
+		bool	_probeUring(void);
+		bool	_pushSqe(Op *op);
+		void	_enter(unsigned toSubmit, unsigned minComplete);
+		void	_reapUring(std::vector<Op*> &done);
+		void	_closeUring(void);
+
+		/* THREADS */
+		bool	_initThreads(void);
+		void	_stopThreads(void);
+		static void	*_threadMain(void *arg);
+		static void	_run(Op *op);
+
+		DiskIo(const DiskIo &src);
+		DiskIo &operator=(const DiskIo &rhs);
+	public:
+		DiskIo(void);
+		~DiskIo(void);
+
+		void	init(void);
+		Op*		read(Client *client, e_op_owner owner, int fd, size_t size, off_t offset);
+		Op*		write(Client *client, e_op_owner owner, int fd, std::string &data, off_t offset);
+		Op*		splice(Client *client, e_op_owner owner, int pipeFd, int fd, size_t size, off_t offset);
+		Op*		prefetch(Client *client, e_op_owner owner, int fd, size_t size, off_t offset);
+		void	detach(Op *op, bool closeFd);
+		void	reap(std::vector<Op*> &done);
+		void	release(Op *op);
+
+		/* GETTERS */
+		int			getFd(void) const { return _eventFd; }
+		const char*	getBackendName(void) const;
+};
+
+#endif // DISKIO_HPP
@@ -0,0 +1,282 @@
+#include "OutputBuffer.hpp"
+#include "Webserv.hpp"
+
+OutputBuffer::OutputBuffer(void) : _offset(0), _pending(0), _sent(0)
+{
+}
+
+OutputBuffer::~OutputBuffer(void)
+{
+	this->clear();
+}
+
+/*
+** --------------------------------- METHODS ----------------------------------
+*/
+
+/*
+** @brief Queue a buffer
+** The content of data is taken without copy (swap), data is left empty
+*/
+void	OutputBuffer::push(std::string &data)
+{
+	if (data.empty())
+		return ;
+	Segment &segment = this->_pushSegment(OutputBuffer::BUFFER);
+	segment.data.swap(data);
+	segment.ptr = segment.data.data();
+	segment.size = segment.data.size();
+	this->_pending += segment.size;
+}
+
+/*
+** @brief Queue a shared buffer, only its reference count is touched
+*/
+void	OutputBuffer::push(const SharedBuffer &data)
+{
+	if (data.empty())
+		return ;
+	Segment &segment = this->_pushSegment(OutputBuffer::SHARED);
+	segment.shared = data;
+	segment.ptr = segment.shared.data();
+	segment.size = segment.shared.size();
+	this->_pending += segment.size;
+}
+
+/*
+** @brief Queue a string which outlives the buffer (static storage), not copied
+*/
+void	OutputBuffer::pushStatic(const char *data, size_t size)
+{
+	if (size == 0)
+		return ;
+	Segment &segment = this->_pushSegment(OutputBuffer::STATIC);
+	segment.ptr = data;
+	segment.size = size;
+	this->_pending += size;
+}
+
+/*
+** @brief Queue the range [offset, end[ of an open file
+** The buffer takes the ownership of fd and closes it once sent
+*/
+void	OutputBuffer::pushFile(int fd, off_t offset, off_t end)
+{
+	if (offset >= end)
+	{
+		close(fd);
+		return ;
+	}
+	Segment &segment = this->_pushSegment(OutputBuffer::FILE);
+	segment.fd = fd;
+	segment.offset = offset;
+	segment.end = end;
+	segment.ready = offset;
+	this->_pending += end - offset;
+}
+
+/*
+** @brief Move all the segments of other at the end of this buffer
+** other must not be partially sent
+*/
+void	OutputBuffer::splice(OutputBuffer &other)
+{
+	this->_pending += other._pending;
+	this->_segments.splice(this->_segments.end(), other._segments);
+	other._pending = 0;
+	other._offset = 0;
+}
+
+/*
+** @brief Send as much as the socket accepts, up to OUTPUT_BUFFER_FLUSH_MAX
+**
+** @return ssize_t : the number of bytes sent (0 if the socket is full)
+*/
+ssize_t	OutputBuffer::flush(int socketFd)
+{
+	ssize_t	total = 0;
+
+	while (!this->_segments.empty() && total < OUTPUT_BUFFER_FLUSH_MAX)
+	{
+		size_t	max = OUTPUT_BUFFER_FLUSH_MAX - total;
+		ssize_t	bytesSent;
+
+		Segment &front = this->_segments.front();
+		if (front.type == OutputBuffer::FILE && front.offset >= front.ready) // Waiting for the disk
+			break ;
+		if (front.type == OutputBuffer::FILE)
+			bytesSent = this->_sendFile(socketFd, max);
+		else
+			bytesSent = this->_sendMemory(socketFd, max);
+		if (bytesSent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) // Socket full, resume on the next EPOLLOUT
+			break ;
+		if (bytesSent == -1)
+			throw std::runtime_error("Error with send function");
+		total += bytesSent;
+		this->_pending -= bytesSent;
+		this->_sent += bytesSent;
+	}
+	return (total);
+}
+
+/*
+** @brief Keep the file range in front of the queue prefetched a window
+** ahead of sendfile
+**
+** @return true if nothing can be sent before the prefetch completes
+*/
+bool	OutputBuffer::prefetch(Client *client)
+{
+	if (this->_segments.empty() || this->_segments.front().type != OutputBuffer::FILE)
+		return (false);
+	Segment &segment = this->_segments.front();
+	if (segment.prefetch == NULL && segment.ready < segment.end && segment.ready - segment.offset < DISKIO_PREFETCH_SIZE)
+		segment.prefetch = g_server->getDiskIo().prefetch(client, DiskIo::FILE_SEND, segment.fd, segment.end - segment.ready, segment.ready);
+	return (segment.offset >= segment.ready);
+}
+
+/*
+** @brief A prefetch is done, sendfile goes on up to its end. A failed or
+** short one releases the rest of the range: sendfile reports the error
+*/
+void	OutputBuffer::prefetched(DiskIo::Op &op)
+{
+	if (this->_segments.empty() || this->_segments.front().prefetch != &op)
+		return ;
+	Segment &segment = this->_segments.front();
+	segment.prefetch = NULL;
+	if (op.result <= 0 || op.done < op.size)
+		segment.ready = segment.end;
+	else
+		segment.ready = op.offset + op.done;
+}
+
+/*
+** @brief Drop everything still queued
+*/
+void	OutputBuffer::clear(void)
+{
+	while (!this->_segments.empty())
+		this->_pop();
+	this->_pending = 0;
+}
+
+/*
+** --------------------------------- PRIVATE ----------------------------------
+*/
+
+OutputBuffer::Segment&	OutputBuffer::_pushSegment(e_segment_type type)
+{
+	this->_segments.push_back(Segment());
+	Segment &segment = this->_segments.back();
+	segment.type = type;
+	segment.ptr = NULL;
+	segment.size = 0;
+	segment.fd = -1;
+	segment.offset = 0;
+	segment.end = 0;
+	segment.ready = 0;
+	segment.prefetch = NULL;
+	return (segment);
+}
+
+/*
+** @brief Copy the first bytes still to send, up to the first file range
+**
+** @return the number of bytes copied
+*/
+size_t	OutputBuffer::peek(char *dst, size_t size) const
+{
+	size_t	copied = 0;
+	size_t	offset = this->_offset;
+
+	for (std::list<Segment>::const_iterator it = this->_segments.begin(); it != this->_segments.end() && it->type != OutputBuffer::FILE && copied < size; ++it)
+	{
+		size_t length = std::min(it->size - offset, size - copied);
+		std::memcpy(dst + copied, it->ptr + offset, length);
+		copied += length;
+		offset = 0;
+	}
+	return (copied);
+}
+
+/*
+** @brief Gather the memory segments in front of the queue into one sendmsg
+*/
+ssize_t	OutputBuffer::_sendMemory(int socketFd, size_t max)
+{
+	struct iovec	iov[OUTPUT_BUFFER_IOV_MAX];
+	int				iovCount = 0;
+	size_t			size = 0;
+	size_t			offset = this->_offset;
+
+	std::list<Segment>::iterator it = this->_segments.begin();
+	for (; it != this->_segments.end() && it->type != OutputBuffer::FILE && iovCount < OUTPUT_BUFFER_IOV_MAX && size < max; ++it)
+	{
+		iov[iovCount].iov_base = const_cast<char *>(it->ptr) + offset;
+		iov[iovCount].iov_len = std::min(it->size - offset, max - size);
+		size += iov[iovCount].iov_len;
+		iovCount++;
+		offset = 0;
+	}
+
+	struct msghdr	msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovCount;
+	// Let the kernel merge the headers with the segments that follow
+	int flags = MSG_NOSIGNAL | (it != this->_segments.end() ? MSG_MORE : 0);
+	ssize_t bytesSent = sendmsg(socketFd, &msg, flags);
+	if (bytesSent > 0)
+		this->_consume(bytesSent);
+	return (bytesSent);
+}
+
+/*
+** @brief Send the prefetched part of the file range in front of the queue
+** with sendfile
+*/
+ssize_t	OutputBuffer::_sendFile(int socketFd, size_t max)
+{
+	Segment	&segment = this->_segments.front();
+	off_t	toSend = std::min((off_t)max, segment.ready - segment.offset);
+
+	ssize_t bytesSent = sendfile(socketFd, segment.fd, &segment.offset, toSend);
+	if (bytesSent == 0) // File truncated since its headers were queued
+		throw std::runtime_error("File truncated during sendfile");
+	if (segment.offset >= segment.end)
+		this->_pop();
+	return (bytesSent);
+}
+
+/*
+** @brief Drop size bytes of memory segments from the front of the queue
+*/
+void	OutputBuffer::_consume(size_t size)
+{
+	while (size > 0)
+	{
+		size_t left = this->_segments.front().size - this->_offset;
+		if (size < left)
+		{
+			this->_offset += size;
+			return ;
+		}
+		size -= left;
+		this->_pop();
+	}
+}
+
+/*
+** @brief Remove the front segment
+*/
+void	OutputBuffer::_pop(void)
+{
+	Segment &segment = this->_segments.front();
+	if (segment.prefetch != NULL) // The engine closes the file once the kernel is done with it
+		g_server->getDiskIo().detach(segment.prefetch, true);
+	else if (segment.type == OutputBuffer::FILE && segment.fd != -1)
+		protectedCall(close(segment.fd), "[OutputBuffer] Failed to close file", false);
+	this->_segments.pop_front();
+	this->_offset = 0;
+}
@@ -0,0 +1,87 @@
+#ifndef OUTPUTBUFFER_HPP
+# define OUTPUTBUFFER_HPP
+
+# include <string>
+# include <list>
+# include <algorithm>
+# include <sys/types.h>
+# include <sys/socket.h>
+# include <sys/sendfile.h>
+# include <sys/uio.h>
+
+# include "Utils.hpp"
+# include "SharedBuffer.hpp"
+# include "DiskIo.hpp"
+
+# define OUTPUT_BUFFER_FLUSH_MAX 1048576 // 1MB per EPOLLOUT, to stay fair with the other clients
+# define OUTPUT_BUFFER_IOV_MAX 64 // Memory segments gathered in one sendmsg
+
+/*
+** Per-client queue of the bytes still to send.
+** A segment is a buffer (owned), a shared buffer (reference counted), a static
+** string (not owned) or a range of an open file. Consecutive memory segments
+** are gathered into one sendmsg, file ranges go through sendfile, so nothing is ever copied into one big
+** string. Short writes are resumed from the send offset on the next EPOLLOUT.
+** A file range is sent only once prefetched by the disk I/O engine, one
+** window ahead of sendfile, so a cold file never blocks the reactor.
+*/
+class OutputBuffer
+{
+	private:
+		enum e_segment_type
+		{
+			BUFFER,
+			SHARED,
+			STATIC,
+			FILE
+		};
+		struct Segment
+		{
+			e_segment_type	type;
+			std::string		data;
+			SharedBuffer	shared;
+			const char*		ptr;
+			size_t			size;
+			int				fd;
+			off_t			offset;
+			off_t			end;
+			off_t			ready; // Prefetched up to there
+			DiskIo::Op*		prefetch; // In flight, NULL if none
+		};
+
+		std::list<Segment>	_segments;
+		size_t				_offset; // Send offset in the front memory segment
+		unsigned long long	_pending;
+		unsigned long long	_sent; // Bytes sent since the connection started
+
+		Segment&	_pushSegment(e_segment_type type);
+		ssize_t		_sendMemory(int socketFd, size_t max);
+		ssize_t		_sendFile(int socketFd, size_t max);
+		void		_consume(size_t size);
+		void		_pop(void);
+
+		OutputBuffer(const OutputBuffer &src);
+		OutputBuffer &operator=(const OutputBuffer &rhs);
+	public:
+		OutputBuffer(void);
+		~OutputBuffer(void);
+
+		void		push(std::string &data);
+		void		push(const SharedBuffer &data);
+		void		pushStatic(const char *data, size_t size);
+		void		pushFile(int fd, off_t offset, off_t end);
+		void		splice(OutputBuffer &other);
+		ssize_t		flush(int socketFd);
+		bool		prefetch(Client *client);
+		void		prefetched(DiskIo::Op &op);
+		void		clear(void);
+		size_t		peek(char *dst, size_t size) const;
+
+		/* GETTERS */
+		bool				empty(void) const { return _segments.empty(); }
+		unsigned long long	pending(void) const { return _pending; }
+		unsigned long long	getSent(void) const { return _sent; }
+		bool				isWaitingDisk(void) const { return !_segments.empty() && _segments.front().type == FILE && _segments.front().offset >= _segments.front().ready; }
+};
+
+#endif // OUTPUTBUFFER_HPP
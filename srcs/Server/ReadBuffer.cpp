@@ -0,0 +1,94 @@
+#include "ReadBuffer.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+std::vector<char *>	ReadBuffer::_pool;
+
+/*
+** ------------------------------- CONSTRUCTOR --------------------------------
+*/
+
+ReadBuffer::ReadBuffer(void) : _data(NULL), _size(0)
+{
+}
+
+/*
+** -------------------------------- DESTRUCTOR --------------------------------
+*/
+
+ReadBuffer::~ReadBuffer(void)
+{
+	this->release();
+}
+
+/*
+** --------------------------------- METHODS ----------------------------------
+*/
+
+/*
+** @brief Take a block from the pool, or allocate one if the pool is empty
+*/
+void	ReadBuffer::lease(void)
+{
+	if (this->_data)
+		return ;
+	if (!ReadBuffer::_pool.empty())
+	{
+		this->_data = ReadBuffer::_pool.back();
+		ReadBuffer::_pool.pop_back();
+	}
+	else if ((this->_data = static_cast<char *>(malloc(READ_BUFFER_SIZE))) == NULL)
+		throw std::bad_alloc();
+	this->_size = 0;
+}
+
+/*
+** @brief Give the block back to the pool, its content is dropped
+*/
+void	ReadBuffer::release(void)
+{
+	if (!this->_data)
+		return ;
+	if (ReadBuffer::_pool.size() < READ_BUFFER_POOL_MAX)
+		ReadBuffer::_pool.push_back(this->_data);
+	else
+		free(this->_data);
+	this->_data = NULL;
+	this->_size = 0;
+}
+
+/*
+** @brief Remove count bytes at pos, the tail is moved down
+*/
+void	ReadBuffer::erase(size_t pos, size_t count)
+{
+	if (pos >= this->_size)
+		return ;
+	if (count > this->_size - pos)
+		count = this->_size - pos;
+	memmove(this->_data + pos, this->_data + pos + count, this->_size - pos - count);
+	this->_size -= count;
+}
+
+/*
+** @brief Find needle from pos
+**
+** @return its position, std::string::npos if absent
+*/
+size_t	ReadBuffer::find(const char *needle, size_t pos) const
+{
+	if (pos >= this->_size)
+		return (std::string::npos);
+	const char *found = static_cast<const char *>(memmem(this->_data + pos, this->_size - pos, needle, strlen(needle)));
+	return (found ? found - this->_data : std::string::npos);
+}
+
+std::string	ReadBuffer::substr(size_t pos, size_t count) const
+{
+	if (pos >= this->_size)
+		return ("");
+	return (std::string(this->_data + pos, std::min(count, this->_size - pos)));
+}
@@ -0,0 +1,55 @@
+#ifndef READBUFFER_HPP
+# define READBUFFER_HPP
+
+# include <string>
+# include <vector>
+# include <cstddef>
+
+# define READ_BUFFER_SIZE 16384 // Size of a pooled block
+# define READ_BUFFER_HEADER_MAX 8192 // Request line and headers must fit in it, 431 otherwise
+# define READ_BUFFER_POOL_MAX 1024 // Free blocks kept for reuse, the others go back to malloc
+
+/*
+** Receive buffer of a connection: a fixed-size block leased from a per
+** process pool while a request is in flight, and given back when the
+** connection goes idle. recv writes straight into its free space and the
+** request parser reads it in place.
+*/
+class ReadBuffer
+{
+	private:
+		char*	_data;
+		size_t	_size;
+
+		static std::vector<char *>	_pool;
+
+		ReadBuffer(const ReadBuffer &src);
+		ReadBuffer &operator=(const ReadBuffer &rhs);
+
+	public:
+		ReadBuffer(void);
+		~ReadBuffer(void);
+
+		void		lease(void);
+		void		release(void);
+
+		void		commit(size_t size) { _size += size; }
+		void		erase(size_t pos, size_t count);
+		void		resize(size_t size) { _size = size; }
+		void		clear(void) { _size = 0; }
+		size_t		find(const char *needle, size_t pos = 0) const;
+		std::string	substr(size_t pos, size_t count) const;
+
+		/* GETTERS */
+		bool		isLeased(void) const { return _data != NULL; }
+		const char*	data(void) const { return _data; }
+		char*		end(void) { return _data + _size; }
+		size_t		size(void) const { return _size; }
+		bool		empty(void) const { return _size == 0; }
+		size_t		space(void) const { return _data ? READ_BUFFER_SIZE - _size : 0; }
+		char		operator[](size_t pos) const { return _data[pos]; }
+
+		static size_t	getPoolSize(void) { return _pool.size(); }
+};
+
+#endif // READBUFFER_HPP
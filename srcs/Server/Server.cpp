@@ -1,7 +1,8 @@
 #include "Server.hpp"
+#include "HttpScanner.hpp"
 
 
-Server::Server() : _state(S_STATE_INIT), _epollFD(-1)
+Server::Server() : _state(S_STATE_INIT), _epollFD(-1), _isWorker(false), _reserveFD(-1), _signalFD(-1)
 {
 }
 
@@ -11,16 +12,29 @@ Server::Server() : _state(S_STATE_INIT), _epollFD(-1)
  * - close the epoll instance
  */
 Server::~Server(){
+	// Before the clients, so their cancelled FastCGI requests respawn nothing
+	for (std::map<std::string, FastCgiPool*>::iterator it = this->_fastCgiPools.begin(); it != this->_fastCgiPools.end(); ++it)
+		it->second->stop();
 	if (this->_epollFD != -1)
 		protectedCall(close(_epollFD), "Faild to close epoll instance", false);
+	if (this->_reserveFD != -1)
+		close(this->_reserveFD);
+	if (this->_signalFD != -1)
+		close(this->_signalFD);
+	for (size_t i = 0; i < this->_orphans.size(); i++)
+		if (this->_orphans[i].second != -1)
+			close(this->_orphans[i].second);
 	// Delete all the sockets
-	for (std::map<int, Socket*>::iterator it = this->_sockets.begin(); it != this->_sockets.end(); ++it)
-		delete it->second;
+	for (size_t i = 0; i < this->_sockets.size(); i++)
+		delete this->_sockets[i];
 	this->_sockets.clear();
 	// Delete all the clients
-	for (std::map<int, Client*>::iterator it = this->_clients.begin(); it != this->_clients.end(); ++it)
-		delete it->second;
+	for (size_t i = 0; i < this->_clients.size(); i++)
+		delete this->_clients[i];
 	this->_clients.clear();
+	for (std::map<std::string, FastCgiPool*>::iterator it = this->_fastCgiPools.begin(); it != this->_fastCgiPools.end(); ++it)
+		delete it->second;
+	this->_fastCgiPools.clear();
 }
 
 /*
@@ -31,34 +45,170 @@ Server::~Server(){
 void Server::stop( void )
 {
 	this->setState(S_STATE_STOP);
+	this->_stopWorkers();
+}
+
+/**
+ * @brief Reopen the log file (rotation), in the workers too
+ * Called from the signal handler, so it only flags and uses kill
+ */
+void Server::reopenLogs( void )
+{
+	Logger::reopen();
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		if (this->_workers[i] > 0)
+			kill(this->_workers[i], SIGUSR1);
 }
 
 /**
  * @brief Initializes the server with the given server configurations.
  * 
- * This function sets up the server by creating and binding listening sockets for 
- * each GROUP of CORRESPONDING IP:PORT 
- * create the epoll instance and add all the listening socket to the epoll
- * 
- * @param serversConfig A vector of BlocServer objects representing the server configurations.
+ * With a single worker the reactor is set up right away. Otherwise each
+ * worker process sets up its own reactor after the fork (see _runMaster).
+ * The access log is opened before, the workers share it
  */
 void Server::init(void)
 {
-	Logger::log(Logger::DEBUG, "[Server::init] Create epoll instance...");
+	AccessLog::open(this->_configParser.getAccessLog(), this->_configParser.getAccessLogSample());
+	if (this->_configParser.getWorkers() == 1)
+		this->_initReactor(false);
+	this->setState(S_STATE_READY);
+}
+
+/**
+ * @brief Set up one reactor: an epoll instance and a listening socket for
+ * each GROUP of CORRESPONDING IP:PORT, all added to the epoll
+ * 
+ * @param reusePort set SO_REUSEPORT so several reactors can bind the same ip:port
+ */
+void Server::_initReactor(bool reusePort)
+{
+	LOG_DEBUG("[Server::init] Create epoll instance...");
 	this->setEpollFD(protectedCall(epoll_create1(O_CLOEXEC), "Failed to create epoll instance"));
 
-	Logger::log(Logger::DEBUG, "#==============================#");
-	Logger::log(Logger::DEBUG, "|| Create listening sockets...||");
-	Logger::log(Logger::DEBUG, "#==============================#");
+	// One slot per possible fd, a client is found without any lookup
+	struct rlimit limit;
+	size_t tableSize = SERVER_DEFAULT_MAX_FDS;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+		tableSize = limit.rlim_cur;
+	this->_clients.assign(tableSize, NULL);
+	this->_reserveFD = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	LOG_DEBUG("#==============================#");
+	LOG_DEBUG("|| Create listening sockets...||");
+	LOG_DEBUG("#==============================#");
 
 	std::map<std::string, std::vector<BlocServer> > &servers = this->_configParser.getServers();
 	for (std::map<std::string, std::vector<BlocServer> >::iterator it = servers.begin(); it != servers.end(); ++it)
 	{
-		int socketFD = protectedCall(socket(AF_INET, SOCK_STREAM, 0), "Error with socket function");
-		this->_sockets[socketFD] = new Socket(socketFD, extractIp(it->first), extractPort(it->first), &it->second);
-		addSocketEpoll(this->_epollFD, socketFD, REQUEST_FLAGS);
+		int socketFD = protectedCall(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0), "Error with socket function");
+		Socket *listener = new Socket(socketFD, extractIp(it->first), extractPort(it->first), &it->second, this->_configParser.getBacklog(), reusePort);
+		this->_sockets.push_back(listener);
+		addSocketEpoll(this->_epollFD, socketFD, LISTEN_FLAGS, EPOLL_TAG(listener, EPOLL_TAG_SOCKET));
+	}
+	this->_initFileCache();
+	Clock::update();
+	this->_timers.start(Clock::now());
+	this->_initChildWatch();
+	this->_initFastCgi();
+	this->_initDiskIo(); // After the first FastCGI forks, the thread pool (if any) is not copied
+	LOG_DEBUG("[Server::init] Request scanner kernels: %s", HttpScanner::getKernelName());
+}
+
+/**
+ * @brief Set up the static file cache of this reactor and its inotify
+ * watcher on every root and alias, the watcher fd joins the epoll
+ */
+void Server::_initFileCache(void)
+{
+	this->_fileCache.configure(this->_configParser.getFileCacheSize(), this->_configParser.getFileCacheValid());
+	if (!this->_fileCache.isEnabled())
+		return ;
+
+	std::map<std::string, std::vector<BlocServer> > &servers = this->_configParser.getServers();
+	for (std::map<std::string, std::vector<BlocServer> >::iterator it = servers.begin(); it != servers.end(); ++it)
+	{
+		for (std::vector<BlocServer>::iterator server = it->second.begin(); server != it->second.end(); ++server)
+		{
+			this->_fileCache.watchRoot(server->getRoot());
+			std::vector<BlocLocation> *locations = server->getLocations();
+			for (std::vector<BlocLocation>::iterator location = locations->begin(); location != locations->end(); ++location)
+			{
+				this->_fileCache.watchRoot(location->getRoot());
+				this->_fileCache.watchRoot(location->getAlias());
+			}
+		}
+	}
+	if (this->_fileCache.getWatchFd() != -1)
+		addSocketEpoll(this->_epollFD, this->_fileCache.getWatchFd(), EPOLLIN, EPOLL_TAG(&this->_fileCache, EPOLL_TAG_WATCH));
+}
+
+/**
+ * @brief Choose how the exit of a CGI process is noticed: its pidfd in the
+ * epoll, or on a kernel without pidfd (before 5.3) SIGCHLD, blocked and read
+ * from a signalfd. Either way the reactor is woken, nothing polls waitpid
+ */
+void Server::_initChildWatch(void)
+{
+	sigset_t	mask;
+
+	int pidFd = openPidFd(getpid());
+	if (pidFd != -1)
+		return ((void)close(pidFd));
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	this->_signalFD = protectedCall(signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC), "Failed to create signalfd");
+	addSocketEpoll(this->_epollFD, this->_signalFD, EPOLLIN, EPOLL_TAG(this, EPOLL_TAG_SIGNAL));
+	LOG_INFO("No pidfd support, CGI processes are reaped on SIGCHLD");
+}
+
+/**
+ * @brief Start the disk I/O engine, its completions wake the epoll through
+ * its eventfd like the inotify one
+ */
+void Server::_initDiskIo(void)
+{
+	this->_diskIo.init();
+	addSocketEpoll(this->_epollFD, this->_diskIo.getFd(), EPOLLIN, EPOLL_TAG(&this->_diskIo, EPOLL_TAG_WATCH));
+}
+
+/**
+ * @brief Start a FastCGI pool for each application of a fastcgi_pass, shared
+ * by the locations naming the same command (their settings agree, see
+ * ConfigParser::checkFastCgiPools)
+ */
+void Server::_initFastCgi(void)
+{
+	std::map<std::string, std::vector<BlocServer> > &servers = this->_configParser.getServers();
+	for (std::map<std::string, std::vector<BlocServer> >::iterator it = servers.begin(); it != servers.end(); ++it)
+	{
+		for (std::vector<BlocServer>::iterator server = it->second.begin(); server != it->second.end(); ++server)
+		{
+			std::vector<BlocLocation> *locations = server->getLocations();
+			for (std::vector<BlocLocation>::iterator location = locations->begin(); location != locations->end(); ++location)
+			{
+				const std::map<std::string, std::string> &passes = location->getFastCgi();
+				for (std::map<std::string, std::string>::const_iterator pass = passes.begin(); pass != passes.end(); ++pass)
+				{
+					if (this->_fastCgiPools.find(pass->second) != this->_fastCgiPools.end())
+						continue ;
+					FastCgiPool *pool = new FastCgiPool(pass->second, location->getFastCgiPoolSize(), location->getFastCgiMaxRequests());
+					this->_fastCgiPools[pass->second] = pool;
+					pool->start();
+				}
+			}
+		}
 	}
-	this->setState(S_STATE_READY);
+}
+
+/**
+ * @brief The pool started for an application command, NULL if none
+ */
+FastCgiPool* Server::getFastCgiPool(const std::string &command)
+{
+	std::map<std::string, FastCgiPool*>::iterator it = this->_fastCgiPools.find(command);
+	return (it == this->_fastCgiPools.end() ? NULL : it->second);
 }
 
 /*
@@ -66,24 +216,105 @@ void Server::init(void)
 */
 
 /**
- * @brief Handle the new client connection
+ * @brief Handle the new client connections
+ * the listener is edge-triggered: its accept queue is drained until EAGAIN,
+ * at most SERVER_ACCEPT_BUDGET connections per loop iteration. A listener
+ * stopped by the budget goes on at the next iteration (_runPendingAccepts)
  * 
- * @param fd => The LISTENING socket who get the new client
+ * @param socket => The LISTENING socket who get the new clients
  */
-void	Server::_handleClientConnection(int fd)
+void	Server::_handleClientConnection(Socket *socket)
 {
-	Logger::log(Logger::DEBUG, "[Server::_handleClientConnection] New client connected on file descriptor %d", fd);
+	for (int accepted = 0; accepted < SERVER_ACCEPT_BUDGET; )
+	{
+		struct sockaddr_in addr;
+		socklen_t addrLen = sizeof(addr);
+		int clientFD = accept4(socket->getFd(), reinterpret_cast<struct sockaddr *>(&addr), &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (clientFD != -1)
+		{
+			try {
+				this->_acceptClient(socket, clientFD, addr);
+			} catch (const std::exception &e) { // bad_alloc: this connection only
+				LOG_ERROR("[Server::_handleClientConnection] Error with a new connection : %s", e.what());
+				close(clientFD);
+			}
+			accepted++;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) // Queue drained, wait for the next edge
+			return ;
+		else if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) // This connection only
+			continue ;
+		else if ((errno == EMFILE || errno == ENFILE) && this->_reserveFD != -1)
+		{
+			if (!this->_refuseClient(socket)) // EMFILE comes first even on an empty queue
+				return ;
+			accepted++;
+		}
+		else
+		{
+			// ENOBUFS, ENOMEM, out of fds without a reserve: the queue is tried again on the next edge
+			LOG_ERROR("[Server::_handleClientConnection] accept4 on %d: %s", socket->getFd(), strerror(errno));
+			return ;
+		}
+	}
+	this->_acceptPending.push_back(socket);
+}
 
-	struct sockaddr_in	addr;
-	socklen_t			addrLen = sizeof(addr);
+/**
+ * @brief Register the new client, already non-blocking and close-on-exec
+ */
+void	Server::_acceptClient(Socket *socket, int clientFD, const struct sockaddr_in &addr)
+{
+	LOG_DEBUG("[Server::_handleClientConnection] New client connected on file descriptor %d", clientFD);
+	if ((size_t)clientFD >= this->_clients.size()) // RLIMIT_NOFILE raised since the start
+		this->_clients.resize(clientFD + 1, NULL);
+	Client *client = new Client(clientFD, socket, this->_timers, addr);
+	this->_clients[clientFD] = client;
+	addSocketEpoll(this->_epollFD, clientFD, REQUEST_FLAGS, EPOLL_TAG_FD(clientFD, EPOLL_TAG_CLIENT));
+}
 
-	// First create the client socket
-	int clientFD = protectedCall(accept(fd, (struct sockaddr *)&addr, &addrLen), "Error with accept function");
-	// Create the new client directly in the map (to be able to clear it if the fcntl fails)
-	this->_clients[clientFD] = new Client(clientFD, this->_sockets[fd]);
-	// Set the client socket to non-blocking. After creating the client because we have to be able to clear the client if the fcntl fails
-	protectedCall(fcntl(clientFD, F_SETFL, O_NONBLOCK), "Error with fcntl function");
-	addSocketEpoll(this->_epollFD, clientFD, REQUEST_FLAGS);
+/**
+ * @brief Out of fds: the reserve fd is given up to accept and close the
+ * connection right away, instead of leaving it in the queue where the
+ * edge-triggered listener would never see it again
+ * 
+ * @return false if the queue was empty
+ */
+bool	Server::_refuseClient(Socket *socket)
+{
+	close(this->_reserveFD);
+	int clientFD = accept(socket->getFd(), NULL, NULL);
+	if (clientFD != -1)
+	{
+		LOG_WARNING("[Server::_handleClientConnection] Too many open files, connection on %s:%d refused", socket->getIp().c_str(), socket->getPort());
+		close(clientFD);
+	}
+	this->_reserveFD = open("/dev/null", O_RDONLY | O_CLOEXEC);
+	return (clientFD != -1);
+}
+
+/**
+ * @brief Accept on a listener once the batch is handled: a client closed
+ * later in the batch frees its fd, a connection accepted meanwhile could
+ * take it and get the events still queued for the old one
+ */
+void	Server::_deferAccept(Socket *socket)
+{
+	if (std::find(this->_acceptPending.begin(), this->_acceptPending.end(), socket) == this->_acceptPending.end())
+		this->_acceptPending.push_back(socket);
+}
+
+/**
+ * @brief Accept on the listeners of the batch, and go on with the ones
+ * stopped by their budget
+ */
+void	Server::_runPendingAccepts(void)
+{
+	std::vector<Socket *> pending;
+
+	pending.swap(this->_acceptPending);
+	for (size_t i = 0; i < pending.size(); i++)
+		this->_handleClientConnection(pending[i]);
 }
 
 /**
@@ -92,80 +323,231 @@ void	Server::_handleClientConnection(int fd)
  */
 void	Server::_handleClientDisconnection(int fd)
 {
-	Logger::log(Logger::DEBUG, "[Server::_handleClientDisconnection] Client disconnected on file descriptor %d", fd);
+	LOG_DEBUG("[Server::_handleClientDisconnection] Client disconnected on file descriptor %d", fd);
 	deleteSocketEpoll(this->_epollFD, fd);
-	std::map<int, Client*>::iterator it = this->_clients.find(fd);
-	if (it != this->_clients.end())
+	if (fd >= 0 && (size_t)fd < this->_clients.size())
 	{
-		delete it->second;
-		this->_clients.erase(it);
+		delete this->_clients[fd];
+		this->_clients[fd] = NULL;
 	}
 }
 
 
 /**
  * @brief Handle the event that occured on the file descriptor
+ * the epoll data is the tagged owner of the fd, or the fd of the client
+ * owning it: a client is looked up in the table, as an event earlier in
+ * the batch (CGI, disk I/O) may have deleted it. No client is accepted
+ * during the batch, so its fd is not reused before the batch ends
  */
 void Server::handleEvent(epoll_event *events, int i){
 	uint32_t event = events[i].events;
-	int fd = events[i].data.fd;
-	
+	void *data = events[i].data.ptr;
+
+	switch (EPOLL_TAG_OF(data))
+	{
+		case EPOLL_TAG_WATCH:
+			if (EPOLL_UNTAG(data) == &this->_diskIo)
+				return (this->_handleDiskIo());
+			return (this->_fileCache.handleWatchEvents());
+		case EPOLL_TAG_FASTCGI:
+			return (static_cast<FastCgiWorker *>(EPOLL_UNTAG(data))->handleEvent(event));
+		case EPOLL_TAG_SIGNAL:
+			return (this->_handleChildSignal());
+		case EPOLL_TAG_CGI_STDIN:
+		case EPOLL_TAG_CGI_STDOUT:
+		case EPOLL_TAG_CGI_EXIT:
+			return (this->_handleCgiEvent(EPOLL_UNTAG_FD(data), EPOLL_TAG_OF(data), event));
+		case EPOLL_TAG_SOCKET:
+			if (event & EPOLLIN) // New client connections, accepted after the batch
+				this->_deferAccept(static_cast<Socket *>(EPOLL_UNTAG(data)));
+			return ;
+		default:
+		{
+			Client *client = this->getClient(EPOLL_UNTAG_FD(data));
+			if (client != NULL)
+				this->_handleClientEvent(client, event);
+			return ;
+		}
+	}
+}
+
+/**
+ * @brief Handle the event of a connected client
+ */
+void Server::_handleClientEvent(Client *client, uint32_t event)
+{
+	int fd = client->getFd();
+
 	try {
 
 		if (event & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) // Error with the file descriptor
 			throw Client::DisconnectedException();
 		if (event & EPOLLIN){
-			if (this->_clients.find(fd) == this->_clients.end()) // New client connection
-				_handleClientConnection(fd);
-			else{
-				this->_clients[fd]->updateLastActivity();
-				this->_clients[fd]->handleRequest();
-			}
+			client->updateLastActivity();
+			client->handleRequest();
 		}
 		if (event & EPOLLOUT){
-			this->_clients[fd]->updateLastActivity();
-			this->_clients[fd]->checkCgi();
-			if (this->_clients[fd]->getRequest() && this->_clients[fd]->getRequest()->getState() == Request::FINISH)
-				this->_clients[fd]->handleResponse(this->_epollFD);
+			client->updateLastActivity();
+			if (!client->getOutput().empty() || (client->getRequest() && client->getRequest()->canRespond()))
+				client->handleResponse(this->_epollFD);
 		}
 	} catch (ChildProcessException &e) { // Child process error (CGI)
 		throw ChildProcessException();
 	} catch (Client::DisconnectedException &e) { // Client disconnected
 		this->_handleClientDisconnection(fd);
 	} catch (const std::exception &e) { // Other exceptions
-		Logger::log(Logger::ERROR, "[Server::handleEvent] Error with client %d : %s", fd, e.what());
+		LOG_ERROR("[Server::handleEvent] Error with client %d : %s", fd, e.what());
 		this->_handleClientDisconnection(fd);
 	}
 }
 
+/**
+ * @brief Handle the event of a CGI pipe, found through the fd of its client:
+ * a CGI deleted earlier in the batch (client gone, reset) is not found
+ */
+void Server::_handleCgiEvent(int fd, int tag, uint32_t event)
+{
+	Client *client = this->getClient(fd);
+
+	if (client == NULL || client->getRequest()->getCgi().getExecutor() == NULL)
+		return ;
+	try {
+		client->getRequest()->getCgi().getExecutor()->handleEvent(tag, event);
+	} catch (const std::exception &e) {
+		LOG_ERROR("[Server::handleEvent] Error with the CGI of client %d : %s", fd, e.what());
+		this->_handleClientDisconnection(fd);
+	}
+}
 
 /**
- * @brief Check the timeouts of the clients
- * 
+ * @brief Hand the finished disk operations to their clients. A client
+ * disconnected by one of them detaches its other operations of the batch
  */
-void	Server::_checkTimeouts(time_t currentTime)
+void Server::_handleDiskIo(void)
 {
-	std::map<int, Client*>::iterator it = this->_clients.begin();
-	while (it != this->_clients.end())
+	std::vector<DiskIo::Op *> done;
+
+	this->_diskIo.reap(done);
+	for (size_t i = 0; i < done.size(); i++)
 	{
-		it->second->getRequest()->checkTimeout();
-		if (currentTime - it->second->getLastActivity() > INACTIVITY_TIMEOUT)
+		Client *client = done[i]->client;
+		if (client == NULL)
 		{
-			Logger::log(Logger::DEBUG, "[Server::_checkTimeouts] Client %d timed out", it->first);
-			deleteSocketEpoll(this->_epollFD, it->first);
-			delete it->second;
-			this->_clients.erase(it++);
+			this->_diskIo.release(done[i]);
+			continue ;
+		}
+		int fd = client->getFd();
+		try {
+			client->handleDiskIo(*done[i]);
+		} catch (ChildProcessException &e) {
+			this->_diskIo.release(done[i]);
+			throw ChildProcessException();
+		} catch (Client::DisconnectedException &e) {
+			this->_handleClientDisconnection(fd);
+		} catch (const std::exception &e) {
+			LOG_ERROR("[Server::handleEvent] Error with client %d : %s", fd, e.what());
+			this->_handleClientDisconnection(fd);
+		}
+		this->_diskIo.release(done[i]);
+	}
+}
+
+/**
+ * @brief A child exited: with SIGCHLD every CGI process watched through it
+ * checks if it is the one. The CGI may delete others (client reset), so a
+ * copy is walked
+ */
+void Server::_handleChildSignal(void)
+{
+	struct signalfd_siginfo	info;
+
+	if (this->_signalFD != -1)
+	{
+		while (read(this->_signalFD, &info, sizeof(info)) == sizeof(info))
+			;
+		std::vector<std::pair<pid_t, int> > children(this->_children.begin(), this->_children.end());
+		for (size_t i = 0; i < children.size(); i++)
+			this->_handleCgiEvent(children[i].second, EPOLL_TAG_CGI_EXIT, 0);
+	}
+	this->_reapOrphans();
+}
+
+/**
+ * @brief Collect the killed CGI processes which exited
+ */
+void Server::_reapOrphans(void)
+{
+	for (size_t i = 0; i < this->_orphans.size(); )
+	{
+		if (waitpid(this->_orphans[i].first, NULL, WNOHANG) == 0)
+		{
+			i++;
+			continue ;
+		}
+		if (this->_orphans[i].second != -1)
+		{
+			deleteSocketEpoll(this->_epollFD, this->_orphans[i].second);
+			close(this->_orphans[i].second);
+		}
+		this->_orphans[i] = this->_orphans.back();
+		this->_orphans.pop_back();
+	}
+}
+
+/**
+ * @brief Watch a CGI process through SIGCHLD, no pidfd could be opened
+ */
+void Server::watchChild(pid_t pid, int fd)
+{
+	if (this->_signalFD == -1)
+		LOG_WARNING("[Server] No pidfd for CGI process %d, its exit is noticed on timeout", pid);
+	this->_children[pid] = fd;
+}
+
+void Server::unwatchChild(pid_t pid)
+{
+	this->_children.erase(pid);
+}
+
+/**
+ * @brief Take over a CGI process killed with its request, its pidfd (if
+ * any) now wakes the server to reap it
+ */
+void Server::adoptChild(pid_t pid, int pidFd)
+{
+	if (pidFd != -1)
+		modifySocketEpoll(this->_epollFD, pidFd, EPOLLIN, EPOLL_TAG(this, EPOLL_TAG_SIGNAL));
+	this->_orphans.push_back(std::make_pair(pid, pidFd));
+}
+
+/**
+ * @brief Handle the clients whose timer is due, only them
+ * the request timeout turns into a 408/504, the inactivity one disconnects,
+ * otherwise the timer is armed again on the next deadline
+ */
+void	Server::_expireTimers(void)
+{
+	std::vector<TimerWheel::Timer *> expired;
+
+	this->_timers.expire(Clock::now(), expired);
+	for (size_t i = 0; i < expired.size(); i++)
+	{
+		Client *client = static_cast<Client *>(expired[i]->data);
+		client->getRequest()->checkTimeout();
+		if (Clock::now() - client->getLastActivity() >= INACTIVITY_TIMEOUT * 1000)
+		{
+			LOG_DEBUG("[Server::_expireTimers] Client %d timed out", client->getFd());
+			this->_handleClientDisconnection(client->getFd());
 		}
 		else
-			++it;
+			client->armTimer();
 	}
 }
 
 /**
- * @brief Main loop of Webserv
- * listen with epoll_wait an event and then handle it
- * either it's a new connection either it's already a knowned client	
- * 
+ * @brief Run Webserv
+ * a single reactor in this process, or a master supervising the workers
  */
 void Server::run(void)
 {
@@ -173,24 +555,121 @@ void Server::run(void)
 		Logger::log(Logger::FATAL, "Server is not ready to run");
 	this->setState(S_STATE_RUN);
 
-	time_t lastTimeoutCheck = time(NULL);
+	if (this->_configParser.getWorkers() > 1)
+		return (this->_runMaster());
+	this->_runReactor();
+}
 
+/**
+ * @brief Main loop of a reactor
+ * listen with epoll_wait an event and then handle it
+ * either it's a new connection either it's already a knowned client	
+ * 
+ */
+void Server::_runReactor(void)
+{
 	epoll_event	events[MAX_EVENTS];
 	while (this->getState() == S_STATE_RUN)
 	{
-		int nfds = protectedCall(epoll_wait(this->_epollFD, events, MAX_EVENTS, SERVER_DEFAULT_EPOLL_WAIT), "Error with epoll_wait function");
-		Logger::log(Logger::DEBUG, "[Server::run] There are %d file descriptors ready for I/O after epoll wait", nfds);
+		// Sleep until the next deadline, forever when no timer is armed, not at all with connections left to accept
+		int timeout = this->_acceptPending.empty() ? this->_timers.nextTimeout(Clock::now()) : 0;
+		int nfds = epoll_wait(this->_epollFD, events, MAX_EVENTS, timeout);
+		Clock::update();
+		if (nfds == -1 && errno == EINTR) // Interrupted by a signal (stop)
+			continue ;
+		protectedCall(nfds, "Error with epoll_wait function");
+		LOG_DEBUG("[Server::run] There are %d file descriptors ready for I/O after epoll wait", nfds);
 		
 		for (int i = 0; i < nfds; i++)
 			handleEvent(events, i);
+		this->_runPendingAccepts();
+
+		this->_expireTimers();
+	}
+}
+
+/*
+** --------------------------------- WORKERS ---------------------------------
+*/
+
+/**
+ * @brief Fork the workers and supervise them
+ * every worker owns its epoll instance, its clients and its SO_REUSEPORT
+ * copy of each listening socket. A worker killed by a signal is respawned,
+ * a worker which exits by itself (bind failure, fatal error) is not
+ * 
+ * The forked workers return from here straight into their own reactor loop
+ */
+void Server::_runMaster(void)
+{
+	size_t	nbWorkers = this->_configParser.getWorkers();
+
+	this->_workers.assign(nbWorkers, -1);
+	for (size_t i = 0; i < nbWorkers && this->getState() == S_STATE_RUN; i++)
+		if (this->_spawnWorker(i) == 0)
+			return (this->_runReactor());
+	LOG_INFO("Master process started %d workers", (int)nbWorkers);
 
-		time_t currentTime = time(NULL);
-		if (currentTime - lastTimeoutCheck >= TIMEOUT_CHECK_INTERVAL)
+	size_t	alive = nbWorkers;
+	while (alive > 0)
+	{
+		int		status;
+		pid_t	pid = waitpid(-1, &status, 0);
+		if (pid == -1)
 		{
-			this->_checkTimeouts(currentTime);
-			lastTimeoutCheck = currentTime;
+			if (errno == EINTR)
+				continue ;
+			break ;
 		}
+		std::vector<pid_t>::iterator it = std::find(this->_workers.begin(), this->_workers.end(), pid);
+		if (it == this->_workers.end())
+			continue ;
+		*it = -1;
+		alive--;
+		if (this->getState() != S_STATE_RUN || !WIFSIGNALED(status))
+		{
+			LOG_INFO("Worker %d exited with status %d", pid, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+			continue ;
+		}
+		LOG_ERROR("Worker %d killed by signal %d, respawning", pid, WTERMSIG(status));
+		if (this->_spawnWorker(it - this->_workers.begin()) == 0)
+			return (this->_runReactor());
+		alive++;
+	}
+	if (this->getState() == S_STATE_RUN)
+		LOG_ERROR("All workers exited");
+}
+
+/**
+ * @brief Fork one worker and set up its reactor
+ * 
+ * @return pid_t : 0 in the worker, the pid of the worker in the master
+ */
+pid_t Server::_spawnWorker(size_t index)
+{
+	pid_t pid = protectedCall(fork(), "Failed to fork worker");
+	if (pid == 0)
+	{
+		this->_isWorker = true;
+		this->_workers.clear();
+		Logger::start(); // The writer thread of the master is not copied
+		this->_initReactor(true);
+		LOG_DEBUG("[Server::_spawnWorker] Worker %d ready", (int)index);
+		return (0);
 	}
+	this->_workers[index] = pid;
+	return (pid);
+}
+
+/**
+ * @brief Forward the stop to the workers (only the master knows them)
+ * Called from the signal handler, so it only uses kill
+ */
+void Server::_stopWorkers(void)
+{
+	for (size_t i = 0; i < this->_workers.size(); i++)
+		if (this->_workers[i] > 0)
+			kill(this->_workers[i], SIGINT);
 }
 
 /*
@@ -200,12 +679,12 @@ void Server::run(void)
 void	Server::setState(int state)
 {
 	if (state == S_STATE_INIT)
-		Logger::log(Logger::INFO, "Parsing completed");
+		LOG_INFO("Parsing completed");
 	else if (state == S_STATE_READY)
-		Logger::log(Logger::INFO, "Server is ready to run");
+		LOG_INFO("Server is ready to run");
 	else if (state == S_STATE_RUN)
-		Logger::log(Logger::INFO, "Server is running");
+		LOG_INFO("Server is running");
 	else if (state == S_STATE_STOP)
-		Logger::log(Logger::INFO, "Server is stopping...");
+		LOG_INFO("Server is stopping...");
 	this->_state = state;
 }
@@ -7,6 +7,9 @@
 # include <sys/epoll.h>
 # include <arpa/inet.h>
 # include <algorithm>
+# include <sys/wait.h>
+# include <sys/resource.h>
+# include <sys/signalfd.h>
 
 # include "ConfigParser.hpp"
 # include "Socket.hpp"
@@ -15,10 +18,15 @@
 # include "Response.hpp"
 # include "Utils.hpp"
 # include "Request.hpp"
+# include "FileCache.hpp"
+# include "TimerWheel.hpp"
+# include "Clock.hpp"
+# include "FastCgiPool.hpp"
+# include "DiskIo.hpp"
+
+# define SERVER_DEFAULT_MAX_FDS 65536 // Connection table size when RLIMIT_NOFILE is unlimited
+# define SERVER_ACCEPT_BUDGET 64 // Connections accepted per listener and loop iteration
 
-# define SERVER_DEFAULT_EPOLL_WAIT 500
-#define TIMEOUT_CHECK_INTERVAL 5 // seconds
-#define INACTIVITY_TIMEOUT 60 // seconds
 
 //#define TIMEOUT_CGI_CHECK_INTERVAL 1 // seconds
 #define TIMEOUT_CGI 30 // seconds
@@ -38,24 +46,57 @@ class Server
 		int						_state;
 		int 					_epollFD;
 		ConfigParser			_configParser;
-		std::map<int, Socket*>	_sockets;
-		std::map<int, Client*>	_clients;
+		bool					_isWorker;
+		std::vector<pid_t>		_workers;
+		std::vector<Socket*>	_sockets; // Listening sockets
+		std::vector<Socket*>	_acceptPending; // Listeners to accept on after the batch
+		int						_reserveFD; // Spare fd given up to refuse a connection on EMFILE
+		std::vector<Client*>	_clients; // Indexed by fd, NULL if none
+		FileCache				_fileCache;
+		DiskIo					_diskIo;
+		TimerWheel				_timers;
+		std::map<std::string, FastCgiPool*>	_fastCgiPools; // By application command
+		int						_signalFD; // SIGCHLD, -1 when the CGI processes are watched through pidfds
+		std::map<pid_t, int>	_children; // CGI processes watched through SIGCHLD: pid -> client fd
+		std::vector<std::pair<pid_t, int> >	_orphans; // CGI processes killed with their request and their pidfd, reaped once they exit
 
 		/* SETTERS */
 		void setState(int state);
 		void setEpollFD(int epollFD) { _epollFD = epollFD; }
 
 		/* UTILS */
-		void _checkTimeouts(time_t currentTime);
+		void _expireTimers(void);
 
 		// void sendResponse(Client* client);
 		void handleEvent(epoll_event *events, int i);
 
 
 		/* HANDLE */
-		void	_handleClientConnection(int fd);
+		void	_handleClientConnection(Socket *socket);
+		void	_deferAccept(Socket *socket);
+		void	_acceptClient(Socket *socket, int clientFD, const struct sockaddr_in &addr);
+		bool	_refuseClient(Socket *socket);
+		void	_runPendingAccepts(void);
+		void	_handleClientEvent(Client *client, uint32_t event);
+		void	_handleCgiEvent(int fd, int tag, uint32_t event);
+		void	_handleChildSignal(void);
+		void	_handleDiskIo(void);
+		void	_reapOrphans(void);
 		void	_handleClientDisconnection(int fd);
 
+		/* REACTOR */
+		void	_initReactor(bool reusePort);
+		void	_runReactor(void);
+		void	_initFileCache(void);
+		void	_initFastCgi(void);
+		void	_initChildWatch(void);
+		void	_initDiskIo(void);
+
+		/* WORKERS */
+		void	_runMaster(void);
+		pid_t	_spawnWorker(size_t index);
+		void	_stopWorkers(void);
+
 	public:
 
 
@@ -65,15 +106,24 @@ class Server
 		void init(void);
 		void run(void);
 		void stop(void);
+		void reopenLogs(void);
 
 		/* GETTERS */
 		int getState(void) const { return _state; }
 		int getEpollFD(void) const { return _epollFD; }
+		bool isWorker(void) const { return _isWorker; }
 		ConfigParser& getConfigParser(void) { return _configParser; }
-		std::map<int, Socket*> getSockets(void) const { return _sockets; }
-		Socket* getSocket(int fd) { return _sockets[fd]; }
-		std::map<int, Client*> getClients(void) const { return _clients; }
-		Client* getClient(int fd) { return _clients[fd]; }
+		const std::vector<Socket*>& getSockets(void) const { return _sockets; }
+		Client* getClient(int fd) const { return (fd >= 0 && (size_t)fd < _clients.size()) ? _clients[fd] : NULL; }
+		FileCache& getFileCache(void) { return _fileCache; }
+		TimerWheel& getTimers(void) { return _timers; }
+		DiskIo& getDiskIo(void) { return _diskIo; }
+		FastCgiPool* getFastCgiPool(const std::string &command);
+
+		/* CHILDREN */
+		void	watchChild(pid_t pid, int fd);
+		void	unwatchChild(pid_t pid);
+		void	adoptChild(pid_t pid, int pidFd);
 };
 
 
@@ -4,9 +4,9 @@ Socket::Socket(void) : _fd(-1)
 {
 }
 
-Socket::Socket(int fd, std::string ip, unsigned int port, std::vector<BlocServer>* servers) : _fd(fd), _ip(ip), _port(port), _servers(servers)
+Socket::Socket(int fd, std::string ip, unsigned int port, std::vector<BlocServer>* servers, int backlog, bool reusePort) : _fd(fd), _ip(ip), _port(port), _portEnv("SERVER_PORT=" + intToString(port)), _servers(servers)
 {
-	Logger::log(Logger::INFO, "Initializing socket on %s:%d", ip.c_str(), port);
+	LOG_INFO("Initializing socket on %s:%d", ip.c_str(), port);
 	try {
 		this->_addr.sin_family = AF_INET;
 		this->_addr.sin_port = htons(port);
@@ -14,8 +14,11 @@ Socket::Socket(int fd, std::string ip, unsigned int port, std::vector<BlocServer
 		protectedCall(fcntl(this->_fd, F_SETFL, O_NONBLOCK), "[Socket] Failed to set socket to non-blocking");
 		int optval = 1;
 		protectedCall(setsockopt(this->_fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(int)), "[Socket] Failed to set socket options");
+		// Each worker binds its own copy of the listener, the kernel balances the accepts between them
+		if (reusePort)
+			protectedCall(setsockopt(this->_fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(int)), "[Socket] Failed to set SO_REUSEPORT");
 		protectedCall(bind(this->_fd, (struct sockaddr *)&this->_addr, sizeof(this->_addr)), "[Socket] Failed to bind socket");
-		protectedCall(listen(this->_fd, BACKLOGS), "[Socket] Failed to listen on socket");	}
+		protectedCall(listen(this->_fd, backlog), "[Socket] Failed to listen on socket");	}
 	catch (std::exception &e) {
 		if (this->_fd != -1)
 			protectedCall(close(this->_fd), "[Socket] Faild to close socket", false);
@@ -40,6 +43,7 @@ Socket &Socket::operator=(const Socket &rhs)
 	{
 		this->_ip = rhs._ip;
 		this->_port = rhs._port;
+		this->_portEnv = rhs._portEnv;
 		this->_fd = rhs._fd;
 		this->_servers = rhs._servers;
 		this->_addr = rhs._addr;
@@ -9,8 +9,6 @@
 # include "Utils.hpp"
 # include "BlocServer.hpp"
 
-#define BACKLOGS 100
-
 
 class Socket
 {
@@ -18,11 +16,12 @@ class Socket
 		int							_fd;
 		std::string					_ip;
 		unsigned int				_port;
+		std::string					_portEnv; // SERVER_PORT of the CGIs, built once
 		std::vector<BlocServer>*	_servers;
 		struct sockaddr_in			_addr;
 	public:
 		Socket(void);
-		Socket(int fd, std::string ip, unsigned int port, std::vector<BlocServer>* servers);
+		Socket(int fd, std::string ip, unsigned int port, std::vector<BlocServer>* servers, int backlog, bool reusePort = false);
 		Socket(Socket const &src);
 		~Socket(void);
 
@@ -31,6 +30,7 @@ class Socket
 		/* GETTERS */
 		std::string getIp(void) const { return _ip; }
 		unsigned int getPort(void) const { return _port; }
+		const std::string &getPortEnv(void) const { return _portEnv; }
 		int getFd(void) const { return _fd; }
 		std::vector<BlocServer>* getServers(void) const { return _servers; }
 		struct sockaddr_in getAddr(void) const { return _addr; }
@@ -0,0 +1,162 @@
+#include "TimerWheel.hpp"
+
+/*
+** ------------------------------- CONSTRUCTOR --------------------------------
+*/
+
+TimerWheel::TimerWheel(void) : _tick(0), _count(0)
+{
+	for (int level = 0; level < 2; level++)
+		for (int i = 0; i < TW_SLOTS; i++)
+			this->_wheel[level][i].prev = this->_wheel[level][i].next = &this->_wheel[level][i];
+}
+
+/*
+** -------------------------------- DESTRUCTOR --------------------------------
+*/
+
+TimerWheel::~TimerWheel(void)
+{
+}
+
+/*
+** --------------------------------- METHODS ----------------------------------
+*/
+
+/*
+** @brief Align the wheel on the clock, before arming anything
+*/
+void	TimerWheel::start(uint64_t now)
+{
+	this->_tick = now / TW_TICK;
+}
+
+/*
+** @brief Arm the timer, or move it if already armed
+*/
+void	TimerWheel::arm(Timer &timer, uint64_t deadline)
+{
+	if (timer.isArmed())
+		TimerWheel::_unlink(timer);
+	else
+		this->_count++;
+	timer.deadline = deadline;
+	this->_insert(timer);
+}
+
+void	TimerWheel::cancel(Timer &timer)
+{
+	if (!timer.isArmed())
+		return ;
+	TimerWheel::_unlink(timer);
+	this->_count--;
+}
+
+/*
+** @brief Run the wheel up to now and collect the timers due
+** the collected timers are disarmed, and can be armed again right away
+*/
+void	TimerWheel::expire(uint64_t now, std::vector<Timer *> &expired)
+{
+	uint64_t target = now / TW_TICK;
+
+	if (this->_count == 0) // Nothing to move, jump
+	{
+		if (target >= this->_tick)
+			this->_tick = target + 1;
+		return ;
+	}
+	while (this->_tick <= target)
+	{
+		if ((this->_tick & TW_MASK) == 0)
+			this->_cascade();
+		Timer &head = this->_wheel[0][this->_tick & TW_MASK];
+		while (head.next != &head)
+		{
+			Timer *timer = head.next;
+			TimerWheel::_unlink(*timer);
+			this->_count--;
+			expired.push_back(timer);
+		}
+		this->_tick++;
+	}
+}
+
+/*
+** @brief Milliseconds epoll may sleep before the next timer is due
+**
+** @return -1 if no timer is armed
+*/
+int	TimerWheel::nextTimeout(uint64_t now) const
+{
+	if (this->_count == 0)
+		return (-1);
+
+	uint64_t	tick = this->_tick;
+	uint64_t	limit = tick + TW_SLOTS - (tick & TW_MASK); // Next cascade
+	for (; tick < limit; tick++)
+	{
+		const Timer &head = this->_wheel[0][tick & TW_MASK];
+		if (head.next != &head)
+			break ;
+	}
+	uint64_t due = tick * TW_TICK;
+	return (due <= now ? 0 : (int)(due - now));
+}
+
+/*
+** --------------------------------- PRIVATE ----------------------------------
+*/
+
+void	TimerWheel::_insert(Timer &timer)
+{
+	uint64_t tick = timer.deadline / TW_TICK;
+
+	if (tick < this->_tick)
+		tick = this->_tick;
+	uint64_t delta = tick - this->_tick;
+	if (delta < (uint64_t)(TW_SLOTS - (this->_tick & TW_MASK))) // Before the next cascade
+		return (TimerWheel::_link(this->_wheel[0][tick & TW_MASK], timer));
+	if (delta >= (uint64_t)(TW_SLOTS - 1) * TW_SLOTS) // Out of reach, parked
+		tick = this->_tick + (uint64_t)(TW_SLOTS - 1) * TW_SLOTS;
+	TimerWheel::_link(this->_wheel[1][(tick >> TW_BITS) & TW_MASK], timer);
+}
+
+/*
+** @brief Move the level 1 slot of the current round down to level 0
+*/
+void	TimerWheel::_cascade(void)
+{
+	Timer &head = this->_wheel[1][(this->_tick >> TW_BITS) & TW_MASK];
+	Timer list;
+
+	if (head.next == &head)
+		return ;
+	// Detach the whole slot first, a parked timer may go back into it
+	list.next = head.next;
+	list.prev = head.prev;
+	list.next->prev = &list;
+	list.prev->next = &list;
+	head.next = head.prev = &head;
+	while (list.next != &list)
+	{
+		Timer *timer = list.next;
+		TimerWheel::_unlink(*timer);
+		this->_insert(*timer);
+	}
+}
+
+void	TimerWheel::_link(Timer &head, Timer &timer)
+{
+	timer.prev = head.prev;
+	timer.next = &head;
+	head.prev->next = &timer;
+	head.prev = &timer;
+}
+
+void	TimerWheel::_unlink(Timer &timer)
+{
+	timer.prev->next = timer.next;
+	timer.next->prev = timer.prev;
+	timer.prev = timer.next = NULL;
+}
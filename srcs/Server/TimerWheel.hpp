@@ -0,0 +1,63 @@
+#ifndef TIMERWHEEL_HPP
+# define TIMERWHEEL_HPP
+
+# include <vector>
+# include <cstddef>
+# include <stdint.h>
+
+# define TW_TICK 100 // ms, resolution of the deadlines
+# define TW_BITS 8
+# define TW_SLOTS (1 << TW_BITS) // Slots per level: 25.6s in level 0, ~109min in level 1
+# define TW_MASK (TW_SLOTS - 1)
+
+/*
+** Two level hierarchical timing wheel.
+** A timer sits in the level 0 slot of its tick when due within TW_SLOTS
+** ticks, otherwise in the level 1 slot of its tick / TW_SLOTS, and is
+** moved down (cascaded) when level 0 wraps. Farther deadlines are parked in
+** the last reachable slot and cascaded again until they are close enough.
+** Timers are intrusive doubly linked nodes: arm, re-arm and cancel are O(1)
+** and never allocate.
+*/
+class TimerWheel
+{
+	public:
+		struct Timer
+		{
+			Timer*		prev;
+			Timer*		next;
+			uint64_t	deadline; // ms, Clock::now() base
+			void*		data;
+
+			Timer(void) : prev(NULL), next(NULL), deadline(0), data(NULL) {}
+			bool	isArmed(void) const { return next != NULL; }
+		};
+
+	private:
+		Timer		_wheel[2][TW_SLOTS]; // List heads
+		uint64_t	_tick; // Next tick to expire
+		size_t		_count;
+
+		void	_insert(Timer &timer);
+		void	_cascade(void);
+		static void	_link(Timer &head, Timer &timer);
+		static void	_unlink(Timer &timer);
+
+		TimerWheel(const TimerWheel &src);
+		TimerWheel &operator=(const TimerWheel &rhs);
+
+	public:
+		TimerWheel(void);
+		~TimerWheel(void);
+
+		void	start(uint64_t now);
+		void	arm(Timer &timer, uint64_t deadline);
+		void	cancel(Timer &timer);
+		void	expire(uint64_t now, std::vector<Timer *> &expired);
+		int		nextTimeout(uint64_t now) const;
+
+		/* GETTERS */
+		size_t	size(void) const { return _count; }
+};
+
+#endif // TIMERWHEEL_HPP
@@ -0,0 +1,19 @@
+#include "Clock.hpp"
+
+uint64_t	Clock::_now = 0;
+time_t		Clock::_wall = 0;
+uint64_t	Clock::_wallMs = 0;
+
+/*
+** @brief Read the clocks, once per loop iteration
+*/
+void	Clock::update(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	Clock::_now = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	Clock::_wall = ts.tv_sec;
+	Clock::_wallMs = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,31 @@
+#ifndef CLOCK_HPP
+# define CLOCK_HPP
+
+# include <ctime>
+# include <stdint.h>
+
+/*
+** Time cached once per reactor loop iteration, so the code handling the
+** events reads it without a syscall.
+** now() is monotonic, in milliseconds, for deadlines and durations;
+** wall() is the real time, in seconds, for what is shown to humans,
+** wallMs() the same in milliseconds.
+*/
+class Clock
+{
+	private:
+		static uint64_t	_now;
+		static time_t	_wall;
+		static uint64_t	_wallMs;
+
+		Clock(void);
+
+	public:
+		static void		update(void);
+
+		static uint64_t	now(void) { return _now; }
+		static time_t	wall(void) { return _wall; }
+		static uint64_t	wallMs(void) { return _wallMs; }
+};
+
+#endif // CLOCK_HPP
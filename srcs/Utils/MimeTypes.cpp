@@ -0,0 +1,140 @@
+#include "MimeTypes.hpp"
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+/*
+** Sorted by extension (strcmp order), find() relies on it
+*/
+const MimeTypes::Entry	MimeTypes::_builtin[] = {
+	{"avi", "video/x-msvideo"},
+	{"css", "text/css"},
+	{"csv", "text/csv"},
+	{"eot", "application/vnd.ms-fontobject"},
+	{"gif", "image/gif"},
+	{"gz", "application/gzip"},
+	{"htm", "text/html"},
+	{"html", "text/html"},
+	{"ico", "image/x-icon"},
+	{"jpeg", "image/jpeg"},
+	{"jpg", "image/jpeg"},
+	{"js", "application/javascript"},
+	{"json", "application/json"},
+	{"mkv", "video/x-matroska"},
+	{"mp3", "audio/mpeg"},
+	{"mp4", "video/mp4"},
+	{"mpeg", "video/mpeg"},
+	{"ogg", "video/ogg"},
+	{"otf", "font/otf"},
+	{"pdf", "application/pdf"},
+	{"png", "image/png"},
+	{"svg", "image/svg+xml"},
+	{"tar", "application/x-tar"},
+	{"ttf", "font/ttf"},
+	{"txt", "text/plain"},
+	{"webm", "video/webm"},
+	{"webmanifest", "application/manifest+json"},
+	{"webp", "image/webp"},
+	{"woff", "font/woff"},
+	{"woff2", "font/woff2"},
+	{"xhtml", "application/xhtml+xml"},
+	{"xml", "application/xml"},
+	{"zip", "application/zip"},
+};
+const size_t	MimeTypes::_builtinCount = sizeof(MimeTypes::_builtin) / sizeof(MimeTypes::_builtin[0]);
+std::vector<MimeTypes::CustomEntry>	MimeTypes::_custom;
+
+bool	MimeTypes::_lessCustom(const CustomEntry &lhs, const CustomEntry &rhs)
+{
+	return (lhs.extension < rhs.extension);
+}
+
+bool	MimeTypes::_lessKey(const CustomEntry &lhs, const char *extension)
+{
+	return (lhs.extension.compare(extension) < 0);
+}
+
+/*
+** @brief An extension of a types block: not empty, fits the lookup buffer,
+** no dot nor slash
+*/
+bool	MimeTypes::isValidExtension(const std::string &extension)
+{
+	if (extension.empty() || extension.size() > MIME_EXTENSION_MAX)
+		return (false);
+	for (size_t i = 0; i < extension.size(); i++)
+		if (!std::isalnum(static_cast<unsigned char>(extension[i])) && extension[i] != '-' && extension[i] != '_' && extension[i] != '+')
+			return (false);
+	return (true);
+}
+
+/*
+** @brief Add an entry of the types block, compile() must follow
+*/
+void	MimeTypes::add(const std::string &extension, const std::string &type)
+{
+	CustomEntry entry;
+
+	for (size_t i = 0; i < extension.size(); i++)
+		entry.extension.push_back(std::tolower(static_cast<unsigned char>(extension[i])));
+	entry.type = type;
+	_custom.push_back(entry);
+}
+
+/*
+** @brief Sort the entries of the types block, the last definition of an
+** extension wins
+*/
+void	MimeTypes::compile(void)
+{
+	std::stable_sort(_custom.begin(), _custom.end(), MimeTypes::_lessCustom);
+	std::vector<CustomEntry> unique;
+	for (size_t i = 0; i < _custom.size(); i++)
+	{
+		if (!unique.empty() && unique.back().extension == _custom[i].extension)
+			unique.back() = _custom[i];
+		else
+			unique.push_back(_custom[i]);
+	}
+	_custom.swap(unique);
+}
+
+/*
+** @brief The MIME type of a path from its extension, the types block first
+** then the built-in table, MIME_DEFAULT_TYPE if none matches
+*/
+const char*	MimeTypes::find(const std::string &path)
+{
+	char extension[MIME_EXTENSION_MAX + 1];
+
+	size_t dot = path.rfind('.');
+	if (dot == std::string::npos || path.find('/', dot) != std::string::npos || path.size() - dot - 1 > MIME_EXTENSION_MAX)
+		return (MIME_DEFAULT_TYPE);
+	size_t length = path.size() - dot - 1;
+	for (size_t i = 0; i < length; i++)
+		extension[i] = std::tolower(static_cast<unsigned char>(path[dot + 1 + i]));
+	extension[length] = '\0';
+
+	if (!_custom.empty())
+	{
+		std::vector<CustomEntry>::const_iterator it = std::lower_bound(_custom.begin(), _custom.end(), extension, MimeTypes::_lessKey);
+		if (it != _custom.end() && it->extension == extension)
+			return (it->type.c_str());
+	}
+
+	size_t low = 0;
+	size_t high = _builtinCount;
+	while (low < high)
+	{
+		size_t middle = (low + high) / 2;
+		int cmp = std::strcmp(extension, _builtin[middle].extension);
+		if (cmp == 0)
+			return (_builtin[middle].type);
+		if (cmp < 0)
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	return (MIME_DEFAULT_TYPE);
+}
@@ -0,0 +1,52 @@
+#ifndef MIMETYPES_HPP
+# define MIMETYPES_HPP
+
+# include <string>
+# include <vector>
+# include <cstddef>
+
+# define MIME_DEFAULT_TYPE "application/octet-stream"
+# define MIME_EXTENSION_MAX 31 // Longer extensions are never looked up
+
+/*
+** MIME types by file extension, case-insensitive.
+** The built-in types are a static table sorted by extension, searched by
+** dichotomy without any allocation. A types block of the config adds or
+** overrides entries: they are compiled into a sorted vector once the config
+** is parsed, and looked up first, by the same lowercase buffer.
+*/
+class MimeTypes
+{
+	public:
+		struct Entry
+		{
+			const char*	extension; // Lowercase, without the dot
+			const char*	type;
+		};
+
+	private:
+		struct CustomEntry
+		{
+			std::string	extension;
+			std::string	type;
+		};
+
+		static const Entry				_builtin[];
+		static const size_t				_builtinCount;
+		static std::vector<CustomEntry>	_custom;
+
+		static bool	_lessCustom(const CustomEntry &lhs, const CustomEntry &rhs);
+		static bool	_lessKey(const CustomEntry &lhs, const char *extension);
+
+		MimeTypes(void);
+	public:
+		static bool			isValidExtension(const std::string &extension);
+		static void			add(const std::string &extension, const std::string &type);
+		static void			compile(void);
+		static const char*	find(const std::string &path);
+
+		/* GETTERS */
+		static size_t		getCustomCount(void) { return _custom.size(); }
+};
+
+#endif // MIMETYPES_HPP
@@ -0,0 +1,47 @@
+#include "SharedBuffer.hpp"
+
+SharedBuffer::SharedBuffer(void) : _block(NULL)
+{
+}
+
+/*
+** @brief Build a buffer from data, taken without copy (swap), data is left empty
+*/
+SharedBuffer::SharedBuffer(std::string &data) : _block(new Block())
+{
+	this->_block->refs = 1;
+	this->_block->data.swap(data);
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer &src) : _block(src._block)
+{
+	if (this->_block)
+		this->_block->refs++;
+}
+
+SharedBuffer::~SharedBuffer(void)
+{
+	this->_release();
+}
+
+SharedBuffer &SharedBuffer::operator=(const SharedBuffer &rhs)
+{
+	if (this->_block != rhs._block)
+	{
+		this->_release();
+		this->_block = rhs._block;
+		if (this->_block)
+			this->_block->refs++;
+	}
+	return *this;
+}
+
+/*
+** @brief Drop this reference, free the block with the last one
+*/
+void	SharedBuffer::_release(void)
+{
+	if (this->_block && --this->_block->refs == 0)
+		delete this->_block;
+	this->_block = NULL;
+}
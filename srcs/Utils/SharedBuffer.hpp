@@ -0,0 +1,39 @@
+#ifndef SHAREDBUFFER_HPP
+# define SHAREDBUFFER_HPP
+
+# include <string>
+# include <cstddef>
+
+/*
+** Immutable reference-counted bytes.
+** Copies share the same block, so a cached body or a canned response can be
+** queued on many clients at once without being copied, and stays alive until
+** the last client has sent it even if its owner drops it meanwhile.
+** Not thread safe: a buffer lives in one reactor.
+*/
+class SharedBuffer
+{
+	private:
+		struct Block
+		{
+			size_t		refs;
+			std::string	data;
+		};
+		Block*	_block;
+
+		void	_release(void);
+	public:
+		SharedBuffer(void);
+		explicit SharedBuffer(std::string &data);
+		SharedBuffer(const SharedBuffer &src);
+		~SharedBuffer(void);
+
+		SharedBuffer &operator=(const SharedBuffer &rhs);
+
+		/* GETTERS */
+		const char*	data(void) const { return _block ? _block->data.data() : NULL; }
+		size_t		size(void) const { return _block ? _block->data.size() : 0; }
+		bool		empty(void) const { return size() == 0; }
+};
+
+#endif // SHAREDBUFFER_HPP
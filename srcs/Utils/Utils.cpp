@@ -1,5 +1,8 @@
 #include "Utils.hpp"
 
+#include <csignal>
+#include <sys/syscall.h>
+
 /*
 ** @brief Create a temporary file
 **
@@ -17,7 +20,7 @@ int	Utils::createTmpFile(std::string &path, int &fd)
 	fd = mkstemp(&tmpPath[0]);
 	if (fd == -1)
 	{
-		Logger::log(Logger::ERROR, "[Utils::createTmpFile] Failed to create temporary file");
+		LOG_ERROR("[Utils::createTmpFile] Failed to create temporary file");
 		return (-1);
 	}
 	path.assign(tmpPath.begin(), tmpPath.end() - 1);
@@ -40,7 +43,7 @@ int Utils::createFileRandomSuffix(std::string &path, int &fd)
 	fd = mkstemp(&tmpPath[0]);
 	if (fd == -1)
 	{
-		Logger::log(Logger::ERROR, "[Utils::createTmpFile] Failed to create temporary file");
+		LOG_ERROR("[Utils::createTmpFile] Failed to create temporary file");
 		return (-1);
 	}
 	path.assign(tmpPath.begin(), tmpPath.end() - 1);
@@ -253,7 +256,7 @@ int protectedCall(int ret, std::string msg, bool isFatal)
 		if (isFatal)
 			Logger::log(Logger::FATAL, msg.c_str());
 		else
-			Logger::log(Logger::ERROR, msg.c_str());
+			LOG_ERROR(msg.c_str());
 	}
 	return ret;
 }
@@ -309,12 +312,13 @@ std::string getExtension(const std::string &path, bool includeDot)
 /**
  * WARNING: this function do not update flags for a socket, it only add socket to 
  * epoll with flags
+ * data is the owner of the fd, tagged with EPOLL_TAG
  */
-void addSocketEpoll(int epollFD, int sockFD, uint32_t flags)
+void addSocketEpoll(int epollFD, int sockFD, uint32_t flags, void *data)
 {
 	epoll_event ev;
 	ev.events = flags;
-	ev.data.fd = sockFD;
+	ev.data.ptr = data;
 	protectedCall(epoll_ctl(epollFD, EPOLL_CTL_ADD, sockFD, &ev), "Error with epoll_ctl function", false);
 }
 
@@ -323,21 +327,49 @@ void addSocketEpoll(int epollFD, int sockFD, uint32_t flags)
  * WARNING: this function over written previous flags
  * 
  */
-void modifySocketEpoll(int epollFD, int sockFD, uint32_t flags)
+void modifySocketEpoll(int epollFD, int sockFD, uint32_t flags, void *data)
 {
 	epoll_event ev;
 	ev.events = flags;
-	ev.data.fd = sockFD;
+	ev.data.ptr = data;
 	protectedCall(epoll_ctl(epollFD, EPOLL_CTL_MOD, sockFD, &ev), "Error with epoll_ctl function", false);
 }
 
 void deleteSocketEpoll(int epollFD, int sockFD)
 {
 	epoll_event ev;
-	ev.data.fd = sockFD;
+	ev.data.ptr = NULL;
 	protectedCall(epoll_ctl(epollFD, EPOLL_CTL_DEL, sockFD, &ev), "Error with epoll_ctl function", false);
 }
 
+/**
+ * @brief Open a pidfd on a child, readable once it exits (Linux 5.3)
+ *
+ * @return the pidfd, close-on-exec, or -1 if the kernel has none
+ */
+int openPidFd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return (syscall(SYS_pidfd_open, pid, 0));
+#else
+	(void)pid;
+	errno = ENOSYS;
+	return (-1);
+#endif
+}
+
+/**
+ * @brief Unblock every signal in a child before its execve, the mask of the
+ * server (SIGCHLD on a signalfd) would be inherited
+ */
+void resetSignalMask(void)
+{
+	sigset_t	none;
+
+	sigemptyset(&none);
+	sigprocmask(SIG_SETMASK, &none, NULL);
+}
+
 std::string getErrorMessage(int code)
 {
 	switch (code)
@@ -391,6 +423,8 @@ std::string getErrorMessage(int code)
 			return "Unsupported Media Type";
 		case 429:
 			return "Too Many Requests";
+		case 431:
+			return "Request Header Fields Too Large";
 
 		// 5xx Server Errors
 		case 500:
@@ -414,56 +448,11 @@ std::string getErrorMessage(int code)
 
 /**
  * @brief Fonction pour obtenir le type MIME basé sur l'extension de fichier
+ * (bloc types de la config puis table statique, voir MimeTypes)
  */
 std::string getMimeType(const std::string &path)
 {
-	std::map<std::string, std::string> mimeTypes;
-
-	mimeTypes[".html"] = "text/html";
-	mimeTypes[".htm"] = "text/html";
-	mimeTypes[".css"] = "text/css";
-	mimeTypes[".js"] = "application/javascript";
-	mimeTypes[".jpg"] = "image/jpeg";
-	mimeTypes[".jpeg"] = "image/jpeg";
-	mimeTypes[".png"] = "image/png";
-	mimeTypes[".gif"] = "image/gif";
-	mimeTypes[".svg"] = "image/svg+xml";
-	mimeTypes[".json"] = "application/json";
-	mimeTypes[".txt"] = "text/plain";
-	mimeTypes[".pdf"] = "application/pdf";
-	mimeTypes[".zip"] = "application/zip";
-	mimeTypes[".tar"] = "application/x-tar";
-	mimeTypes[".gz"] = "application/gzip";
-	mimeTypes[".mp3"] = "audio/mpeg";
-	mimeTypes[".mp4"] = "video/mp4";
-	mimeTypes[".avi"] = "video/x-msvideo";
-	mimeTypes[".mpeg"] = "video/mpeg";
-	mimeTypes[".webm"] = "video/webm";
-	mimeTypes[".ogg"] = "video/ogg";
-	mimeTypes[".ico"] = "image/x-icon";
-	mimeTypes[".webp"] = "image/webp";
-	mimeTypes[".woff"] = "font/woff";
-	mimeTypes[".woff2"] = "font/woff2";
-	mimeTypes[".ttf"] = "font/ttf";
-	mimeTypes[".otf"] = "font/otf";
-	mimeTypes[".eot"] = "application/vnd.ms-fontobject";
-	mimeTypes[".csv"] = "text/csv";
-	mimeTypes[".xml"] = "application/xml";
-	mimeTypes[".xhtml"] = "application/xhtml+xml";
-	mimeTypes[".webmanifest"] = "application/manifest+json";
-	mimeTypes[".ico"] = "image/x-icon";
-	mimeTypes[".mkv"] = "video/x-matroska";
-
-	std::string::size_type idx = path.rfind('.');
-	if (idx != std::string::npos)
-	{
-		std::string ext = path.substr(idx);
-		if (mimeTypes.find(ext) != mimeTypes.end())
-		{
-			return mimeTypes[ext];
-		}
-	}
-	return "application/octet-stream";
+	return (MimeTypes::find(path));
 }
 
 
@@ -471,16 +460,17 @@ std::string getMimeType(const std::string &path)
 
 
 
+static const char	LIST_DIRECTORY_HEAD[] = "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\"><title>Listing Directory</title><style>@import url('https://fonts.googleapis.com/css2?family=Inter:ital,opsz,wght@0,14..32,100..900;1,14..32,100..900&display=swap');body{padding: 0;margin: 0;box-sizing: border-box;font-family: 'Inter', sans-serif;background-color: #f9f9f9;}.container{--max-width: 1215px;--padding: 1rem;width: min(var(--max-width), 100% - (var(--padding) * 1.2));margin-inline: auto;}a{list-style-type: none;padding: 0;color: black;}.bigLine{width: 100%;height: 1px;background-color: #e0e0e0;margin: 1rem 0;}ul li{list-style-type: '▪️';padding: .2rem 1rem;margin: 0;}a:visited{color: #9e0999;}</style></head>";
+
 /**
- * @brief build the html page with the files in the directory
+ * @brief build the body of the html page with the files in the directory
+ * (the static head of the page is LIST_DIRECTORY_HEAD)
  */
-std::string buildPage(std::vector<std::string> files, std::string path, std::string root){
-	std::string page;
-	std::string header = "<!DOCTYPE html><html lang=\"en\"><head><meta charset=\"UTF-8\"><meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\"><title>Listing Directory</title><style>@import url('https://fonts.googleapis.com/css2?family=Inter:ital,opsz,wght@0,14..32,100..900;1,14..32,100..900&display=swap');body{padding: 0;margin: 0;box-sizing: border-box;font-family: 'Inter', sans-serif;background-color: #f9f9f9;}.container{--max-width: 1215px;--padding: 1rem;width: min(var(--max-width), 100% - (var(--padding) * 1.2));margin-inline: auto;}a{list-style-type: none;padding: 0;color: black;}.bigLine{width: 100%;height: 1px;background-color: #e0e0e0;margin: 1rem 0;}ul li{list-style-type: '▪️';padding: .2rem 1rem;margin: 0;}a:visited{color: #9e0999;}</style></head>";
+std::string buildPage(const std::vector<std::string> &files, const std::string &path, const std::string &root){
 	std::string body = "<body><div class=\"container\"><h1>Index of " + path.substr(root.size()) + "</h1><div class=\"bigLine\"></div><ul>";
 	
 	// ajoute les lien au body
-	for (std::vector<std::string>::iterator it = files.begin(); it != files.end(); ++it)
+	for (std::vector<std::string>::const_iterator it = files.begin(); it != files.end(); ++it)
 	{
 		body += "<li><a href=\"";
 		body += *it;
@@ -490,7 +480,7 @@ std::string buildPage(std::vector<std::string> files, std::string path, std::str
 	}
 	body += "</ul><div class=\"bigLine\"></div></div></body></html>";
 	
-	return header + body;
+	return body;
 }
 
 
@@ -552,27 +542,38 @@ bool is_path_within_root(const std::string& root, std::string& path) {
 
 /**
  * @brief List all files in a directory
+ * queue the headers, the static head of the page and the listing
  * @param path path of the directory
+ * @param cache if enabled, the rendered page is served from and kept in it
  * 
  */
-std::string listDirectory(std::string path, std::string root){
+void listDirectory(std::string path, std::string root, OutputBuffer &output, FileCache *cache){
 
 	cleanPath(path);
 	if (path[0] != '.')
 		path.insert(0, ".");
-	Logger::log(Logger::DEBUG, "Root: %s", root.c_str());
-	Logger::log(Logger::DEBUG, "Path: %s", path.c_str());
+	LOG_DEBUG("Root: %s", root.c_str());
+	LOG_DEBUG("Path: %s", path.c_str());
 
 	if (!is_path_within_root(root, path)) {
-		Logger::log(Logger::ERROR, "Path asked is not within root");
-		return ErrorPage::getPage(403);
+		LOG_ERROR("Path asked is not within root");
+		return ErrorPage::pushPage(output, 403);
 	}
 
+	// the page depends on the root too, for its title
+	std::string key = path + "\n" + root;
+	const FileCache::Entry *cached;
+	if (cache && cache->isEnabled() && (cached = cache->lookup(key)) != NULL)
+		return FileCache::pushEntry(output, *cached);
+
 	std::vector<std::string> files;
+	struct stat dirStat;
 	DIR *dir = opendir(path.c_str());
-	if (dir == NULL){
-		Logger::log(Logger::ERROR, "Failed to open directory: %s", path.c_str());
-		return ErrorPage::getPage(404);
+	if (dir == NULL || fstat(dirfd(dir), &dirStat) == -1){
+		LOG_ERROR("Failed to open directory: %s", path.c_str());
+		if (dir)
+			closedir(dir);
+		return ErrorPage::pushPage(output, 404);
 	}
 	struct dirent *ent;
 	while ((ent = readdir(dir)) != NULL)
@@ -584,9 +585,18 @@ std::string listDirectory(std::string path, std::string root){
 	std::string body = buildPage(files, path, root);
 	std::string header = "HTTP/1.1 200 OK\r\n";
 	header += "Content-Type: text/html\r\n";
-	header += "Content-Length: " + intToString(body.size()) + "\r\n";
+	header += "Content-Length: " + intToString(sizeof(LIST_DIRECTORY_HEAD) - 1 + body.size()) + "\r\n";
 	header += "\r\n";
-	return header + body;
+	if (cache && cache->isEnabled())
+	{
+		body.insert(0, LIST_DIRECTORY_HEAD, sizeof(LIST_DIRECTORY_HEAD) - 1);
+		if ((cached = cache->insert(key, path, header, body, dirStat)) != NULL)
+			return FileCache::pushEntry(output, *cached);
+		body.erase(0, sizeof(LIST_DIRECTORY_HEAD) - 1);
+	}
+	output.push(header);
+	output.pushStatic(LIST_DIRECTORY_HEAD, sizeof(LIST_DIRECTORY_HEAD) - 1);
+	output.push(body);
 }
 
 
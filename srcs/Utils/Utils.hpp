@@ -21,6 +21,10 @@
 #include "Logger.hpp"
 #include "ConfigParser.hpp"
 #include "ErrorPage.hpp"
+#include "MimeTypes.hpp"
+
+class OutputBuffer;
+class FileCache;
 
 class Utils
 {
@@ -58,15 +62,19 @@ std::string getMimeType(const std::string &path);
 
 
 // epoll utils
-void addSocketEpoll(int epollFD, int sockFD, uint32_t flags);
-void modifySocketEpoll(int epollFD, int sockFD, uint32_t flags);
+void addSocketEpoll(int epollFD, int sockFD, uint32_t flags, void *data);
+void modifySocketEpoll(int epollFD, int sockFD, uint32_t flags, void *data);
 void deleteSocketEpoll(int epollFD, int sockFD);
 
+// child process utils
+int openPidFd(pid_t pid);
+void resetSignalMask(void);
+
 // list directory
-std::string buildPage(std::vector<std::string> files, std::string path, std::string root);
+std::string buildPage(const std::vector<std::string> &files, const std::string &path, const std::string &root);
 void cleanPath(std::string& path);
 bool is_path_within_root(const std::string& root, std::string& path) ;
-std::string listDirectory(std::string path, std::string root);
+void listDirectory(std::string path, std::string root, OutputBuffer &output, FileCache *cache = NULL);
 
 class IntException : public std::exception {
 private:
@@ -6,7 +6,12 @@ int ConfigParser::countLineFile = 0;
 
 void signalHandler(int signum) {
 	g_server->stop();
-	Logger::log(Logger::DEBUG, "interrupt signal (%d) received.", signum);
+	LOG_DEBUG("interrupt signal (%d) received.", signum);
+}
+
+void reopenHandler(int signum) {
+	(void)signum;
+	g_server->reopenLogs();
 }
 
 int main(int ac, char **av)
@@ -20,17 +25,22 @@ int main(int ac, char **av)
 		return (args.help(), args.getState());
 	
 	signal(SIGINT, signalHandler);
+	signal(SIGUSR1, reopenHandler); // Log rotation
+	signal(SIGPIPE, SIG_IGN); // A peer closing mid-response must not kill the server, send/sendfile report EPIPE instead
 	try{
 		server.getConfigParser().parse(args.getConfigFilePath());
-		Logger::log(Logger::INFO, "Configuration file parsed");
+		LOG_INFO("Configuration file parsed");
 		if (Logger::getLogDebugState())
 			server.getConfigParser().printServers();
+		Logger::start();
 		server.init();
 		server.run();
 	} catch (const std::exception &e){
+		Logger::stop();
 		return (EXIT_FAILURE);
 	}
-	Logger::log(Logger::DEBUG, "Server stopped");
+	LOG_DEBUG("Server stopped");
+	Logger::stop();
 	
 	return (EXIT_SUCCESS);
 }
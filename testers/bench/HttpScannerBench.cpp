@@ -0,0 +1,132 @@
+/*
+** Times the HttpScanner kernels against the <cctype> loops the request
+** parser used before them (memchr to the delimiter, then isalnum/isprint
+** per byte), on fixed header names, header values and URIs.
+** The scanner source is included to reach every kernel, not only the one
+** the dispatch picks. x86-64 only, the Makefile skips it elsewhere.
+*/
+#include "../../srcs/Request/HttpScanner.cpp"
+
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+
+#define BENCH_ROUNDS 2000000
+
+static const char	*g_names[] = {
+	"Host:", "User-Agent:", "Accept:", "Accept-Language:", "Accept-Encoding:",
+	"Connection:", "Cookie:", "Content-Type:", "Content-Length:", "X-Forwarded-For:", NULL
+};
+static const char	*g_values[] = {
+	"localhost:8080\r\n",
+	"Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n",
+	"text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n",
+	"en-US,en;q=0.5\r\n",
+	"gzip, deflate, br, zstd\r\n",
+	"keep-alive\r\n",
+	"session=3f1c9a7be2d84c06a1f5e9d2b7c4a8e0; theme=dark; lang=en; tracking=0b6e2f5a9d1c4e7b8a3f6d0c2e5b9a14\r\n",
+	"application/x-www-form-urlencoded\r\n",
+	"1048576\r\n",
+	"203.0.113.195, 70.41.3.18, 150.172.238.178\r\n",
+	NULL
+};
+static const char	*g_uris[] = {
+	"/ HTTP/1.1",
+	"/index.html HTTP/1.1",
+	"/static/css/main.3f1c9a7b.chunk.css HTTP/1.1",
+	"/api/v1/users/12345/profile?fields=name,email,avatar&sort=desc HTTP/1.1",
+	"/search?q=epoll+edge+triggered+vs+level+triggered&page=2&per_page=50&lang=en HTTP/1.1",
+	NULL
+};
+
+/* --- The loops replaced by the kernels --- */
+
+static size_t	scanTokenCctype(const char *data, size_t size)
+{
+	const char	*colon = static_cast<const char *>(memchr(data, ':', size));
+	size_t		end = colon ? colon - data : size;
+
+	for (size_t i = 0; i < end; i++)
+		if (!std::isalnum(data[i]) && data[i] != '-' && data[i] != '_')
+			return (i);
+	return (end);
+}
+
+static size_t	scanUriCctype(const char *data, size_t size)
+{
+	const char	*space = static_cast<const char *>(memchr(data, ' ', size));
+	size_t		end = space ? space - data : size;
+
+	for (size_t i = 0; i < end; i++)
+		if (!std::isprint(data[i]))
+			return (i);
+	return (end);
+}
+
+static size_t	scanPrintCctype(const char *data, size_t size)
+{
+	const char	*newLine = static_cast<const char *>(memchr(data, '\n', size));
+	size_t		end = newLine ? newLine - data : size;
+	size_t		i = 0;
+
+	while (i < end && std::isprint(data[i]))
+		i++;
+	return (i);
+}
+
+/* --- Timing --- */
+
+static uint64_t	nowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+/*
+** @brief Scan every input BENCH_ROUNDS times, print the ns per input and
+** the throughput. The sum of the results keeps the calls from being dropped
+*/
+static void	run(const char *input, const char *kernel, HttpScanner::t_kernel scan, const char **inputs)
+{
+	size_t	sizes[16];
+	size_t	count = 0;
+	size_t	bytes = 0;
+	size_t	sum = 0;
+
+	for (; inputs[count] != NULL; count++)
+		bytes += (sizes[count] = strlen(inputs[count]));
+	uint64_t start = nowNs();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+		for (size_t i = 0; i < count; i++)
+			sum += scan(inputs[i], sizes[i]);
+	uint64_t elapsed = nowNs() - start;
+	printf("%-8s %-8s %8.2f ns/input %8.2f GB/s   (%zu)\n", input, kernel,
+		(double)elapsed / ((double)BENCH_ROUNDS * count),
+		(double)bytes * BENCH_ROUNDS / elapsed, sum);
+}
+
+int	main(void)
+{
+	struct Case
+	{
+		const char				*input;
+		const char				**inputs;
+		HttpScanner::t_kernel	kernels[3];
+	};
+	const Case	cases[] = {
+		{ "name", g_names, { scanTokenCctype, scanTokenScalar, scanTokenSse2 } },
+		{ "value", g_values, { scanPrintCctype, scanPrintScalar, scanPrintSse2 } },
+		{ "uri", g_uris, { scanUriCctype, scanUriScalar, scanUriSse2 } }
+	};
+	const char	*kernels[] = { "cctype", "scalar", "sse2" };
+
+	printf("HttpScanner (dispatch picks %s), %d rounds\n", HttpScanner::getKernelName(), BENCH_ROUNDS);
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+		for (size_t k = 0; k < 3; k++)
+			run(cases[c].input, kernels[k], cases[c].kernels[k], cases[c].inputs);
+	return (0);
+}
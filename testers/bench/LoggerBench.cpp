@@ -0,0 +1,89 @@
+/*
+** Times a request's worth of debug statements with debug off: the
+** LOG_DEBUG macro, which skips the arguments, against the Logger::log
+** calls it replaced, which built them (state names, a copy of the
+** response) before returning.
+*/
+#include "Logger.hpp"
+
+#include <stdint.h>
+
+#define BENCH_ROUNDS 200000
+#define BENCH_RESPONSE_SIZE 16384
+
+/*
+** A request and its response, the getters return copies like the ones of
+** Request and Response
+*/
+class FakeRequest
+{
+	public:
+		FakeRequest(void) : _method("GET"), _uri("/api/v1/users/12345/profile"), _host("localhost"), _response(BENCH_RESPONSE_SIZE, 'x') {}
+
+		__attribute__((noinline)) std::string	getStateStr(int state) const { static const char *names[] = { "INIT", "REQUEST_LINE", "HEADERS", "BODY", "FINISH" }; return (names[state % 5]); }
+		__attribute__((noinline)) std::string	getResponse(void) const { return (this->_response); }
+
+		std::string	_method;
+		std::string	_uri;
+		std::string	_host;
+		std::string	_response;
+};
+
+static uint64_t	nowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+__attribute__((noinline)) static void	requestMacro(const FakeRequest &r, int fd)
+{
+	LOG_DEBUG("[handleRequest] Handling request from client %d", fd);
+	LOG_DEBUG("Method: %s", r._method.c_str());
+	LOG_DEBUG("URI: %s", r._uri.c_str());
+	for (int state = 0; state < 4; state++)
+		LOG_DEBUG("[_setState] Request state changed from %s to %s with state code: %d", r.getStateStr(state).c_str(), r.getStateStr(state + 1).c_str(), 0);
+	LOG_DEBUG("[_findServer] Host: %s", r._host.c_str());
+	LOG_DEBUG("[setState (response)] Response PROCESS");
+	LOG_DEBUG("[prepareStandardResponse] Opening file %s", r._uri.c_str());
+	LOG_DEBUG("[setState (response)] Response FINISH");
+	LOG_DEBUG("Response to sent: \n%s", r.getResponse().c_str());
+	LOG_DEBUG("Sent %d bytes to client %d", BENCH_RESPONSE_SIZE, fd);
+	LOG_DEBUG("Response sent to client %d", fd);
+}
+
+__attribute__((noinline)) static void	requestLog(const FakeRequest &r, int fd)
+{
+	Logger::log(Logger::DEBUG, "[handleRequest] Handling request from client %d", fd);
+	Logger::log(Logger::DEBUG, "Method: %s", r._method.c_str());
+	Logger::log(Logger::DEBUG, "URI: %s", r._uri.c_str());
+	for (int state = 0; state < 4; state++)
+		Logger::log(Logger::DEBUG, "[_setState] Request state changed from %s to %s with state code: %d", r.getStateStr(state).c_str(), r.getStateStr(state + 1).c_str(), 0);
+	Logger::log(Logger::DEBUG, "[_findServer] Host: %s", r._host.c_str());
+	Logger::log(Logger::DEBUG, "[setState (response)] Response PROCESS");
+	Logger::log(Logger::DEBUG, "[prepareStandardResponse] Opening file %s", r._uri.c_str());
+	Logger::log(Logger::DEBUG, "[setState (response)] Response FINISH");
+	Logger::log(Logger::DEBUG, "Response to sent: \n%s", r.getResponse().c_str());
+	Logger::log(Logger::DEBUG, "Sent %d bytes to client %d", BENCH_RESPONSE_SIZE, fd);
+	Logger::log(Logger::DEBUG, "Response sent to client %d", fd);
+}
+
+static void	run(const char *name, void (*request)(const FakeRequest &, int))
+{
+	FakeRequest	r;
+
+	uint64_t start = nowNs();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+		request(r, round);
+	printf("%-12s %8.1f ns/request\n", name, (double)(nowNs() - start) / BENCH_ROUNDS);
+}
+
+int	main(void)
+{
+	Logger::setLogDebugState(false);
+	printf("14 debug statements per request, debug off, %d rounds\n", BENCH_ROUNDS);
+	run("LOG_DEBUG", requestMacro);
+	run("Logger::log", requestLog);
+	return (0);
+}
@@ -0,0 +1,86 @@
+/*
+** Times the launch of a trivial program by a process holding a large
+** touched heap, like a server with its caches full: fork + execve copies
+** the page tables of the parent, posix_spawn (vfork) does not.
+** A launch is timed until the child is reaped.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdint.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_PROGRAM	"/bin/true"
+#define BENCH_ROUNDS	200
+
+extern char	**environ;
+static char	*volatile g_heap; // The heap escapes, its pages are kept
+
+static uint64_t	nowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static pid_t	launchFork(char *const argv[])
+{
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		execve(argv[0], argv, environ);
+		_exit(127);
+	}
+	return (pid);
+}
+
+static pid_t	launchSpawn(char *const argv[])
+{
+	pid_t pid;
+	if (posix_spawn(&pid, argv[0], NULL, NULL, argv, environ) != 0)
+		return (-1);
+	return (pid);
+}
+
+/*
+** @brief Launch and reap the program BENCH_ROUNDS times, print the mean
+*/
+static int	run(size_t heapMb, const char *name, pid_t (*launch)(char *const[]))
+{
+	char	program[] = BENCH_PROGRAM;
+	char	*argv[] = { program, NULL };
+	int		status;
+
+	uint64_t start = nowNs();
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+	{
+		pid_t pid = launch(argv);
+		if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			return (perror(name), -1);
+	}
+	printf("%5zu MB heap  %-12s %8.1f us/launch\n", heapMb, name, (double)(nowNs() - start) / BENCH_ROUNDS / 1000);
+	return (0);
+}
+
+int	main(void)
+{
+	const size_t	heaps[] = { 0, 256, 1024 };
+
+	printf("Launch of %s, %d rounds\n", BENCH_PROGRAM, BENCH_ROUNDS);
+	for (size_t i = 0; i < sizeof(heaps) / sizeof(heaps[0]); i++)
+	{
+		size_t	size = heaps[i] << 20;
+		char	*heap = static_cast<char *>(malloc(size ? size : 1));
+		if ((g_heap = heap) == NULL)
+			return (perror("malloc"), 1);
+		memset(heap, 1, size); // Every page mapped
+		if (run(heaps[i], "fork+execve", launchFork) == -1 || run(heaps[i], "posix_spawn", launchSpawn) == -1)
+			return (free(heap), 1);
+		free(heap);
+	}
+	return (0);
+}
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""FastCGI responder for webserv's fastcgi_pass.
+
+Started by the server with a listening Unix socket as fd 0 (FCGI_LISTENSOCK_FILENO).
+It runs the CGI scripts in this long-lived process: the script named by
+SCRIPT_FILENAME is executed with the request params as os.environ, the
+body as sys.stdin and sys.stdout captured as the response, so the existing
+.py scripts work unchanged without paying for the interpreter startup.
+
+    fastcgi_pass .py /usr/bin/python3 ./www/fastcgi/responder.py
+"""
+
+import io
+import os
+import runpy
+import socket
+import struct
+import sys
+import traceback
+
+FCGI_VERSION_1 = 1
+FCGI_BEGIN_REQUEST = 1
+FCGI_ABORT_REQUEST = 2
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_STDERR = 7
+FCGI_GET_VALUES = 9
+FCGI_GET_VALUES_RESULT = 10
+FCGI_UNKNOWN_TYPE = 11
+FCGI_KEEP_CONN = 1
+FCGI_REQUEST_COMPLETE = 0
+FCGI_UNKNOWN_ROLE = 3
+FCGI_RESPONDER = 1
+FCGI_MAX_CONTENT = 65535
+
+HEADER = struct.Struct("!BBHHBx")
+BASE_ENVIRON = dict(os.environ)
+
+
+def read_exact(conn, size):
+    data = b""
+    while len(data) < size:
+        chunk = conn.recv(size - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return data
+
+
+def read_record(conn):
+    header = read_exact(conn, HEADER.size)
+    if header is None:
+        return None
+    _, kind, request_id, length, padding = HEADER.unpack(header)
+    content = read_exact(conn, length + padding)
+    if content is None:
+        return None
+    return kind, request_id, content[:length]
+
+
+def write_record(conn, kind, request_id, data=b""):
+    records = []
+    for offset in range(0, max(len(data), 1), FCGI_MAX_CONTENT):
+        chunk = data[offset:offset + FCGI_MAX_CONTENT]
+        records.append(HEADER.pack(FCGI_VERSION_1, kind, request_id, len(chunk), 0) + chunk)
+    conn.sendall(b"".join(records))
+
+
+def read_length(data, offset):
+    if data[offset] < 128:
+        return data[offset], offset + 1
+    return struct.unpack("!I", data[offset:offset + 4])[0] & 0x7FFFFFFF, offset + 4
+
+
+def parse_params(data):
+    params = {}
+    offset = 0
+    while offset < len(data):
+        name_length, offset = read_length(data, offset)
+        value_length, offset = read_length(data, offset)
+        name = data[offset:offset + name_length].decode("latin-1")
+        offset += name_length
+        params[name] = data[offset:offset + value_length].decode("latin-1")
+        offset += value_length
+    return params
+
+
+def encode_params(params):
+    data = b""
+    for name, value in params.items():
+        for item in (name, value):
+            data += bytes([len(item)]) if len(item) < 128 else struct.pack("!I", len(item) | 0x80000000)
+        data += name.encode() + value.encode()
+    return data
+
+
+def run_script(params, body):
+    """Run a CGI script in process, return its output and exit status"""
+    output = io.BytesIO()
+    saved = (sys.stdin, sys.stdout, sys.argv, os.getcwd())
+    os.environ.clear()
+    os.environ.update(BASE_ENVIRON)
+    os.environ.update(params)
+    stdout = io.TextIOWrapper(output, encoding="utf-8", write_through=True)
+    sys.stdin = io.TextIOWrapper(io.BytesIO(body), encoding="utf-8", errors="surrogateescape")
+    sys.stdout = stdout
+    sys.argv = [params.get("SCRIPT_FILENAME", "")]
+    status = 0
+    try:
+        runpy.run_path(sys.argv[0], run_name="__main__")
+    except SystemExit as e:
+        status = e.code if isinstance(e.code, int) else (0 if e.code is None else 1)
+    except Exception:
+        traceback.print_exc(file=sys.stderr)
+        status = 1
+    finally:
+        stdout.flush()
+        stdout.detach()  # Closing the wrapper would close the captured output
+        sys.stdin, sys.stdout, sys.argv = saved[:3]
+        os.chdir(saved[3])
+    return output.getvalue(), status
+
+
+def serve(conn):
+    """Serve the requests of one connection, kept open with FCGI_KEEP_CONN"""
+    request_id, keep_conn, params, stdin = None, False, b"", b""
+    while True:
+        record = read_record(conn)
+        if record is None:
+            return
+        kind, rid, content = record
+        if kind == FCGI_GET_VALUES:
+            values = {"FCGI_MAX_CONNS": "1", "FCGI_MAX_REQS": "1", "FCGI_MPXS_CONNS": "0"}
+            write_record(conn, FCGI_GET_VALUES_RESULT, 0, encode_params(values))
+        elif kind == FCGI_BEGIN_REQUEST:
+            role, flags = struct.unpack("!HB", content[:3])
+            if role != FCGI_RESPONDER:
+                write_record(conn, FCGI_END_REQUEST, rid, struct.pack("!IB3x", 0, FCGI_UNKNOWN_ROLE))
+                continue
+            request_id, keep_conn, params, stdin = rid, bool(flags & FCGI_KEEP_CONN), b"", b""
+        elif rid != request_id:
+            if rid == 0:
+                write_record(conn, FCGI_UNKNOWN_TYPE, 0, bytes([kind]) + b"\0" * 7)
+        elif kind == FCGI_ABORT_REQUEST:
+            write_record(conn, FCGI_END_REQUEST, rid, struct.pack("!IB3x", 1, FCGI_REQUEST_COMPLETE))
+            request_id = None
+        elif kind == FCGI_PARAMS:
+            params += content
+        elif kind == FCGI_STDIN and content:
+            stdin += content
+        elif kind == FCGI_STDIN:
+            output, status = run_script(parse_params(params), stdin)
+            write_record(conn, FCGI_STDOUT, rid, output)
+            write_record(conn, FCGI_STDOUT, rid)
+            write_record(conn, FCGI_END_REQUEST, rid, struct.pack("!IB3x", status & 0xFFFFFFFF, FCGI_REQUEST_COMPLETE))
+            request_id = None
+            if not keep_conn:
+                return
+
+
+def main():
+    listener = socket.socket(fileno=0)
+    while True:
+        conn, _ = listener.accept()
+        with conn:
+            serve(conn)
+
+
+if __name__ == "__main__":
+    main()